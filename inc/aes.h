@@ -1,9 +1,19 @@
 #ifndef AES_H_
 #define AES_H_
 
+#include <stddef.h>
 #include <stdint.h>
+#include "engine.h"
+
+// marks the library API, the only symbols libaes.so exports (it is built with -fvisibility=hidden)
+#define AES_API __attribute__((visibility("default")))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 #define BUFFER_SIZE 16                  // 16 bytes (since block length is 16 bytes)
+#define CHUNK_SIZE (1 << 20)            // bytes read from the input file at a time
 #define BLOCK_SIZE_BYTES 16             // block length is fixed at 128 bits or 16 bytes
 #define AES_BLOCK_SIZE_WORDS 4          // AES block size in words
 #define WORD_SIZE_BYTES 4               // a word is 4 bytes
@@ -17,6 +27,16 @@
 #define AES_128_NUM_ROUNDS 10           // the number of rounds for AES-128 is 10
 #define AES_192_NUM_ROUNDS 12           // the number of rounds for AES-192 is 12
 #define AES_256_NUM_ROUNDS 14           // the number of rounds for AES-256 is 14
+#define AES_MODE_ECB 0                  // modes, as returned by parseInput()
+#define AES_MODE_CBC 1
+#define AES_MODE_GCM 2
+#define AES_MODE_GCM_SIV 3
+#define AES_MODE_CTR 4
+#define AES_MODE_XTS 5
+#define AES_RCON_SIZE 10                // round constants needed by the longest schedule (AES-128)
+#define AES_SCHEDULE_WORDS (AES_BLOCK_SIZE_WORDS * (AES_256_NUM_ROUNDS + 1)) // key schedule words for the largest key
+#define AES_BATCH_BLOCKS (1 << 20)      // blocks per engine call in aesEcbBlocks() and aesCryptBlocks()
+#define AES_ENGINE_KEY_BYTES (2 * (AES_256_NUM_ROUNDS + 1) * 64) // room for the largest engine key format (VAES-512)
 
 // AES-128:
     //      keyWordLength   = 4 words       = 16 bytes
@@ -35,14 +55,39 @@
 
 
 
-uint32_t subWord(uint32_t word);
-uint32_t rotWord(uint32_t word);
-void createKeySchedule(uint32_t* key, int keyLengthInWords, int numRounds);
-void addRoundKey(uint8_t* block, int round);
-void createRoundConstantArray(int RconArraySize);
-void swapRowsAndColumns(uint8_t* block);
-void cleanup();
-void aesEncrypt(uint8_t* inBuf, int numRounds);
-void aesDecrypt(uint8_t* inBuf, int numRounds);
+/*
+ * Everything needed to en/de-crypt with one key. Contexts share nothing,
+ * so any number of them can be used at once from different threads; a
+ * single context can be shared by threads for the block functions, which
+ * only read it.
+ */
+struct aes_ctx {
+
+    uint32_t keySchedule[AES_SCHEDULE_WORDS];    // round keys, one big endian word per column
+    uint32_t decKeySchedule[AES_SCHEDULE_WORDS]; // round keys for the equivalent inverse cipher
+    int numRounds;                  // 10, 12 or 14
+    int keyLengthInWords;           // 4, 6 or 8
+    const engine_t* engine;         // the engine running the rounds
+    kernels_t kernels;              // its block functions for this key size
+    uint8_t iv[BLOCK_SIZE_BYTES];   // chaining value: the iv, then the last ciphertext block (CBC)
+    uint8_t engineKeys[AES_ENGINE_KEY_BYTES] __attribute__((aligned(64))); // round keys in the engine's own format
+
+};
+
+AES_API int aesInit(aes_ctx_t* ctx, const uint8_t* key, int keyLengthBits, const char* engineName);
+AES_API int aesEngineSupported(const char* name);
+AES_API void aesSetIv(aes_ctx_t* ctx, const uint8_t* iv);
+AES_API void aesClear(aes_ctx_t* ctx);
+AES_API void aesWipe(void* buf, size_t length);
+AES_API void aesEncrypt(const aes_ctx_t* ctx, uint8_t* block);
+AES_API void aesDecrypt(const aes_ctx_t* ctx, uint8_t* block);
+AES_API void aesEncryptBlocks(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks);
+AES_API void aesDecryptBlocks(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks);
+AES_API void aesEcbBlocks(const aes_ctx_t* ctx, int decrypt, const uint8_t* in, uint8_t* out, size_t numBlocks);
+AES_API void aesCryptBlocks(aes_ctx_t* ctx, int mode, int decrypt, const uint8_t* in, uint8_t* out, size_t numBlocks);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif // AES_H_
@@ -0,0 +1,40 @@
+#ifndef AESNI_H_
+#define AESNI_H_
+
+#include "aes.h"
+#include "multibuf.h"
+
+// functions for the AES-NI hardware engine (x86 only)
+
+#ifdef ENGINE_X86
+
+#include <immintrin.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * AES-NI round keys, kept in the context's engineKeys
+ */
+typedef struct aesni_keys {
+
+    __m128i enc[AES_256_NUM_ROUNDS + 1];    // round keys for encryption
+    __m128i dec[AES_256_NUM_ROUNDS + 1];    // round keys for decryption (AESIMC applied)
+
+} aesni_keys_t;
+
+extern const engine_t aesniEngine;
+
+int aesniSupported(void);
+void aesniExpandRoundKeys(const uint32_t* key, int keyLengthInWords, int numRounds, aesni_keys_t* keys); // also used by the VAES engines
+void aesniMultiEncrypt(const aes_job_t* jobs, int numJobs, int keyLengthInWords, int numRounds, int mode); // up to MULTIBUF_LANES jobs
+void aesniMultiDecrypt(const aes_job_t* jobs, int numJobs, int keyLengthInWords, int numRounds, int mode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ENGINE_X86
+
+#endif // AESNI_H_
@@ -0,0 +1,20 @@
+#ifndef BITSLICE_H_
+#define BITSLICE_H_
+
+#include "aes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BITSLICE_BLOCKS 4               // blocks processed together by one pass of the circuit
+
+// functions for the bitsliced constant-time engine
+
+extern const engine_t aesBitsliceEngine;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BITSLICE_H_
@@ -1,8 +1,39 @@
 #ifndef CBC_H_
 #define CBC_H_
 
-void xor(uint8_t** a, uint8_t** b);
-void cbcEncrypt(uint8_t* inBuf, uint8_t* prevCipherOut, uint8_t* prevCipherIn, int numRounds, uint8_t* iv, int* firstRun);
-void cbcDecrypt(uint8_t* inBuf, uint8_t* prevCipherOut, uint8_t* prevCipherIn, int numRounds, uint8_t* iv, int* firstRun);
+#include "aes.h"
+#include "threads.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CBC_BATCH_BLOCKS 256            // blocks decrypted together before the XOR pass (4 KiB, stays in L1)
+
+#define CBC_MAX_STREAMS 8               // chains advanced together by cbcEncryptStreams
+
+/*
+ * One of several independent CBC chains encrypted together under one key
+ */
+typedef struct cbc_stream {
+
+    const uint8_t* in;                  // the plaintext blocks
+    uint8_t* out;                       // where the ciphertext goes; may be in, but must not otherwise overlap it
+    size_t numBlocks;
+    uint8_t iv[BUFFER_SIZE];            // the chaining value, updated to the last ciphertext block
+
+} cbc_stream_t;
+
+void aesXorBlocks(uint8_t* out, const uint8_t* a, const uint8_t* b, size_t numBlocks);
+AES_API void cbcEncrypt(aes_ctx_t* ctx, uint8_t* block);
+AES_API void cbcDecrypt(aes_ctx_t* ctx, uint8_t* block);
+AES_API void cbcEncryptBlocks(aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks);
+AES_API void cbcEncryptStreams(const aes_ctx_t* ctx, cbc_stream_t* streams, int numStreams);
+AES_API void cbcDecryptBlocks(aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks);
+AES_API void poolCbcDecryptBlocks(thread_pool_t* pool, aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, size_t numBlocks);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif // CBC_H_
\ No newline at end of file
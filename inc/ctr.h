@@ -0,0 +1,22 @@
+#ifndef CTR_H_
+#define CTR_H_
+
+#include <stdint.h>
+#include "aes.h"
+#include "threads.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CTR_BATCH_BLOCKS 128            // counter blocks encrypted per engine call (2 KiB, stays in L1)
+
+AES_API void ctrCounterAt(const uint8_t* iv, uint64_t blockIndex, uint8_t* counter);
+AES_API void ctrCrypt(const aes_ctx_t* ctx, const uint8_t* iv, uint64_t offset, const uint8_t* in, uint8_t* out, size_t length);
+AES_API void poolCtrCrypt(thread_pool_t* pool, const aes_ctx_t* ctx, const uint8_t* iv, uint64_t offset, const uint8_t* in, uint8_t* out, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CTR_H_
@@ -3,19 +3,20 @@
 
 #include "aes.h"
 
-extern const uint8_t invSbox[256];
+#ifdef __cplusplus
+extern "C" {
+#endif
 
-// functions for DECRYPTING data using an AES encryption scheme
+// tables for DECRYPTING data using an AES encryption scheme
 
-// inv subbytes
-uint8_t invSubByte(uint8_t inputByte);
+extern const uint8_t aesInvSbox[256];
+extern const uint32_t aesTd0[256];  // inverse T-tables, one per row: InvSubBytes + InvMixColumns
+extern const uint32_t aesTd1[256];  // as a single lookup per state byte
+extern const uint32_t aesTd2[256];
+extern const uint32_t aesTd3[256];
 
-void invSubBytes(uint8_t* block);
-
-// inv shift row
-void invShiftRows(uint8_t* block);
-
-// inv mix columns
-void invMixColumns(uint8_t* block);
+#ifdef __cplusplus
+}
+#endif
 
 #endif // DECRYPT_H_
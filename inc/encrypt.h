@@ -3,20 +3,23 @@
 
 #include "aes.h"
 
-extern const uint8_t sbox[256];
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern const uint8_t aesSbox[256];
+extern const uint32_t aesTe0[256];  // T-tables, one per row: SubBytes + ShiftRows + MixColumns
+extern const uint32_t aesTe1[256];  // as a single lookup per state byte
+extern const uint32_t aesTe2[256];
+extern const uint32_t aesTe3[256];
 
 // functions for ENCRYPTING data using an AES encryption scheme
 
 // subbyte
-uint8_t subByte(uint8_t inputByte);
-
-// subbytes
-void subBytes(uint8_t* block);
-
-// shift row
-void shiftRows(uint8_t* block);
+uint8_t aesSubByte(uint8_t inputByte);
 
-// mix columns
-void mixColumns(uint8_t* block);
+#ifdef __cplusplus
+}
+#endif
 
 #endif // ENCRYPT_H_
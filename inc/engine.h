@@ -0,0 +1,114 @@
+#ifndef ENGINE_H_
+#define ENGINE_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ENGINE_X86 1                    // x86 specific engines (AES-NI, ...) can be built
+#endif
+
+typedef struct aes_ctx aes_ctx_t;       // defined in aes.h
+
+/*
+ * The block functions used for a key. aesSelectKernels() fills these in once
+ * the key size is known, with the versions fixed to that round count when
+ * the engine has them.
+ */
+typedef struct kernels {
+
+    void (*encrypt)(const aes_ctx_t* ctx, uint8_t* block);
+    void (*decrypt)(const aes_ctx_t* ctx, uint8_t* block);
+    void (*encryptBlocks)(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks);
+    void (*decryptBlocks)(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks);
+
+} kernels_t;
+
+/*
+ * A block cipher engine. Every engine implements the same single block
+ * primitives on the column-major state block used by aes.c; aesInit()
+ * picks one based on what the CPU supports.
+ *
+ * Engines keep no state of their own: round keys in the engine's format
+ * go into the context's engineKeys area (see ENGINE_KEYS).
+ */
+typedef struct engine {
+
+    const char* name;                   // name used with -engine
+    int (*isSupported)(void);           // 1 if the running CPU can use this engine
+    void (*expandKey)(aes_ctx_t* ctx);  // engine specific key schedule, NULL if the shared one is enough
+    void (*encrypt)(const aes_ctx_t* ctx, uint8_t* block);
+    void (*decrypt)(const aes_ctx_t* ctx, uint8_t* block);
+    void (*encryptBlocks)(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks); // several independent blocks, NULL to loop over encrypt
+    void (*decryptBlocks)(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks); // several independent blocks, NULL to loop over decrypt
+    void (*specialize)(int numRounds, kernels_t* kernels); // swap in kernels fixed to numRounds, NULL if there are none
+
+} engine_t;
+
+const engine_t* aesSelectEngine(const char* name);
+void aesSelectKernels(aes_ctx_t* ctx);
+
+extern const engine_t aesTtableEngine;  // portable C engine using the T-tables, in aes.c
+
+// an engine's round keys, stored in the context
+#define ENGINE_KEYS(type, ctx) ((type*) (ctx)->engineKeys)
+
+// fail the build if an engine's round keys do not fit in the context
+#define CHECK_ENGINE_KEYS(type) \
+    _Static_assert(sizeof(type) <= AES_ENGINE_KEY_BYTES, #type " does not fit in aes_ctx_t")
+
+
+
+/*
+ * Generate AES-128/192/256 entry points from one kernel source.
+ *
+ * An engine writes prefix##EncryptKernel / prefix##DecryptKernel(ctx, in,
+ * out, numBlocks, numRounds) as always-inline functions. Each entry point
+ * below passes a constant round count, so the compiler fully unrolls the
+ * round loop and can keep every round key in a register. DEFINE_KERNELS
+ * also defines prefix##Specialize() to hook into the engine's specialize
+ * field.
+ */
+#define DEFINE_KERNELS_FOR(prefix, target, bits) \
+    target static void prefix##Encrypt##bits(const aes_ctx_t* ctx, uint8_t* block) { \
+        prefix##EncryptKernel(ctx, block, block, 1, AES_##bits##_NUM_ROUNDS); \
+    } \
+    target static void prefix##Decrypt##bits(const aes_ctx_t* ctx, uint8_t* block) { \
+        prefix##DecryptKernel(ctx, block, block, 1, AES_##bits##_NUM_ROUNDS); \
+    } \
+    target static void prefix##EncryptBlocks##bits(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks) { \
+        prefix##EncryptKernel(ctx, in, out, numBlocks, AES_##bits##_NUM_ROUNDS); \
+    } \
+    target static void prefix##DecryptBlocks##bits(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks) { \
+        prefix##DecryptKernel(ctx, in, out, numBlocks, AES_##bits##_NUM_ROUNDS); \
+    }
+
+#define SET_KERNELS_FOR(prefix, bits, kernels) \
+    (kernels)->encrypt = prefix##Encrypt##bits; \
+    (kernels)->decrypt = prefix##Decrypt##bits; \
+    (kernels)->encryptBlocks = prefix##EncryptBlocks##bits; \
+    (kernels)->decryptBlocks = prefix##DecryptBlocks##bits
+
+#define DEFINE_KERNELS(prefix, target) \
+    DEFINE_KERNELS_FOR(prefix, target, 128) \
+    DEFINE_KERNELS_FOR(prefix, target, 192) \
+    DEFINE_KERNELS_FOR(prefix, target, 256) \
+    static void prefix##Specialize(int numRounds, kernels_t* kernels) { \
+        switch (numRounds) { \
+            case AES_128_NUM_ROUNDS: SET_KERNELS_FOR(prefix, 128, kernels); break; \
+            case AES_192_NUM_ROUNDS: SET_KERNELS_FOR(prefix, 192, kernels); break; \
+            case AES_256_NUM_ROUNDS: SET_KERNELS_FOR(prefix, 256, kernels); break; \
+        } \
+    }
+
+// force a kernel inline so the constant round count reaches its loops
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ENGINE_H_
@@ -0,0 +1,59 @@
+#ifndef FILEIO_H_
+#define FILEIO_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "pipeline.h"
+#include "uring.h"
+
+#define IO_STDIO "-"                    // the file name for stdin (input) and stdout (output)
+
+/*
+ * The input and output file of one job of the command line tool. Files
+ * that can be are mapped, and the cipher reads straight from the input's
+ * pages and writes straight to the output's; anything else goes through
+ * fread and fwrite, on reader and writer threads once ioStart() is called
+ * and with buf before that. With useRing, regular files are not mapped
+ * but read and written through io_uring; with direct as well, with
+ * O_DIRECT, and what still goes through the page cache is dropped
+ * behind the reads and writes. An input that cannot seek (a pipe, stdin)
+ * is streamed: read to its end, whatever its size.
+ */
+typedef struct file_io {
+
+    FILE* read;
+    FILE* write;
+    const uint8_t* inMap;               // the whole input, NULL when it is read with fread
+    uint8_t* outMap;                    // the whole output, NULL when it is written with fwrite
+    unsigned long inSize;               // 0 when inStream
+    unsigned long outSize;              // the size the output was allocated (and mapped) at
+    unsigned long inPos;                // next byte of the input
+    unsigned long outPos;               // next byte of the output
+    uint8_t* buf;                       // for fread / fwrite, room for a read plus a block
+    io_pipeline_t pipeline;             // reader and writer threads for the sides not mapped
+    int piped;                          // 1 once the pipeline is running
+    io_buffer_t* current;               // the pipeline buffer being en/de-crypted, if any
+    int inEnded;                        // the reader has handed over the end of the input
+    int useRing;                        // set before ioMap() to use io_uring rather than mapping
+    int direct;                         // set before ioMap() to keep the files out of the page cache
+    io_ring_t ring;
+    int ringed;                         // 1 once the ring is running
+    int inStream;                       // the input's size is not known up front
+    int outStream;                      // the output is stdout, only ever appended to
+    int failed;                         // a read or write on the calling thread failed
+
+} file_io_t;
+
+void ioKeepStdout(void);
+int ioOpen(file_io_t* io, const char* inputFilename, const char* outputFilename, uint8_t* buf);
+int ioMap(file_io_t* io, unsigned long outSize);
+int ioSeek(file_io_t* io, unsigned long offset);
+void ioStart(file_io_t* io, unsigned long inLength, size_t chunkSize);
+size_t ioRead(file_io_t* io, const uint8_t** data, size_t length);
+int ioReadTail(file_io_t* io, uint8_t* data, size_t length);
+uint8_t* ioOutput(file_io_t* io);
+void ioCommit(file_io_t* io, size_t length);
+void ioWriteBytes(file_io_t* io, const uint8_t* data, size_t length);
+int ioClose(file_io_t* io);
+
+#endif // FILEIO_H_
@@ -0,0 +1,84 @@
+#ifndef GCM_H_
+#define GCM_H_
+
+#include <stddef.h>
+#include "aes.h"
+#include "threads.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GCM_IV_LENGTH 12                // bytes in the recommended (96 bit) iv, the one -aes-gcm takes
+#define GCM_TAG_LENGTH 16               // bytes in the authentication tag
+#define GCM_MAX_LENGTH (((uint64_t) 1 << 36) - 32) // most bytes of plaintext in one message, 2^32 - 2 blocks (SP 800-38D 5.2.1.1)
+#define GCM_AGGREGATE 8                 // blocks hashed per reduction (powers of H kept)
+#define GCM_BATCH_BLOCKS 64             // blocks of keystream made per engine call
+#define GCM_SIV_NONCE_LENGTH 12         // bytes in an AES-GCM-SIV nonce
+#define GCM_SIV_MAX_LENGTH ((uint64_t) 1 << 36) // most bytes of plaintext or aad in one message (RFC 8452)
+
+/*
+ * Galois/Counter Mode state for one message. The keystream comes from
+ * the AES context; GHASH runs with PCLMULQDQ when the CPU has it and
+ * with 4-bit tables (Shoup's method) otherwise.
+ */
+typedef struct gcm_ctx {
+
+    const aes_ctx_t* aes;               // the key, only read
+    int usePclmul;                      // 1 for the carry-less multiply GHASH
+    int useStitched;                    // 1 for the combined AES-NI + PCLMULQDQ kernel
+    uint8_t hPowers[GCM_AGGREGATE][BLOCK_SIZE_BYTES] __attribute__((aligned(16))); // H^1..H^8, byte reversed (PCLMULQDQ)
+    uint8_t roundKeys[AES_256_NUM_ROUNDS + 1][BLOCK_SIZE_BYTES] __attribute__((aligned(16))); // AES-NI round keys (stitched kernel)
+    uint64_t tableHigh[16];             // multiples of H by every 4 bit value (tables)
+    uint64_t tableLow[16];
+    uint8_t j0[BLOCK_SIZE_BYTES];       // the pre-counter block, encrypted for the tag
+    uint8_t counter[BLOCK_SIZE_BYTES];  // the next counter block
+    uint8_t hash[BLOCK_SIZE_BYTES];     // the GHASH value so far
+    uint8_t keystream[BLOCK_SIZE_BYTES]; // keystream of a block part way through
+    int blockUsed;                      // bytes of the current block already en/de-crypted and hashed
+    uint64_t aadLength;                 // bytes
+    uint64_t textLength;                // bytes
+    int decrypt;
+
+} gcm_ctx_t;
+
+/*
+ * AES-GCM-SIV (RFC 8452) state for one message. The keys are derived
+ * from the key-generating key and the nonce, so repeating a nonce only
+ * shows whether two messages were the same.
+ */
+typedef struct gcm_siv_ctx {
+
+    aes_ctx_t encryption;               // the message-encryption key
+    gcm_ctx_t polyval;                  // the message-authentication key and the POLYVAL value so far
+    uint8_t nonce[GCM_SIV_NONCE_LENGTH];
+    uint8_t counter[BLOCK_SIZE_BYTES];  // CTR block, the first 32 bits a little endian counter
+    uint64_t aadLength;                 // bytes
+    uint64_t textLength;                // bytes
+
+} gcm_siv_ctx_t;
+
+AES_API int gcmInit(gcm_ctx_t* gcm, const aes_ctx_t* aes, const uint8_t* iv, size_t ivLength, int decrypt);
+AES_API void gcmAad(gcm_ctx_t* gcm, const uint8_t* aad, size_t length);
+AES_API int gcmUpdate(gcm_ctx_t* gcm, const uint8_t* in, uint8_t* out, size_t length);
+AES_API void gcmFinal(gcm_ctx_t* gcm, uint8_t* tag);
+AES_API int gcmVerify(gcm_ctx_t* gcm, const uint8_t* tag);
+
+AES_API int gcmSivInit(gcm_siv_ctx_t* siv, const aes_ctx_t* aes, const uint8_t* nonce);
+AES_API void gcmSivAad(gcm_siv_ctx_t* siv, const uint8_t* aad, size_t length);
+AES_API void gcmSivHash(gcm_siv_ctx_t* siv, const uint8_t* plaintext, size_t length);
+AES_API void gcmSivTag(gcm_siv_ctx_t* siv, uint8_t* tag);
+AES_API void gcmSivSetTag(gcm_siv_ctx_t* siv, const uint8_t* tag);
+AES_API void gcmSivCrypt(gcm_siv_ctx_t* siv, const uint8_t* in, uint8_t* out, size_t length, thread_pool_t* pool);
+AES_API int gcmSivVerify(gcm_siv_ctx_t* siv, const uint8_t* tag);
+AES_API void gcmSivClear(gcm_siv_ctx_t* siv);
+AES_API int gcmSivEncrypt(const aes_ctx_t* aes, const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+                          const uint8_t* in, uint8_t* out, size_t length, uint8_t* tag, thread_pool_t* pool);
+AES_API int gcmSivDecrypt(const aes_ctx_t* aes, const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+                          const uint8_t* in, uint8_t* out, size_t length, const uint8_t* tag, thread_pool_t* pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GCM_H_
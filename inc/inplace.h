@@ -0,0 +1,83 @@
+#ifndef INPLACE_H_
+#define INPLACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "aes.h"
+
+#define INPLACE_SECTOR 4096             // journaled unit, a write the device is taken to complete whole or not at all
+#define INPLACE_SEGMENT (16 << 20)      // bytes rewritten between journal entries, a multiple of INPLACE_SECTOR
+#define INPLACE_SECTORS (INPLACE_SEGMENT / INPLACE_SECTOR)
+#define INPLACE_JOURNAL_SUFFIX ".journal" // the journal is the file's name with this appended
+#define INPLACE_MAGIC "AESJRNL1"
+
+/*
+ * En/de-crypt length bytes at offset of the file, in place in data.
+ * chain is the last ciphertext block before data (CBC), to be updated to
+ * the last one of data; the other modes leave it alone.
+ */
+typedef void (*inplace_crypt_t)(void* arg, uint8_t* data, uint64_t offset, size_t length, uint8_t* chain);
+
+/*
+ * What a run was started with. A journal is only replayed by a run with
+ * the same settings, key included (by its check value).
+ */
+typedef struct inplace_run {
+
+    uint32_t mode;                      // AES_MODE_*
+    uint32_t decrypt;                   // 0 to encrypt, 1 to decrypt
+    uint64_t fileSize;
+    uint64_t start;                     // first byte en/de-crypted, -seek
+    uint64_t sectorSize;                // XTS, 0 otherwise
+    uint8_t iv[BLOCK_SIZE_BYTES];       // and the chaining value at start
+    uint8_t keyCheck[BLOCK_SIZE_BYTES]; // a fixed block encrypted with the key
+
+} inplace_run_t;
+
+/*
+ * A sector of the segment being rewritten, as it was before
+ */
+typedef struct inplace_sector {
+
+    uint64_t digest;                    // of its contents, to tell whether it has been rewritten
+    uint8_t last[BLOCK_SIZE_BYTES];     // its last block when decrypting, the chaining value after it
+
+} inplace_sector_t;
+
+/*
+ * One of the journal's two slots. Segments use them in turn, so the
+ * previous entry survives a crash while the next one is being written;
+ * the checksum tells a whole entry from a torn one.
+ */
+typedef struct inplace_journal {
+
+    char magic[8];                      // INPLACE_MAGIC
+    inplace_run_t run;
+    uint64_t sequence;                  // segments done before this one
+    uint64_t offset;                    // of the segment
+    uint64_t length;
+    uint8_t chain[BLOCK_SIZE_BYTES];    // the chaining value before the segment
+    uint64_t checksum;                  // of the whole slot, with this field 0
+    inplace_sector_t sectors[INPLACE_SECTORS];
+
+} inplace_journal_t;
+
+/*
+ * A file being en/de-crypted over itself, and its journal
+ */
+typedef struct inplace {
+
+    int fd;                             // -1 when not open
+    int journalFd;
+    char* journalName;
+    unsigned long fileSize;
+    uint8_t* buf;                       // one segment
+    inplace_journal_t* journal;
+
+} inplace_t;
+
+int inplaceOpen(inplace_t* inplace, const char* filename);
+long inplaceRun(inplace_t* inplace, const inplace_run_t* run, inplace_crypt_t crypt, void* arg);
+void inplaceClose(inplace_t* inplace);
+
+#endif // INPLACE_H_
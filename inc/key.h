@@ -39,13 +39,23 @@ typedef struct uint256 {
 
 } uint256_t;
 
-typedef struct key {
+/*
+ * A 512 bit int comprised of 16 4-byte words (an XTS-AES-256 key pair)
+ *
+ */
+typedef struct uint512 {
+
+    uint32_t w[16]; // 512 bits contains 16 words (16 x 4 bytes)
+
+} uint512_t;
+
+typedef struct aes_key {
 
     uint32_t* keyWords;
     int numRounds;
     int keyCanonLength;
     int RconArraySize;
 
-} key_t;
+} aes_key_t;
 
 #endif // KEY_H_
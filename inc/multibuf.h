@@ -0,0 +1,33 @@
+#ifndef MULTIBUF_H_
+#define MULTIBUF_H_
+
+#include <stddef.h>
+#include "aes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MULTIBUF_LANES 8                // jobs run side by side by the AES-NI kernel
+
+/*
+ * One message for aesMultiEncrypt / aesMultiDecrypt, with its own key
+ */
+typedef struct aes_job {
+
+    const uint8_t* key;                 // keyLengthBits / 8 bytes
+    const uint8_t* iv;                  // 16 bytes for AES_MODE_CBC, not used for ECB
+    const uint8_t* in;
+    uint8_t* out;                       // may be in, but must not otherwise overlap it
+    size_t length;                      // a multiple of the block size
+
+} aes_job_t;
+
+AES_API int aesMultiEncrypt(const aes_job_t* jobs, int numJobs, int keyLengthBits, int mode);
+AES_API int aesMultiDecrypt(const aes_job_t* jobs, int numJobs, int keyLengthBits, int mode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MULTIBUF_H_
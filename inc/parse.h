@@ -1,7 +1,38 @@
 #ifndef PARSE_H_
 #define PARSE_H_
 
+/*
+ * A further input and output file, with its own iv
+ */
+typedef struct file_job {
+
+    char* inputFilename;
+    char* outputFilename;
+    uint8_t iv[BUFFER_SIZE];
+
+} file_job_t;
+
+/*
+ * Optional settings given after the input and output files
+ */
+typedef struct options {
+
+    char* engineName;   // -engine <name>, NULL to pick the fastest supported engine
+    int numThreads;     // -threads <n>, 0 to use one thread per core
+    file_job_t* moreFiles; // further -iv <iv> -in <file> -out <file> groups (CBC), freed by the caller
+    int numMoreFiles;
+    uint64_t seek;      // -seek <bytes>, CTR and XTS: start this far into the input, 0 for the start
+    size_t sectorSize;  // -sector <bytes>, XTS only: 0 for XTS_SECTOR_SIZE
+    int uring;          // -uring: read and write through io_uring rather than mapping the files
+    int direct;         // -direct: as -uring, around the page cache (O_DIRECT)
+    int inplace;        // -inplace: rewrite the input (which must also be the output) over itself
+
+} options_t;
+
 int characterToHex(char c);
-int parseInput(int argc, char** argv, int* mode, key_t** key, uint8_t** iv, char** inputFilename, char** outputFilename);
+int parseIv(const char* hex, uint8_t* iv, int ivLength);
+int parseOptions(int argc, char** argv, int first, options_t* options);
+int checkInplace(const options_t* options, int encryptionMode, const char* inputFilename, const char* outputFilename);
+int parseInput(int argc, char** argv, int* mode, aes_key_t** key, uint8_t** iv, char** inputFilename, char** outputFilename, options_t* options);
 
 #endif // PARSE_H_
\ No newline at end of file
@@ -0,0 +1,82 @@
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#define PIPELINE_BUFFERS 4              // buffers in flight: one being read, one en/de-crypted, one written, one spare
+#define PIPELINE_QUEUE_SLOTS 8          // room for every buffer plus the writer's end marker, a power of 2
+
+/*
+ * One chunk of the file on its way through the pipeline
+ */
+typedef struct io_buffer {
+
+    uint8_t* data;
+    size_t length;                      // bytes of data in use
+
+} io_buffer_t;
+
+/*
+ * A bounded single producer, single consumer queue of buffers. Pushing
+ * and popping are a store and a load; a consumer that finds the queue
+ * empty parks on ready until the producer has pushed.
+ */
+typedef struct buffer_queue {
+
+    io_buffer_t* slots[PIPELINE_QUEUE_SLOTS];
+    atomic_ulong head;                  // next slot to pop, only moved by the consumer
+    atomic_ulong tail;                  // next slot to push, only moved by the producer
+    atomic_int waiting;                 // the consumer is (about to be) parked
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+
+} buffer_queue_t;
+
+/*
+ * A reader thread filling buffers from one file and a writer thread
+ * draining them, in order, to another, so that the disk keeps going
+ * while the calling thread en/de-crypts. Either side can be left out (a
+ * mapped file); the calling thread then takes and returns the buffers
+ * itself. There are PIPELINE_BUFFERS buffers in all, recycled through
+ * the free queue, so the memory used does not grow with the file.
+ *
+ * free's producer is the writer (the caller without one), its consumer
+ * the reader (the caller without one, or once the reader has finished).
+ */
+typedef struct io_pipeline {
+
+    FILE* read;                         // NULL if there is no reader
+    FILE* write;                        // NULL if there is no writer
+    unsigned long inLeft;               // bytes the reader has still to read
+    size_t chunkSize;                   // bytes per read
+    io_buffer_t buffers[PIPELINE_BUFFERS];
+    buffer_queue_t free;                // empty buffers
+    buffer_queue_t filled;              // read, in file order
+    buffer_queue_t written;             // to write, in file order
+    pthread_t reader;
+    pthread_t writer;
+    atomic_int stop;                    // the reader should finish early
+    int readFailed;                     // the input ended early on an error
+    int writeFailed;                    // a write fell short, the rest was not written
+    int dropCache;                      // keep the files out of the page cache (see cacheDrop)
+    unsigned long readOffset;           // of the next read, for dropCache
+    unsigned long writeOffset;          // of the next write
+
+} io_pipeline_t;
+
+int pipelineStart(io_pipeline_t* pipeline, FILE* read, unsigned long inLength, FILE* write, size_t chunkSize, size_t bufferSize,
+                  int dropCache);
+io_buffer_t* pipelineNext(io_pipeline_t* pipeline);
+io_buffer_t* pipelineTake(io_pipeline_t* pipeline);
+void pipelineWrite(io_pipeline_t* pipeline, io_buffer_t* buffer);
+void pipelineRelease(io_pipeline_t* pipeline, io_buffer_t* buffer);
+int pipelineFinish(io_pipeline_t* pipeline);
+
+void pipeResize(int fd, size_t size);
+void cacheDrop(int fd, unsigned long end);
+void cacheWriteBehind(int fd, unsigned long offset, size_t length);
+
+#endif // PIPELINE_H_
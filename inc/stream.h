@@ -0,0 +1,36 @@
+#ifndef STREAM_H_
+#define STREAM_H_
+
+#include <stddef.h>
+#include "aes.h"
+#include "threads.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Incremental en/de-cryption of a byte stream fed in pieces of any size.
+ * Whole blocks are processed straight from the caller's memory; only a
+ * trailing partial block is held back until the next update or final.
+ */
+typedef struct aes_stream {
+
+    aes_ctx_t* ctx;                     // key, engine and chaining value
+    int mode;                           // AES_MODE_ECB or AES_MODE_CBC
+    int decrypt;                        // 0 to encrypt, 1 to decrypt
+    uint8_t partial[BLOCK_SIZE_BYTES];  // bytes of the next block received so far
+    int partialLength;
+    thread_pool_t* pool;                // splits ECB and CBC decrypt runs across threads, NULL for the calling thread only
+
+} aes_stream_t;
+
+AES_API int aesStreamInit(aes_stream_t* stream, aes_ctx_t* ctx, int mode, int decrypt);
+AES_API size_t aesStreamUpdate(aes_stream_t* stream, const uint8_t* in, size_t inLength, uint8_t* out);
+AES_API size_t aesStreamFinal(aes_stream_t* stream, uint8_t* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STREAM_H_
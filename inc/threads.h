@@ -0,0 +1,65 @@
+#ifndef THREADS_H_
+#define THREADS_H_
+
+#include <pthread.h>
+#include "aes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POOL_MAX_THREADS 1024           // upper limit for poolInit
+#define POOL_MIN_BLOCKS 4096            // fewer blocks than this per thread are not worth waking the pool for
+
+/*
+ * A task run by every thread of a pool. part is the thread's index,
+ * 0 to numParts - 1; the task picks its share of the work from it.
+ */
+typedef void (*pool_task_t)(void* arg, int part, int numParts);
+
+typedef struct thread_pool thread_pool_t;
+
+/*
+ * One worker thread, along with the index it passes to tasks
+ */
+typedef struct pool_worker {
+
+    thread_pool_t* pool;
+    int part;
+    pthread_t thread;
+
+} pool_worker_t;
+
+/*
+ * A fixed set of worker threads that run one task at a time. The thread
+ * calling poolRun() works as part 0, so a pool of one thread starts none.
+ */
+struct thread_pool {
+
+    int numThreads;                     // including the calling thread
+    pool_worker_t* workers;             // numThreads - 1 worker threads
+    pthread_mutex_t lock;
+    pthread_cond_t start;               // a new task (or stop) was posted
+    pthread_cond_t done;                // the last worker finished the task
+    pool_task_t task;
+    void* arg;
+    unsigned long generation;           // incremented for every task posted
+    int pending;                        // workers still running the task
+    int stop;
+
+};
+
+AES_API int poolDefaultThreads(void);
+AES_API int poolInit(thread_pool_t* pool, int numThreads);
+AES_API void poolRun(thread_pool_t* pool, pool_task_t task, void* arg);
+AES_API void poolDestroy(thread_pool_t* pool);
+AES_API size_t poolSliceStart(size_t numBlocks, int part, int numParts);
+
+AES_API void poolEncryptBlocks(thread_pool_t* pool, const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, size_t numBlocks);
+AES_API void poolDecryptBlocks(thread_pool_t* pool, const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, size_t numBlocks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // THREADS_H_
@@ -0,0 +1,95 @@
+#ifndef URING_H_
+#define URING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+#include "pipeline.h"
+
+#define URING_BUFFERS 8                 // chunks in flight, read ahead or being written
+#define URING_ALIGNMENT 4096            // of every buffer, a page; also of O_DIRECT offsets and lengths
+#define URING_FILES 4                   // registered: input, output, and the two opened O_DIRECT
+
+/*
+ * Where a ring buffer is in its round: read, handed to the caller,
+ * written, and back.
+ */
+typedef enum ring_state {
+
+    RING_IDLE = 0,
+    RING_READING,
+    RING_READ,                          // waiting for the caller
+    RING_HELD,                          // the caller's
+    RING_WRITING
+
+} ring_state_t;
+
+/*
+ * One buffer of the ring, along with the I/O it is part of
+ */
+typedef struct ring_buffer {
+
+    io_buffer_t buffer;                 // what the caller sees
+    ring_state_t state;
+    unsigned long offset;               // in the file being read or written
+    size_t wanted;                      // bytes asked for
+    int result;                         // bytes done, or -errno
+    int direct;                         // through the O_DIRECT descriptor
+
+} ring_buffer_t;
+
+/*
+ * Reads and writes of one job through io_uring, all submitted from the
+ * calling thread. Chunks are read URING_BUFFERS ahead into buffers (and
+ * files) registered with the kernel where it allows, handed over in
+ * file order, and written back from the same buffer at the output
+ * position, so the device always has a queue of requests while the
+ * pool en/de-crypts. With direct, whatever is aligned goes around the
+ * page cache (O_DIRECT); the rest is dropped from it behind the reads
+ * and writes.
+ */
+typedef struct io_ring {
+
+    int fd;                             // -1 when not set up
+    void* sqRing;                       // the submission ring (and the completion ring with IORING_FEAT_SINGLE_MMAP)
+    void* cqRing;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+    unsigned toSubmit;                  // entries queued since the last io_uring_enter
+    int fixedFiles;                     // the files are registered, 0 is the input and 1 the output
+    int fixedBuffers;                   // the buffers are registered
+    int inFd;
+    int outFd;
+    int inDirectFd;                     // the input opened again with O_DIRECT, -1 if not
+    int outDirectFd;
+    int dropCache;                      // drop what goes through the page cache (cacheDrop, cacheWriteBehind)
+    uint8_t* memory;                    // every buffer, in one allocation
+    ring_buffer_t buffers[URING_BUFFERS];
+    unsigned long readOffset;           // of the next read to submit
+    unsigned long inEnd;                // reads stop here
+    unsigned long writeOffset;          // of the next write
+    size_t chunkSize;
+    unsigned long nextRead;             // chunk the next read is for
+    unsigned long next;                 // chunk the caller gets next
+    int failed;                         // a read or a write failed, the output is not to be kept
+
+} io_ring_t;
+
+int ringStart(io_ring_t* ring, int inFd, unsigned long inOffset, unsigned long inLength, int outFd, unsigned long outOffset,
+              size_t chunkSize, size_t bufferSize, int direct);
+io_buffer_t* ringNext(io_ring_t* ring);
+io_buffer_t* ringTake(io_ring_t* ring);
+void ringWrite(io_ring_t* ring, io_buffer_t* buffer);
+int ringFinish(io_ring_t* ring);
+
+#endif // URING_H_
@@ -0,0 +1,23 @@
+#ifndef VAES_H_
+#define VAES_H_
+
+#include "aes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// functions for the VAES (AVX2 / AVX-512) engines (x86 only)
+
+#ifdef ENGINE_X86
+
+extern const engine_t aesVaes512Engine;
+extern const engine_t aesVaes256Engine;
+
+#endif // ENGINE_X86
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VAES_H_
@@ -0,0 +1,22 @@
+#ifndef VPAES_H_
+#define VPAES_H_
+
+#include "aes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// functions for the SSSE3 vector permute engine (x86 only)
+
+#ifdef ENGINE_X86
+
+extern const engine_t aesVpaesEngine;
+
+#endif // ENGINE_X86
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VPAES_H_
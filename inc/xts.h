@@ -0,0 +1,36 @@
+#ifndef XTS_H_
+#define XTS_H_
+
+#include <stdint.h>
+#include "aes.h"
+#include "threads.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define XTS_SECTOR_SIZE 512             // default data unit for -aes-xts, in bytes
+#define XTS_BATCH_BLOCKS 256            // blocks XORed with their tweaks per engine call (one 4096 byte sector)
+#define XTS_BATCH_SECTORS 64            // sector tweaks encrypted per engine call
+
+/*
+ * XTS-AES (IEEE 1619, NIST SP 800-38E): two keys of the same size, one
+ * for the data and one for the tweaks
+ */
+typedef struct xts_ctx {
+
+    aes_ctx_t data;                     // Key1, en/de-crypts the blocks
+    aes_ctx_t tweak;                    // Key2, encrypts the sector numbers
+
+} xts_ctx_t;
+
+AES_API int xtsInit(xts_ctx_t* xts, const uint8_t* key, int keyLengthBits, const char* engineName);
+AES_API void xtsClear(xts_ctx_t* xts);
+AES_API int xtsEncrypt(const xts_ctx_t* xts, uint64_t firstSector, size_t sectorSize, const uint8_t* in, uint8_t* out, size_t length, thread_pool_t* pool);
+AES_API int xtsDecrypt(const xts_ctx_t* xts, uint64_t firstSector, size_t sectorSize, const uint8_t* in, uint8_t* out, size_t length, thread_pool_t* pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // XTS_H_
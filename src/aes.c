@@ -1,29 +1,17 @@
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include <time.h>
-
 #include "../inc/aes.h"
-#include "../inc/key.h"
-#include "../inc/parse.h"
+#include "../inc/cbc.h"
 #include "../inc/encrypt.h"
 #include "../inc/decrypt.h"
-#include "../inc/cbc.h"
-
-
+#include "../inc/engine.h"
 
-// ********************************************************************************
-// GLOBALS
-// ********************************************************************************
+// the AES library: key schedule, the portable T-table engine and the
+// block functions every mode is built on. All state lives in an aes_ctx_t.
 
-FILE *ptread = NULL;            // read file pointer
-FILE *ptwrite = NULL;           // write file pointer
-key_t* key = NULL;              // 
-uint8_t* iv = NULL;             // 
-uint8_t* Rcon = NULL;           // round constant array
-uint32_t* keySchedule = NULL;   // key schedule array
-uint32_t* keyWords = NULL;      // array of words that make up key
+static void createDecryptionKeySchedule(aes_ctx_t* ctx);
+static void createRoundConstantArray(uint8_t* Rcon, int RconArraySize);
 
 
 
@@ -36,7 +24,7 @@ uint32_t* keyWords = NULL;      // array of words that make up key
 /**
  * Substitutes the bytes in the the input word using the s-box
  */
-uint32_t subWord(uint32_t word) {
+static uint32_t subWord(uint32_t word) {
 
     int32_t newWord = 0;
 
@@ -45,7 +33,7 @@ uint32_t subWord(uint32_t word) {
     {
 
         uint32_t byte_to_sub = (word & (0xFF << (i * 8))) >> (i * 8);
-        newWord |= subByte(byte_to_sub) << (i * 8); // add substituted byte to word
+        newWord |= aesSubByte(byte_to_sub) << (i * 8); // add substituted byte to word
 
     }
 
@@ -56,7 +44,7 @@ uint32_t subWord(uint32_t word) {
 /**
  * Performs a cyclic permutation
  */
-uint32_t rotWord(uint32_t word) {
+static uint32_t rotWord(uint32_t word) {
 
     uint32_t temp = (word & (0xFF << 24)) >> 24; // grab first byte to move to end
     word <<= 8; // shift rest down
@@ -70,24 +58,21 @@ uint32_t rotWord(uint32_t word) {
  * Create the key schedule for the encryption rounds.
  * Generates BLOCK_SIZE * (numRounds + 1) words used as round keys.
  */
-void createKeySchedule(uint32_t* key, int keyLengthInWords, int numRounds) {
+static void createKeySchedule(aes_ctx_t* ctx, const uint32_t* key, int keyLengthInWords, int numRounds) {
 
     // RESULT: array of 4 byte (ex. key = 0x12345678) keys
     //          L array will be of size blockSize * (numRounds + 1)
     //                                  4 bytes * (16 * (numRounds + 1))
 
     int scheduleLength = (AES_BLOCK_SIZE_WORDS * (numRounds + 1)); 
+    uint32_t* keySchedule = ctx->keySchedule;
+    uint8_t Rcon[AES_RCON_SIZE];
 
-    // allocate space for key schedule array
-    keySchedule = malloc(sizeof(uint32_t) * scheduleLength);
-    if (!keySchedule)
-    {
-        printf("Allocation of key schedule failed!\n");
-        cleanup();
-        exit(-1);
-    }
+    ctx->numRounds = numRounds;
+    ctx->keyLengthInWords = keyLengthInWords;
+
+    createRoundConstantArray(Rcon, AES_RCON_SIZE);
 
-    
     for (int i = 0; i < scheduleLength; i++)
     {
 
@@ -126,26 +111,41 @@ void createKeySchedule(uint32_t* key, int keyLengthInWords, int numRounds) {
         
     }
 
-}
+    createDecryptionKeySchedule(ctx);
 
+}
 
+/**
+ * Create the round keys for the equivalent inverse cipher: the encryption
+ * round keys in reverse order, with InvMixColumns applied to all but the
+ * first and last. Td[sbox[x]] is InvMixColumns without InvSubBytes.
+ */
+static void createDecryptionKeySchedule(aes_ctx_t* ctx) {
 
-void addRoundKey(uint8_t* block, int round) {
-    
-    int l = round * AES_BLOCK_SIZE_WORDS; // l = Round * blockSize
+    int numRounds = ctx->numRounds;
 
-    for (int i = 0; i < BLOCK_ROW_COL_SIZE; i++)
+    for (int round = 0; round <= numRounds; round++)
     {
 
-        uint8_t k1 = (keySchedule[l + i] & (0xFF << 24)) >> 24;
-        uint8_t k2 = (keySchedule[l + i] & (0xFF << 16)) >> 16;
-        uint8_t k3 = (keySchedule[l + i] & (0xFF << 8)) >> 8;
-        uint8_t k4 = keySchedule[l + i] & 0xFF; 
+        const uint32_t* rk = ctx->keySchedule + (AES_BLOCK_SIZE_WORDS * (numRounds - round));
+        uint32_t* dk = ctx->decKeySchedule + (AES_BLOCK_SIZE_WORDS * round);
 
-        block[i] ^= k1;
-        block[(4 * 1) + i] ^= k2;
-        block[(4 * 2) + i] ^= k3;
-        block[(4 * 3) + i] ^= k4; 
+        for (int c = 0; c < AES_BLOCK_SIZE_WORDS; c++)
+        {
+
+            if (round == 0 || round == numRounds)
+            {
+                dk[c] = rk[c];
+            }
+            else
+            {
+                dk[c] = aesTd0[aesSbox[rk[c] >> 24]] ^
+                        aesTd1[aesSbox[(rk[c] >> 16) & 0xFF]] ^
+                        aesTd2[aesSbox[(rk[c] >> 8) & 0xFF]] ^
+                        aesTd3[aesSbox[rk[c] & 0xFF]];
+            }
+
+        }
 
     }
 
@@ -153,15 +153,7 @@ void addRoundKey(uint8_t* block, int round) {
 
 
 
-void createRoundConstantArray(int RconArraySize) {
-
-    Rcon = malloc(sizeof(uint8_t) * RconArraySize);
-    if (Rcon == NULL)
-    {
-        printf("Unable to allocate round constant array!\n");
-        cleanup();
-        exit(-1);
-    }
+static void createRoundConstantArray(uint8_t* Rcon, int RconArraySize) {
 
     for (int i = 0; i < RconArraySize; i++)
     {
@@ -185,248 +177,420 @@ void createRoundConstantArray(int RconArraySize) {
 
 
 
-void swapRowsAndColumns(uint8_t* block) {
+/**
+ * Load the state block into four column words.
+ * The state is column-major, so each column is four consecutive bytes
+ * and row 0 ends up in the most significant byte, matching the byte
+ * order of the words in the key schedule.
+ */
+static inline void loadColumns(const uint8_t* block, uint32_t* s) {
 
-    for (int i = 0; i < BLOCK_ROW_COL_SIZE; i++)
+    for (int c = 0; c < BLOCK_ROW_COL_SIZE; c++)
     {
+        s[c] = ((uint32_t) block[4 * c] << 24) | ((uint32_t) block[(4 * c) + 1] << 16) |
+               ((uint32_t) block[(4 * c) + 2] << 8) | (uint32_t) block[(4 * c) + 3];
+    }
 
-        for (int j = i; j < BLOCK_ROW_COL_SIZE; j++)
-        {
-
-            uint8_t temp = block[(4 * i) + j];          
-            block[(4 * i) + j] = block[(4 * j) + i];
-            block[(4 * j) + i] = temp;
+}
 
-        }
+/**
+ * Store four column words back into the state block.
+ */
+static inline void storeColumns(uint8_t* block, const uint32_t* s) {
 
+    for (int c = 0; c < BLOCK_ROW_COL_SIZE; c++)
+    {
+        block[4 * c] = s[c] >> 24;
+        block[(4 * c) + 1] = s[c] >> 16;
+        block[(4 * c) + 2] = s[c] >> 8;
+        block[(4 * c) + 3] = s[c];
     }
 
 }
 
 
 
-void cleanup() {
+/**
+ * Encrypt blocks using the T-tables.
+ * Each round does SubBytes, ShiftRows and MixColumns as four table
+ * lookups per column; ShiftRows is folded into which column each
+ * row's byte is taken from.
+ * Always inlined, so the per-key-size copies made by DEFINE_KERNELS
+ * get a constant numRounds and unroll every loop.
+ */
+KERNEL_INLINE void ttableEncryptKernel(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks, int numRounds) {
 
-    // if ptread open (not NULL), close it
-    if (ptread) {
-        fclose(ptread);
-    }
+    const uint32_t* keySchedule = ctx->keySchedule;
 
-    // if ptwrite open (not NULL), close it
-    if (ptwrite) {
-        fclose(ptwrite);
-    }
+    for (int n = 0; n < numBlocks; n++)
+    {
 
-    // if Rcon was allocated (not NULL), free it
-    if (Rcon) {
-        free(Rcon);
-    }
+        uint32_t s[4];
+        uint32_t t[4];
 
-    // if keySchedule was allocated (not NULL), free it
-    if (keySchedule) {
-        free(keySchedule);
-    }
+        loadColumns(in + (BLOCK_SIZE_BYTES * n), s);
+
+        #pragma GCC unroll 4
+        for (int c = 0; c < 4; c++)
+        {
+            s[c] ^= keySchedule[c]; // add roundkey (add cipher key to plaintext)
+        }
+
+        #pragma GCC unroll 14
+        for (int i = 1; i < numRounds; i++)
+        {
+
+            const uint32_t* rk = keySchedule + (AES_BLOCK_SIZE_WORDS * i);
 
-    if (key) {
+            #pragma GCC unroll 4
+            for (int c = 0; c < 4; c++)
+            {
+                t[c] = aesTe0[s[c] >> 24] ^
+                       aesTe1[(s[(c + 1) & 3] >> 16) & 0xFF] ^
+                       aesTe2[(s[(c + 2) & 3] >> 8) & 0xFF] ^
+                       aesTe3[s[(c + 3) & 3] & 0xFF] ^
+                       rk[c];
+            }
+
+            #pragma GCC unroll 4
+            for (int c = 0; c < 4; c++)
+            {
+                s[c] = t[c];
+            }
 
-        if (key->keyWords) {
-            free(key->keyWords);
         }
 
-        free(key);
+        // final round has no MixColumns, so use the s-box directly
+        const uint32_t* rk = keySchedule + (AES_BLOCK_SIZE_WORDS * numRounds);
+
+        #pragma GCC unroll 4
+        for (int c = 0; c < 4; c++)
+        {
+            t[c] = ((uint32_t) aesSbox[s[c] >> 24] << 24) ^
+                   ((uint32_t) aesSbox[(s[(c + 1) & 3] >> 16) & 0xFF] << 16) ^
+                   ((uint32_t) aesSbox[(s[(c + 2) & 3] >> 8) & 0xFF] << 8) ^
+                   (uint32_t) aesSbox[s[(c + 3) & 3] & 0xFF] ^
+                   rk[c];
+        }
+
+        storeColumns(out + (BLOCK_SIZE_BYTES * n), t);
 
     }
 
 }
 
+/**
+ * Decrypt blocks with the equivalent inverse cipher (FIPS-197 5.3.5).
+ * With the InvMixColumns-transformed decKeySchedule the rounds have the
+ * same shape as encryption: InvSubBytes + InvShiftRows + InvMixColumns
+ * as four Td table lookups per column.
+ */
+KERNEL_INLINE void ttableDecryptKernel(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks, int numRounds) {
 
+    const uint32_t* decKeySchedule = ctx->decKeySchedule;
 
-void aesEncrypt(uint8_t* inBuf, int numRounds) {
+    for (int n = 0; n < numBlocks; n++)
+    {
 
-    addRoundKey(inBuf, 0); // add roundkey (add cipher key to plaintext)
+        uint32_t s[4];
+        uint32_t t[4];
 
-    for (int i = 1; i < numRounds; i++)
-    {
+        loadColumns(in + (BLOCK_SIZE_BYTES * n), s);
 
-        subBytes(inBuf);
-        shiftRows(inBuf);
-        mixColumns(inBuf);
-        addRoundKey(inBuf, i);
+        #pragma GCC unroll 4
+        for (int c = 0; c < 4; c++)
+        {
+            s[c] ^= decKeySchedule[c];
+        }
 
-    }
+        #pragma GCC unroll 14
+        for (int i = 1; i < numRounds; i++)
+        {
 
-    subBytes(inBuf); // subBytes
-    shiftRows(inBuf); // shiftRows
-    addRoundKey(inBuf, numRounds); // addRoundKey
+            const uint32_t* rk = decKeySchedule + (AES_BLOCK_SIZE_WORDS * i);
 
-}
+            #pragma GCC unroll 4
+            for (int c = 0; c < 4; c++)
+            {
+                t[c] = aesTd0[s[c] >> 24] ^
+                       aesTd1[(s[(c + 3) & 3] >> 16) & 0xFF] ^
+                       aesTd2[(s[(c + 2) & 3] >> 8) & 0xFF] ^
+                       aesTd3[s[(c + 1) & 3] & 0xFF] ^
+                       rk[c];
+            }
 
-void aesDecrypt(uint8_t* inBuf, int numRounds) {
+            #pragma GCC unroll 4
+            for (int c = 0; c < 4; c++)
+            {
+                s[c] = t[c];
+            }
 
-    // decryption starts at numRounds and works back down
+        }
 
-    addRoundKey(inBuf, numRounds); 
+        // final round has no InvMixColumns, so use the inverse s-box directly
+        const uint32_t* rk = decKeySchedule + (AES_BLOCK_SIZE_WORDS * numRounds);
+
+        #pragma GCC unroll 4
+        for (int c = 0; c < 4; c++)
+        {
+            t[c] = ((uint32_t) aesInvSbox[s[c] >> 24] << 24) ^
+                   ((uint32_t) aesInvSbox[(s[(c + 3) & 3] >> 16) & 0xFF] << 16) ^
+                   ((uint32_t) aesInvSbox[(s[(c + 2) & 3] >> 8) & 0xFF] << 8) ^
+                   (uint32_t) aesInvSbox[s[(c + 1) & 3] & 0xFF] ^
+                   rk[c];
+        }
+
+        storeColumns(out + (BLOCK_SIZE_BYTES * n), t);
 
-    for (int i = numRounds-1; i > 0; i--)
-    {
-        invShiftRows(inBuf);
-        invSubBytes(inBuf);
-        addRoundKey(inBuf, i);
-        invMixColumns(inBuf);
-        
     }
 
-    invShiftRows(inBuf);
-    invSubBytes(inBuf);
-    addRoundKey(inBuf, 0);
-    
 }
 
+/**
+ * Encrypt one block using the T-tables, for any key size.
+ */
+static void ttableEncrypt(const aes_ctx_t* ctx, uint8_t* block) {
 
+    ttableEncryptKernel(ctx, block, block, 1, ctx->numRounds);
 
+}
+
+/**
+ * Decrypt one block using the T-tables, for any key size.
+ */
+static void ttableDecrypt(const aes_ctx_t* ctx, uint8_t* block) {
 
+    ttableDecryptKernel(ctx, block, block, 1, ctx->numRounds);
 
-int main(int argc, char** argv) {
+}
 
-    uint8_t inBuf[BUFFER_SIZE] = {0}; // file input
-    uint8_t prevCipherOut[BUFFER_SIZE] = {0};
-    uint8_t prevCipherIn[BUFFER_SIZE] = {0};
+DEFINE_KERNELS(ttable, )
 
-    char* inputFilename = NULL; // input filename pointer
-    char* outputFilename = NULL; // output filename pointer
-    int mode = 0;               // 0 for encryption, 1 for decryption
-    int firstRun = 1;           // used for CBC encryption to determine what to XOR the input with
-    
+static int ttableSupported(void) {
 
-    int encryptionMode = parseInput(argc, argv, &mode, &key, &iv, &inputFilename, &outputFilename);
+    return 1;
 
-    if (encryptionMode == -1) // an error occurred when parsing userInput (either by fault of user or system)
-    {
-        // error message cause is displayed by parse.c 
-        cleanup();
-        exit(-1);
-    }
+}
 
+// portable C engine using the T-tables, runs everywhere
+const engine_t aesTtableEngine = {
 
+    .name = "ttable",
+    .isSupported = ttableSupported,
+    .expandKey = NULL,
+    .encrypt = ttableEncrypt,
+    .decrypt = ttableDecrypt,
+    .encryptBlocks = NULL,
+    .decryptBlocks = NULL,
+    .specialize = ttableSpecialize
 
+};
 
 
-    if ((ptread = fopen(inputFilename, "rb")) == NULL)
+
+/*
+ * ctx          - the context to set up
+ * key          - the key bytes
+ * keyLengthBits - 128, 192 or 256
+ * engineName   - the engine to use, or NULL for the fastest one the CPU supports
+ *
+ * Expand the key and pick the engine and its kernels for this key size.
+ * The iv starts out as zero, see aesSetIv().
+ *
+ * Returns 0 on success, -1 if the key length or engine is not usable.
+ */
+int aesInit(aes_ctx_t* ctx, const uint8_t* key, int keyLengthBits, const char* engineName) {
+
+    uint32_t keyWords[AES_256_KEY_LENGTH_WORDS];
+    int keyLengthInWords = 0;
+    int numRounds = 0;
+
+    switch (keyLengthBits)
     {
-        printf("File %s cannot be opened\n", inputFilename);
-        cleanup();
-        exit(-1);
+        case AES_128_KEY_LENGTH:
+            keyLengthInWords = AES_128_KEY_LENGTH_WORDS;
+            numRounds = AES_128_NUM_ROUNDS;
+            break;
+        case AES_192_KEY_LENGTH:
+            keyLengthInWords = AES_192_KEY_LENGTH_WORDS;
+            numRounds = AES_192_NUM_ROUNDS;
+            break;
+        case AES_256_KEY_LENGTH:
+            keyLengthInWords = AES_256_KEY_LENGTH_WORDS;
+            numRounds = AES_256_NUM_ROUNDS;
+            break;
+        default:
+            return -1;
     }
 
-    if ((ptwrite = fopen(outputFilename, "wb")) == NULL)
+    memset(ctx, 0, sizeof(aes_ctx_t));
+
+    ctx->engine = aesSelectEngine(engineName);
+    if (ctx->engine == NULL)
     {
-        printf("File %s cannot be opened\n", outputFilename);
-        cleanup();
-        exit(-1);
-    } 
-    fseek(ptread, 0, SEEK_END);
-    unsigned long fileSize = ftell(ptread);
-    printf("File size: %lu\n", fileSize);
-    fseek(ptread, 0, SEEK_SET);
-    fseek(ptwrite, 0, SEEK_SET); // move write pointer to beginning of file
-
-
-    
-    createRoundConstantArray(key->RconArraySize); // create round constants array
-    createKeySchedule(key->keyWords, key->keyCanonLength, key->numRounds); // expand given key
-
-    if (encryptionMode == 0) {
-        printf("USING ECB MODE!\n");
+        return -1;
     }
-    else if (encryptionMode == 1) {
-        printf("USING CBC MODE!\n");
+
+    for (int i = 0; i < keyLengthInWords; i++)
+    {
+        keyWords[i] = ((uint32_t) key[4 * i] << 24) | ((uint32_t) key[(4 * i) + 1] << 16) |
+                      ((uint32_t) key[(4 * i) + 2] << 8) | (uint32_t) key[(4 * i) + 3];
     }
-    else if (encryptionMode == 2) {
-        printf("USING GCM MODE!\n");
+
+    createKeySchedule(ctx, keyWords, keyLengthInWords, numRounds); // expand given key
+
+    if (ctx->engine->expandKey)
+    {
+        ctx->engine->expandKey(ctx); // engine specific round keys
     }
 
+    aesSelectKernels(ctx); // the key size is fixed from here on, pick its unrolled kernels
 
+    aesWipe(keyWords, sizeof(keyWords));
 
-    // printf("Progress:\n");
+    return 0;
 
+}
 
+/**
+ * Set the chaining value used by the modes (the CBC iv).
+ */
+void aesSetIv(aes_ctx_t* ctx, const uint8_t* iv) {
 
-    float startTime = (float) clock() / CLOCKS_PER_SEC;
+    memcpy(ctx->iv, iv, BLOCK_SIZE_BYTES);
 
-    while (fread(inBuf, sizeof(uint8_t), BUFFER_SIZE, ptread) != 0) // READ FROM INPUT FILE
-    {
+}
 
-        // printf("\r%lu / %lu", ftell(ptread), fileSize);
+/**
+ * Overwrite the keys in a context that is no longer needed.
+ */
+void aesClear(aes_ctx_t* ctx) {
 
-        swapRowsAndColumns(inBuf);
+    aesWipe(ctx, sizeof(aes_ctx_t));
 
-        if (encryptionMode == 0) // AES-ECB
-        {
+}
 
-            // just simply use AES encryption/decryption functions
-            // no need to hold on to generated output
-            if (mode == 0) {
-                aesEncrypt(inBuf, key->numRounds);
-            }
-            else {
-                aesDecrypt(inBuf, key->numRounds);
-            }
+/**
+ * Zero memory holding key material. The empty asm claims to read the
+ * buffer, so the compiler cannot drop the memset as dead, while the
+ * memset itself still runs at full width (key setup for short messages
+ * wipes kilobytes per key).
+ */
+void aesWipe(void* buf, size_t length) {
 
-        }
-        else 
-        {
+    memset(buf, 0, length);
 
-            swapRowsAndColumns(iv);
+    __asm__ __volatile__("" : : "r" (buf) : "memory");
 
-            if (encryptionMode == 1) // AES-CBC
-            {
+}
 
-                if (mode == 0) {
-                    cbcEncrypt(inBuf, prevCipherOut, prevCipherIn, key->numRounds, iv, &firstRun);
-                }
-                else {
-                    cbcDecrypt(inBuf, prevCipherOut, prevCipherIn, key->numRounds, iv, &firstRun);
-                }
 
-                memcpy(prevCipherIn, prevCipherOut, BUFFER_SIZE);
 
-            }
-            else if (encryptionMode == 2)// AES-GCM
-            {
+/**
+ * Encrypt one block with the context's engine.
+ */
+void aesEncrypt(const aes_ctx_t* ctx, uint8_t* block) {
 
-                if (mode == 0) {
+    ctx->kernels.encrypt(ctx, block);
 
-                }
-                else {
+}
 
-                }
-                
-            }
+/**
+ * Decrypt one block with the context's engine.
+ */
+void aesDecrypt(const aes_ctx_t* ctx, uint8_t* block) {
 
-            swapRowsAndColumns(iv);
+    ctx->kernels.decrypt(ctx, block);
 
-        }
+}
+
+/**
+ * Encrypt several independent blocks (ECB) with the context's engine.
+ * Engines that can work on more than one block at a time get the whole
+ * run and interleave the blocks internally.
+ *
+ * in           - numBlocks blocks of plaintext
+ * out          - where the ciphertext goes; may be in itself, but must
+ *                not otherwise overlap it
+ */
+void aesEncryptBlocks(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks) {
 
-        swapRowsAndColumns(inBuf);
+    ctx->kernels.encryptBlocks(ctx, in, out, numBlocks);
 
+}
 
-        
-        fwrite(inBuf, sizeof(uint8_t), BUFFER_SIZE, ptwrite);// WRITE TO OUTPUT FILE
+/**
+ * Decrypt several independent blocks (ECB) with the context's engine.
+ * Same rules for in and out as aesEncryptBlocks().
+ */
+void aesDecryptBlocks(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks) {
+
+    ctx->kernels.decryptBlocks(ctx, in, out, numBlocks);
 
-        memset(inBuf, 0, BUFFER_SIZE);
+}
+
+/**
+ * Run any number of independent blocks (ECB) through the context. The
+ * engines count blocks in an int, so longer runs go to them
+ * AES_BATCH_BLOCKS at a time. Only reads ctx, so threads can share it.
+ *
+ * decrypt      - 0 to encrypt, 1 to decrypt
+ * in, out      - as for aesEncryptBlocks()
+ */
+void aesEcbBlocks(const aes_ctx_t* ctx, int decrypt, const uint8_t* in, uint8_t* out, size_t numBlocks) {
+
+    while (numBlocks > 0)
+    {
+
+        int batch = (numBlocks > AES_BATCH_BLOCKS) ? AES_BATCH_BLOCKS : (int) numBlocks;
+
+        if (decrypt) {
+            aesDecryptBlocks(ctx, in, out, batch);
+        }
+        else {
+            aesEncryptBlocks(ctx, in, out, batch);
+        }
+
+        in += BLOCK_SIZE_BYTES * (size_t) batch;
+        out += BLOCK_SIZE_BYTES * (size_t) batch;
+        numBlocks -= batch;
 
     }
 
+}
 
-    float endTime = (float) clock()/CLOCKS_PER_SEC;
+/**
+ * Run any number of blocks through ECB or CBC, AES_BATCH_BLOCKS at a time.
+ *
+ * mode         - AES_MODE_ECB, or AES_MODE_CBC to chain through ctx->iv
+ *                (ECB only reads ctx, see aesEcbBlocks())
+ * decrypt      - 0 to encrypt, 1 to decrypt
+ * in, out      - as for aesEncryptBlocks()
+ */
+void aesCryptBlocks(aes_ctx_t* ctx, int mode, int decrypt, const uint8_t* in, uint8_t* out, size_t numBlocks) {
 
-    printf("\nTime to en/de-crypt %lu bytes : %fs\n", fileSize, endTime-startTime);
+    if (mode != AES_MODE_CBC)
+    {
+        aesEcbBlocks(ctx, decrypt, in, out, numBlocks);
+        return;
+    }
 
+    while (numBlocks > 0)
+    {
 
-    cleanup();
+        int batch = (numBlocks > AES_BATCH_BLOCKS) ? AES_BATCH_BLOCKS : (int) numBlocks;
 
-    // system("leaks aes"); // used to check for memory leaks
+        if (decrypt) {
+            cbcDecryptBlocks(ctx, in, out, batch);
+        }
+        else {
+            cbcEncryptBlocks(ctx, in, out, batch);
+        }
 
-    return 0;
+        in += BLOCK_SIZE_BYTES * (size_t) batch;
+        out += BLOCK_SIZE_BYTES * (size_t) batch;
+        numBlocks -= batch;
+
+    }
 
 }
@@ -0,0 +1,569 @@
+#include "../inc/aes.h"
+#include "../inc/aesni.h"
+
+// AES-NI engine: runs the rounds with the AESENC/AESDEC instructions and
+// expands the key with AESKEYGENASSIST
+
+#ifdef ENGINE_X86
+
+#include <immintrin.h>
+#include <string.h>
+
+#define AESNI_TARGET __attribute__((target("aes,ssse3")))
+
+#define AESNI_INTERLEAVE 8              // blocks in flight per loop iteration
+
+CHECK_ENGINE_KEYS(aesni_keys_t);
+
+
+
+int aesniSupported(void) {
+
+    __builtin_cpu_init();
+
+    return __builtin_cpu_supports("aes") && __builtin_cpu_supports("ssse3");
+
+}
+
+
+
+/**
+ * Apply SubWord (and RotWord, with rotate set) to a key schedule word.
+ * AESKEYGENASSIST works on the second and fourth words of its input,
+ * so the word is placed in the second slot and the round constant is
+ * left to the caller.
+ */
+AESNI_TARGET
+static uint32_t keyGenAssist(uint32_t word, int rotate) {
+
+    __m128i result = _mm_aeskeygenassist_si128(_mm_set_epi32(0, 0, word, 0), 0);
+
+    if (rotate)
+    {
+        return _mm_cvtsi128_si32(_mm_srli_si128(result, 4)); // RotWord(SubWord(word))
+    }
+
+    return _mm_cvtsi128_si32(result); // SubWord(word)
+
+}
+
+/**
+ * Expand the key into __m128i round keys.
+ * The schedule words are kept in memory byte order, the order the
+ * AES instructions expect, so the big endian key words are swapped first.
+ */
+AESNI_TARGET
+void aesniExpandRoundKeys(const uint32_t* key, int keyLengthInWords, int numRounds, aesni_keys_t* keys) {
+
+    uint32_t w[AES_BLOCK_SIZE_WORDS * (AES_256_NUM_ROUNDS + 1)];
+    uint32_t rcon = 1;
+    int scheduleLength = AES_BLOCK_SIZE_WORDS * (numRounds + 1);
+
+    for (int i = 0; i < keyLengthInWords; i++)
+    {
+        w[i] = __builtin_bswap32(key[i]);
+    }
+
+    for (int i = keyLengthInWords; i < scheduleLength; i++)
+    {
+
+        uint32_t temp = w[i - 1];
+
+        if (i % keyLengthInWords == 0)
+        {
+            temp = keyGenAssist(temp, 1) ^ rcon;
+            rcon = (rcon << 1) ^ ((rcon & 0x80) ? 0x11B : 0);
+        }
+        else if (keyLengthInWords == AES_256_KEY_LENGTH_WORDS && i % keyLengthInWords == 4)
+        {
+            temp = keyGenAssist(temp, 0);
+        }
+
+        w[i] = w[i - keyLengthInWords] ^ temp;
+
+    }
+
+    for (int i = 0; i <= numRounds; i++)
+    {
+        keys->enc[i] = _mm_loadu_si128((const __m128i*) &w[AES_BLOCK_SIZE_WORDS * i]);
+    }
+
+    // equivalent inverse cipher: reverse order, InvMixColumns on the inner round keys
+    keys->dec[0] = keys->enc[numRounds];
+
+    for (int i = 1; i < numRounds; i++)
+    {
+        keys->dec[i] = _mm_aesimc_si128(keys->enc[numRounds - i]);
+    }
+
+    keys->dec[numRounds] = keys->enc[0];
+
+    aesWipe(w, sizeof(w));
+
+}
+
+AESNI_TARGET
+static void aesniExpandKey(aes_ctx_t* ctx) {
+
+    aesniExpandRoundKeys(ctx->keySchedule, ctx->keyLengthInWords, ctx->numRounds, ENGINE_KEYS(aesni_keys_t, ctx));
+
+}
+
+
+
+/**
+ * Encrypt blocks AESNI_INTERLEAVE at a time. AESENC has a latency of
+ * several cycles but can start every cycle, so independent blocks are
+ * run through each round together to keep the unit busy. The round keys
+ * are copied into locals first: with a constant numRounds the round
+ * loop unrolls completely and the keys stay in registers (or are used
+ * straight from the stack as memory operands).
+ */
+AESNI_TARGET
+KERNEL_INLINE void aesniEncryptKernel(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks, int numRounds) {
+
+    const aesni_keys_t* keys = ENGINE_KEYS(const aesni_keys_t, ctx);
+    __m128i k[AES_256_NUM_ROUNDS + 1];
+    int n = 0;
+
+    #pragma GCC unroll 15
+    for (int i = 0; i <= numRounds; i++)
+    {
+        k[i] = keys->enc[i];
+    }
+
+    for (; n + AESNI_INTERLEAVE <= numBlocks; n += AESNI_INTERLEAVE)
+    {
+
+        const __m128i* src = (const __m128i*) (in + (BLOCK_SIZE_BYTES * n));
+        __m128i* dst = (__m128i*) (out + (BLOCK_SIZE_BYTES * n));
+        __m128i s[AESNI_INTERLEAVE];
+
+        #pragma GCC unroll 8
+        for (int j = 0; j < AESNI_INTERLEAVE; j++)
+        {
+            s[j] = _mm_xor_si128(_mm_loadu_si128(src + j), k[0]);
+        }
+
+        #pragma GCC unroll 14
+        for (int i = 1; i < numRounds; i++)
+        {
+            #pragma GCC unroll 8
+            for (int j = 0; j < AESNI_INTERLEAVE; j++)
+            {
+                s[j] = _mm_aesenc_si128(s[j], k[i]);
+            }
+        }
+
+        #pragma GCC unroll 8
+        for (int j = 0; j < AESNI_INTERLEAVE; j++)
+        {
+            _mm_storeu_si128(dst + j, _mm_aesenclast_si128(s[j], k[numRounds]));
+        }
+
+    }
+
+    for (; n < numBlocks; n++)
+    {
+
+        __m128i state = _mm_loadu_si128((const __m128i*) (in + (BLOCK_SIZE_BYTES * n)));
+
+        state = _mm_xor_si128(state, k[0]);
+
+        #pragma GCC unroll 14
+        for (int i = 1; i < numRounds; i++)
+        {
+            state = _mm_aesenc_si128(state, k[i]);
+        }
+
+        state = _mm_aesenclast_si128(state, k[numRounds]);
+
+        _mm_storeu_si128((__m128i*) (out + (BLOCK_SIZE_BYTES * n)), state);
+
+    }
+
+}
+
+AESNI_TARGET
+KERNEL_INLINE void aesniDecryptKernel(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks, int numRounds) {
+
+    const aesni_keys_t* keys = ENGINE_KEYS(const aesni_keys_t, ctx);
+    __m128i k[AES_256_NUM_ROUNDS + 1];
+    int n = 0;
+
+    #pragma GCC unroll 15
+    for (int i = 0; i <= numRounds; i++)
+    {
+        k[i] = keys->dec[i];
+    }
+
+    for (; n + AESNI_INTERLEAVE <= numBlocks; n += AESNI_INTERLEAVE)
+    {
+
+        const __m128i* src = (const __m128i*) (in + (BLOCK_SIZE_BYTES * n));
+        __m128i* dst = (__m128i*) (out + (BLOCK_SIZE_BYTES * n));
+        __m128i s[AESNI_INTERLEAVE];
+
+        #pragma GCC unroll 8
+        for (int j = 0; j < AESNI_INTERLEAVE; j++)
+        {
+            s[j] = _mm_xor_si128(_mm_loadu_si128(src + j), k[0]);
+        }
+
+        #pragma GCC unroll 14
+        for (int i = 1; i < numRounds; i++)
+        {
+            #pragma GCC unroll 8
+            for (int j = 0; j < AESNI_INTERLEAVE; j++)
+            {
+                s[j] = _mm_aesdec_si128(s[j], k[i]);
+            }
+        }
+
+        #pragma GCC unroll 8
+        for (int j = 0; j < AESNI_INTERLEAVE; j++)
+        {
+            _mm_storeu_si128(dst + j, _mm_aesdeclast_si128(s[j], k[numRounds]));
+        }
+
+    }
+
+    for (; n < numBlocks; n++)
+    {
+
+        __m128i state = _mm_loadu_si128((const __m128i*) (in + (BLOCK_SIZE_BYTES * n)));
+
+        state = _mm_xor_si128(state, k[0]);
+
+        #pragma GCC unroll 14
+        for (int i = 1; i < numRounds; i++)
+        {
+            state = _mm_aesdec_si128(state, k[i]);
+        }
+
+        state = _mm_aesdeclast_si128(state, k[numRounds]);
+
+        _mm_storeu_si128((__m128i*) (out + (BLOCK_SIZE_BYTES * n)), state);
+
+    }
+
+}
+
+AESNI_TARGET
+static void aesniEncrypt(const aes_ctx_t* ctx, uint8_t* block) {
+
+    aesniEncryptKernel(ctx, block, block, 1, ctx->numRounds);
+
+}
+
+AESNI_TARGET
+static void aesniDecrypt(const aes_ctx_t* ctx, uint8_t* block) {
+
+    aesniDecryptKernel(ctx, block, block, 1, ctx->numRounds);
+
+}
+
+AESNI_TARGET
+static void aesniEncryptBlocks(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks) {
+
+    aesniEncryptKernel(ctx, in, out, numBlocks, ctx->numRounds);
+
+}
+
+AESNI_TARGET
+static void aesniDecryptBlocks(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks) {
+
+    aesniDecryptKernel(ctx, in, out, numBlocks, ctx->numRounds);
+
+}
+
+DEFINE_KERNELS(aesni, AESNI_TARGET)
+
+
+
+/**
+ * Expand one key per job, all in lockstep. AESKEYGENASSIST has a latency
+ * of several cycles, so the lanes' calls for the same schedule word are
+ * issued back to back and overlap. The keys are bytes, already in the
+ * memory order the instructions use.
+ */
+AESNI_TARGET
+static void aesniExpandLanes(const aes_job_t* jobs, int numJobs, int keyLengthInWords, int numRounds, int decrypt, __m128i rk[][AES_256_NUM_ROUNDS + 1]) {
+
+    uint32_t w[MULTIBUF_LANES][AES_BLOCK_SIZE_WORDS * (AES_256_NUM_ROUNDS + 1)];
+    uint32_t rcon = 1;
+    int scheduleLength = AES_BLOCK_SIZE_WORDS * (numRounds + 1);
+
+    for (int c = 0; c < MULTIBUF_LANES; c++)
+    {
+        if (c < numJobs) {
+            memcpy(w[c], jobs[c].key, 4 * keyLengthInWords);
+        }
+        else {
+            memset(w[c], 0, 4 * keyLengthInWords);
+        }
+    }
+
+    for (int i = keyLengthInWords; i < scheduleLength; i++)
+    {
+
+        int rotate = (i % keyLengthInWords == 0);
+        int substitute = rotate || (keyLengthInWords == AES_256_KEY_LENGTH_WORDS && i % keyLengthInWords == 4);
+
+        #pragma GCC unroll 8
+        for (int c = 0; c < MULTIBUF_LANES; c++) // every lane, so the loop unrolls; unused ones are ignored
+        {
+
+            uint32_t temp = w[c][i - 1];
+
+            if (substitute)
+            {
+                temp = keyGenAssist(temp, rotate) ^ (rotate ? rcon : 0);
+            }
+
+            w[c][i] = w[c][i - keyLengthInWords] ^ temp;
+
+        }
+
+        if (rotate)
+        {
+            rcon = (rcon << 1) ^ ((rcon & 0x80) ? 0x11B : 0);
+        }
+
+    }
+
+    for (int c = 0; c < numJobs; c++)
+    {
+
+        for (int i = 0; i <= numRounds; i++)
+        {
+
+            __m128i key = _mm_loadu_si128((const __m128i*) &w[c][AES_BLOCK_SIZE_WORDS * i]);
+
+            if (!decrypt)
+            {
+                rk[c][i] = key;
+            }
+            else if (i == 0 || i == numRounds) // equivalent inverse cipher, as in aesniExpandRoundKeys
+            {
+                rk[c][numRounds - i] = key;
+            }
+            else
+            {
+                rk[c][numRounds - i] = _mm_aesimc_si128(key);
+            }
+
+        }
+
+    }
+
+    aesWipe(w, sizeof(w));
+
+}
+
+/**
+ * Run up to MULTIBUF_LANES jobs side by side, each with its own round
+ * keys: block j of every job still running goes through each round
+ * together, like the interleaved kernels above. Jobs that end drop out.
+ */
+AESNI_TARGET
+KERNEL_INLINE void aesniMultiEncryptKernel(const aes_job_t* jobs, int numJobs, int mode, __m128i rk[][AES_256_NUM_ROUNDS + 1], int numRounds) {
+
+    __m128i chain[MULTIBUF_LANES];
+    int lane[MULTIBUF_LANES];
+    int numActive = 0;
+
+    for (int c = 0; c < numJobs; c++)
+    {
+
+        chain[c] = (mode == AES_MODE_CBC) ? _mm_loadu_si128((const __m128i*) jobs[c].iv) : _mm_setzero_si128();
+
+        if (jobs[c].length > 0)
+        {
+            lane[numActive++] = c;
+        }
+
+    }
+
+    for (size_t offset = 0; numActive > 0; offset += BLOCK_SIZE_BYTES)
+    {
+
+        __m128i s[MULTIBUF_LANES];
+        int stillActive = 0;
+
+        for (int k = 0; k < numActive; k++)
+        {
+
+            int c = lane[k];
+            __m128i block = _mm_loadu_si128((const __m128i*) (jobs[c].in + offset));
+
+            if (mode == AES_MODE_CBC)
+            {
+                block = _mm_xor_si128(block, chain[c]);
+            }
+
+            s[k] = _mm_xor_si128(block, rk[c][0]);
+
+        }
+
+        #pragma GCC unroll 14
+        for (int i = 1; i < numRounds; i++)
+        {
+            for (int k = 0; k < numActive; k++)
+            {
+                s[k] = _mm_aesenc_si128(s[k], rk[lane[k]][i]);
+            }
+        }
+
+        for (int k = 0; k < numActive; k++)
+        {
+
+            int c = lane[k];
+
+            chain[c] = _mm_aesenclast_si128(s[k], rk[c][numRounds]);
+            _mm_storeu_si128((__m128i*) (jobs[c].out + offset), chain[c]);
+
+            if (offset + BLOCK_SIZE_BYTES < jobs[c].length)
+            {
+                lane[stillActive++] = c;
+            }
+
+        }
+
+        numActive = stillActive;
+
+    }
+
+}
+
+AESNI_TARGET
+KERNEL_INLINE void aesniMultiDecryptKernel(const aes_job_t* jobs, int numJobs, int mode, __m128i rk[][AES_256_NUM_ROUNDS + 1], int numRounds) {
+
+    __m128i chain[MULTIBUF_LANES];
+    int lane[MULTIBUF_LANES];
+    int numActive = 0;
+
+    for (int c = 0; c < numJobs; c++)
+    {
+
+        chain[c] = (mode == AES_MODE_CBC) ? _mm_loadu_si128((const __m128i*) jobs[c].iv) : _mm_setzero_si128();
+
+        if (jobs[c].length > 0)
+        {
+            lane[numActive++] = c;
+        }
+
+    }
+
+    for (size_t offset = 0; numActive > 0; offset += BLOCK_SIZE_BYTES)
+    {
+
+        __m128i s[MULTIBUF_LANES];
+        __m128i cipher[MULTIBUF_LANES];
+        int stillActive = 0;
+
+        for (int k = 0; k < numActive; k++)
+        {
+
+            int c = lane[k];
+
+            cipher[k] = _mm_loadu_si128((const __m128i*) (jobs[c].in + offset));
+            s[k] = _mm_xor_si128(cipher[k], rk[c][0]);
+
+        }
+
+        #pragma GCC unroll 14
+        for (int i = 1; i < numRounds; i++)
+        {
+            for (int k = 0; k < numActive; k++)
+            {
+                s[k] = _mm_aesdec_si128(s[k], rk[lane[k]][i]);
+            }
+        }
+
+        for (int k = 0; k < numActive; k++)
+        {
+
+            int c = lane[k];
+            __m128i block = _mm_aesdeclast_si128(s[k], rk[c][numRounds]);
+
+            if (mode == AES_MODE_CBC)
+            {
+                block = _mm_xor_si128(block, chain[c]);
+                chain[c] = cipher[k];
+            }
+
+            _mm_storeu_si128((__m128i*) (jobs[c].out + offset), block);
+
+            if (offset + BLOCK_SIZE_BYTES < jobs[c].length)
+            {
+                lane[stillActive++] = c;
+            }
+
+        }
+
+        numActive = stillActive;
+
+    }
+
+}
+
+/*
+ * jobs             - up to MULTIBUF_LANES jobs, lengths a multiple of the block size
+ * numJobs          - the number of jobs
+ * keyLengthInWords - the key length shared by the jobs
+ * numRounds        - the round count for that key length
+ * mode             - AES_MODE_ECB or AES_MODE_CBC
+ */
+AESNI_TARGET
+void aesniMultiEncrypt(const aes_job_t* jobs, int numJobs, int keyLengthInWords, int numRounds, int mode) {
+
+    __m128i rk[MULTIBUF_LANES][AES_256_NUM_ROUNDS + 1];
+
+    aesniExpandLanes(jobs, numJobs, keyLengthInWords, numRounds, 0, rk);
+
+    switch (numRounds) // constant round counts, so the round loop unrolls
+    {
+        case AES_128_NUM_ROUNDS: aesniMultiEncryptKernel(jobs, numJobs, mode, rk, AES_128_NUM_ROUNDS); break;
+        case AES_192_NUM_ROUNDS: aesniMultiEncryptKernel(jobs, numJobs, mode, rk, AES_192_NUM_ROUNDS); break;
+        case AES_256_NUM_ROUNDS: aesniMultiEncryptKernel(jobs, numJobs, mode, rk, AES_256_NUM_ROUNDS); break;
+    }
+
+    aesWipe(rk, sizeof(rk));
+
+}
+
+AESNI_TARGET
+void aesniMultiDecrypt(const aes_job_t* jobs, int numJobs, int keyLengthInWords, int numRounds, int mode) {
+
+    __m128i rk[MULTIBUF_LANES][AES_256_NUM_ROUNDS + 1];
+
+    aesniExpandLanes(jobs, numJobs, keyLengthInWords, numRounds, 1, rk);
+
+    switch (numRounds)
+    {
+        case AES_128_NUM_ROUNDS: aesniMultiDecryptKernel(jobs, numJobs, mode, rk, AES_128_NUM_ROUNDS); break;
+        case AES_192_NUM_ROUNDS: aesniMultiDecryptKernel(jobs, numJobs, mode, rk, AES_192_NUM_ROUNDS); break;
+        case AES_256_NUM_ROUNDS: aesniMultiDecryptKernel(jobs, numJobs, mode, rk, AES_256_NUM_ROUNDS); break;
+    }
+
+    aesWipe(rk, sizeof(rk));
+
+}
+
+
+
+const engine_t aesniEngine = {
+
+    .name = "aesni",
+    .isSupported = aesniSupported,
+    .expandKey = aesniExpandKey,
+    .encrypt = aesniEncrypt,
+    .decrypt = aesniDecrypt,
+    .encryptBlocks = aesniEncryptBlocks,
+    .decryptBlocks = aesniDecryptBlocks,
+    .specialize = aesniSpecialize
+
+};
+
+#endif // ENGINE_X86
@@ -0,0 +1,677 @@
+#include "../inc/aes.h"
+#include "../inc/bitslice.h"
+#include <string.h>
+
+// Bitsliced constant-time engine. Four blocks are spread over eight 64-bit
+// words, one word per bit of every state byte, so SubBytes becomes a boolean
+// circuit over whole words and no table is ever indexed with secret data.
+//
+// Layout (same as BearSSL's aes_ct64): block i goes into q[i] and q[i + 4],
+// then ortho() transposes so that q[b] holds bit b of all 64 state bytes.
+
+#define BITSLICE_WORDS 8                // number of 64-bit words holding a batch of blocks
+
+// round keys, already bitsliced, kept in the context's engineKeys
+typedef struct bitslice_keys {
+
+    uint64_t q[BITSLICE_WORDS * (AES_256_NUM_ROUNDS + 1)];
+
+} bitslice_keys_t;
+
+CHECK_ENGINE_KEYS(bitslice_keys_t);
+
+
+
+static int bitsliceAlwaysSupported(void) {
+
+    return 1;
+
+}
+
+
+
+/**
+ * S-box as a boolean circuit (Boyar and Peralta), applied to all 64 bytes
+ * of the batch at once. q[0] holds the least significant bit of each byte.
+ */
+static void bitsliceSbox(uint64_t* q) {
+
+    uint64_t x0, x1, x2, x3, x4, x5, x6, x7;
+    uint64_t y1, y2, y3, y4, y5, y6, y7, y8, y9;
+    uint64_t y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+    uint64_t y20, y21;
+    uint64_t z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+    uint64_t z10, z11, z12, z13, z14, z15, z16, z17;
+    uint64_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+    uint64_t t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+    uint64_t t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+    uint64_t t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+    uint64_t t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+    uint64_t t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+    uint64_t t60, t61, t62, t63, t64, t65, t66, t67;
+    uint64_t s0, s1, s2, s3, s4, s5, s6, s7;
+
+    x0 = q[7];
+    x1 = q[6];
+    x2 = q[5];
+    x3 = q[4];
+    x4 = q[3];
+    x5 = q[2];
+    x6 = q[1];
+    x7 = q[0];
+
+    // top linear transformation
+    y14 = x3 ^ x5;
+    y13 = x0 ^ x6;
+    y9 = x0 ^ x3;
+    y8 = x0 ^ x5;
+    t0 = x1 ^ x2;
+    y1 = t0 ^ x7;
+    y4 = y1 ^ x3;
+    y12 = y13 ^ y14;
+    y2 = y1 ^ x0;
+    y5 = y1 ^ x6;
+    y3 = y5 ^ y8;
+    t1 = x4 ^ y12;
+    y15 = t1 ^ x5;
+    y20 = t1 ^ x1;
+    y6 = y15 ^ x7;
+    y10 = y15 ^ t0;
+    y11 = y20 ^ y9;
+    y7 = x7 ^ y11;
+    y17 = y10 ^ y11;
+    y19 = y10 ^ y8;
+    y16 = t0 ^ y11;
+    y21 = y13 ^ y16;
+    y18 = x0 ^ y16;
+
+    // non-linear section
+    t2 = y12 & y15;
+    t3 = y3 & y6;
+    t4 = t3 ^ t2;
+    t5 = y4 & x7;
+    t6 = t5 ^ t2;
+    t7 = y13 & y16;
+    t8 = y5 & y1;
+    t9 = t8 ^ t7;
+    t10 = y2 & y7;
+    t11 = t10 ^ t7;
+    t12 = y9 & y11;
+    t13 = y14 & y17;
+    t14 = t13 ^ t12;
+    t15 = y8 & y10;
+    t16 = t15 ^ t12;
+    t17 = t4 ^ t14;
+    t18 = t6 ^ t16;
+    t19 = t9 ^ t14;
+    t20 = t11 ^ t16;
+    t21 = t17 ^ y20;
+    t22 = t18 ^ y19;
+    t23 = t19 ^ y21;
+    t24 = t20 ^ y18;
+
+    t25 = t21 ^ t22;
+    t26 = t21 & t23;
+    t27 = t24 ^ t26;
+    t28 = t25 & t27;
+    t29 = t28 ^ t22;
+    t30 = t23 ^ t24;
+    t31 = t22 ^ t26;
+    t32 = t31 & t30;
+    t33 = t32 ^ t24;
+    t34 = t23 ^ t33;
+    t35 = t27 ^ t33;
+    t36 = t24 & t35;
+    t37 = t36 ^ t34;
+    t38 = t27 ^ t36;
+    t39 = t29 & t38;
+    t40 = t25 ^ t39;
+
+    t41 = t40 ^ t37;
+    t42 = t29 ^ t33;
+    t43 = t29 ^ t40;
+    t44 = t33 ^ t37;
+    t45 = t42 ^ t41;
+    z0 = t44 & y15;
+    z1 = t37 & y6;
+    z2 = t33 & x7;
+    z3 = t43 & y16;
+    z4 = t40 & y1;
+    z5 = t29 & y7;
+    z6 = t42 & y11;
+    z7 = t45 & y17;
+    z8 = t41 & y10;
+    z9 = t44 & y12;
+    z10 = t37 & y3;
+    z11 = t33 & y4;
+    z12 = t43 & y13;
+    z13 = t40 & y5;
+    z14 = t29 & y2;
+    z15 = t42 & y9;
+    z16 = t45 & y14;
+    z17 = t41 & y8;
+
+    // bottom linear transformation
+    t46 = z15 ^ z16;
+    t47 = z10 ^ z11;
+    t48 = z5 ^ z13;
+    t49 = z9 ^ z10;
+    t50 = z2 ^ z12;
+    t51 = z2 ^ z5;
+    t52 = z7 ^ z8;
+    t53 = z0 ^ z3;
+    t54 = z6 ^ z7;
+    t55 = z16 ^ z17;
+    t56 = z12 ^ t48;
+    t57 = t50 ^ t53;
+    t58 = z4 ^ t46;
+    t59 = z3 ^ t54;
+    t60 = t46 ^ t57;
+    t61 = z14 ^ t57;
+    t62 = t52 ^ t58;
+    t63 = t49 ^ t58;
+    t64 = z4 ^ t59;
+    t65 = t61 ^ t62;
+    t66 = z1 ^ t63;
+    s0 = t59 ^ t63;
+    s6 = t56 ^ ~t62;
+    s7 = t48 ^ ~t60;
+    t67 = t64 ^ t65;
+    s3 = t53 ^ t66;
+    s4 = t51 ^ t66;
+    s5 = t47 ^ t65;
+    s1 = t64 ^ ~s3;
+    s2 = t55 ^ ~t67;
+
+    q[7] = s0;
+    q[6] = s1;
+    q[5] = s2;
+    q[4] = s3;
+    q[3] = s4;
+    q[2] = s5;
+    q[1] = s6;
+    q[0] = s7;
+
+}
+
+/**
+ * The linear part of the inverse affine transformation,
+ * bit i of the result is bit (i + 2) ^ bit (i + 5) ^ bit (i + 7).
+ */
+static void bitsliceInvAffine(uint64_t* q) {
+
+    uint64_t x[BITSLICE_WORDS];
+
+    memcpy(x, q, sizeof(x));
+
+    for (int i = 0; i < BITSLICE_WORDS; i++)
+    {
+        q[i] = x[(i + 2) & 7] ^ x[(i + 5) & 7] ^ x[(i + 7) & 7];
+    }
+
+}
+
+/**
+ * Inverse s-box built from the forward circuit:
+ * invSbox(x) = A'(sbox(A'(x) ^ 0x05)) ^ 0x05 where A' is the linear part
+ * of the inverse affine transformation (0x05 is its constant).
+ */
+static void bitsliceInvSbox(uint64_t* q) {
+
+    bitsliceInvAffine(q);
+    q[0] = ~q[0];
+    q[2] = ~q[2];
+
+    bitsliceSbox(q);
+
+    bitsliceInvAffine(q);
+    q[0] = ~q[0];
+    q[2] = ~q[2];
+
+}
+
+
+
+#define SWAPN(cl, ch, s, x, y)   do { \
+        uint64_t a = (x); \
+        uint64_t b = (y); \
+        (x) = (a & (uint64_t) (cl)) | ((b & (uint64_t) (cl)) << (s)); \
+        (y) = ((a & (uint64_t) (ch)) >> (s)) | (b & (uint64_t) (ch)); \
+    } while (0)
+
+#define SWAP2(x, y)    SWAPN(0x5555555555555555, 0xAAAAAAAAAAAAAAAA, 1, x, y)
+#define SWAP4(x, y)    SWAPN(0x3333333333333333, 0xCCCCCCCCCCCCCCCC, 2, x, y)
+#define SWAP8(x, y)    SWAPN(0x0F0F0F0F0F0F0F0F, 0xF0F0F0F0F0F0F0F0, 4, x, y)
+
+/**
+ * Transpose between byte order and bit planes. It is its own inverse.
+ */
+static void bitsliceOrtho(uint64_t* q) {
+
+    SWAP2(q[0], q[1]);
+    SWAP2(q[2], q[3]);
+    SWAP2(q[4], q[5]);
+    SWAP2(q[6], q[7]);
+
+    SWAP4(q[0], q[2]);
+    SWAP4(q[1], q[3]);
+    SWAP4(q[4], q[6]);
+    SWAP4(q[5], q[7]);
+
+    SWAP8(q[0], q[4]);
+    SWAP8(q[1], q[5]);
+    SWAP8(q[2], q[6]);
+    SWAP8(q[3], q[7]);
+
+}
+
+/**
+ * Spread one block, given as four little endian column words,
+ * over two 64-bit words.
+ */
+static void interleaveIn(uint64_t* q0, uint64_t* q1, const uint32_t* w) {
+
+    uint64_t x0 = w[0];
+    uint64_t x1 = w[1];
+    uint64_t x2 = w[2];
+    uint64_t x3 = w[3];
+
+    x0 |= (x0 << 16);
+    x1 |= (x1 << 16);
+    x2 |= (x2 << 16);
+    x3 |= (x3 << 16);
+    x0 &= (uint64_t) 0x0000FFFF0000FFFF;
+    x1 &= (uint64_t) 0x0000FFFF0000FFFF;
+    x2 &= (uint64_t) 0x0000FFFF0000FFFF;
+    x3 &= (uint64_t) 0x0000FFFF0000FFFF;
+    x0 |= (x0 << 8);
+    x1 |= (x1 << 8);
+    x2 |= (x2 << 8);
+    x3 |= (x3 << 8);
+    x0 &= (uint64_t) 0x00FF00FF00FF00FF;
+    x1 &= (uint64_t) 0x00FF00FF00FF00FF;
+    x2 &= (uint64_t) 0x00FF00FF00FF00FF;
+    x3 &= (uint64_t) 0x00FF00FF00FF00FF;
+
+    *q0 = x0 | (x2 << 8);
+    *q1 = x1 | (x3 << 8);
+
+}
+
+/**
+ * Inverse of interleaveIn().
+ */
+static void interleaveOut(uint32_t* w, uint64_t q0, uint64_t q1) {
+
+    uint64_t x0 = q0 & (uint64_t) 0x00FF00FF00FF00FF;
+    uint64_t x1 = q1 & (uint64_t) 0x00FF00FF00FF00FF;
+    uint64_t x2 = (q0 >> 8) & (uint64_t) 0x00FF00FF00FF00FF;
+    uint64_t x3 = (q1 >> 8) & (uint64_t) 0x00FF00FF00FF00FF;
+
+    x0 |= (x0 >> 8);
+    x1 |= (x1 >> 8);
+    x2 |= (x2 >> 8);
+    x3 |= (x3 >> 8);
+    x0 &= (uint64_t) 0x0000FFFF0000FFFF;
+    x1 &= (uint64_t) 0x0000FFFF0000FFFF;
+    x2 &= (uint64_t) 0x0000FFFF0000FFFF;
+    x3 &= (uint64_t) 0x0000FFFF0000FFFF;
+
+    w[0] = (uint32_t) x0 | (uint32_t) (x0 >> 16);
+    w[1] = (uint32_t) x1 | (uint32_t) (x1 >> 16);
+    w[2] = (uint32_t) x2 | (uint32_t) (x2 >> 16);
+    w[3] = (uint32_t) x3 | (uint32_t) (x3 >> 16);
+
+}
+
+
+
+static void bitsliceAddRoundKey(uint64_t* q, const uint64_t* roundKey) {
+
+    for (int i = 0; i < BITSLICE_WORDS; i++)
+    {
+        q[i] ^= roundKey[i];
+    }
+
+}
+
+static void bitsliceShiftRows(uint64_t* q) {
+
+    for (int i = 0; i < BITSLICE_WORDS; i++)
+    {
+
+        uint64_t x = q[i];
+
+        q[i] = (x & (uint64_t) 0x000000000000FFFF)
+            | ((x & (uint64_t) 0x00000000FFF00000) >> 4)
+            | ((x & (uint64_t) 0x00000000000F0000) << 12)
+            | ((x & (uint64_t) 0x0000FF0000000000) >> 8)
+            | ((x & (uint64_t) 0x000000FF00000000) << 8)
+            | ((x & (uint64_t) 0xF000000000000000) >> 12)
+            | ((x & (uint64_t) 0x0FFF000000000000) << 4);
+
+    }
+
+}
+
+static void bitsliceInvShiftRows(uint64_t* q) {
+
+    for (int i = 0; i < BITSLICE_WORDS; i++)
+    {
+
+        uint64_t x = q[i];
+
+        q[i] = (x & (uint64_t) 0x000000000000FFFF)
+            | ((x & (uint64_t) 0x000000000FFF0000) << 4)
+            | ((x & (uint64_t) 0x00000000F0000000) >> 12)
+            | ((x & (uint64_t) 0x000000FF00000000) << 8)
+            | ((x & (uint64_t) 0x0000FF0000000000) >> 8)
+            | ((x & (uint64_t) 0x000F000000000000) << 12)
+            | ((x & (uint64_t) 0xFFF0000000000000) >> 4);
+
+    }
+
+}
+
+// rotate every column down by two rows
+static uint64_t rotr32(uint64_t x) {
+
+    return (x << 32) | (x >> 32);
+
+}
+
+static void bitsliceMixColumns(uint64_t* q) {
+
+    uint64_t q0, q1, q2, q3, q4, q5, q6, q7;
+    uint64_t r0, r1, r2, r3, r4, r5, r6, r7;
+
+    q0 = q[0];
+    q1 = q[1];
+    q2 = q[2];
+    q3 = q[3];
+    q4 = q[4];
+    q5 = q[5];
+    q6 = q[6];
+    q7 = q[7];
+
+    // the next row of every column
+    r0 = (q0 >> 16) | (q0 << 48);
+    r1 = (q1 >> 16) | (q1 << 48);
+    r2 = (q2 >> 16) | (q2 << 48);
+    r3 = (q3 >> 16) | (q3 << 48);
+    r4 = (q4 >> 16) | (q4 << 48);
+    r5 = (q5 >> 16) | (q5 << 48);
+    r6 = (q6 >> 16) | (q6 << 48);
+    r7 = (q7 >> 16) | (q7 << 48);
+
+    q[0] = q7 ^ r7 ^ r0 ^ rotr32(q0 ^ r0);
+    q[1] = q0 ^ r0 ^ q7 ^ r7 ^ r1 ^ rotr32(q1 ^ r1);
+    q[2] = q1 ^ r1 ^ r2 ^ rotr32(q2 ^ r2);
+    q[3] = q2 ^ r2 ^ q7 ^ r7 ^ r3 ^ rotr32(q3 ^ r3);
+    q[4] = q3 ^ r3 ^ q7 ^ r7 ^ r4 ^ rotr32(q4 ^ r4);
+    q[5] = q4 ^ r4 ^ r5 ^ rotr32(q5 ^ r5);
+    q[6] = q5 ^ r5 ^ r6 ^ rotr32(q6 ^ r6);
+    q[7] = q6 ^ r6 ^ r7 ^ rotr32(q7 ^ r7);
+
+}
+
+/**
+ * InvMixColumns is MixColumns applied after multiplying each column
+ * by {04}x^2 + {05}, i.e. a[r] ^ {04} * (a[r] ^ a[r + 2]).
+ */
+static void bitsliceInvMixColumns(uint64_t* q) {
+
+    uint64_t x[BITSLICE_WORDS];
+
+    for (int i = 0; i < BITSLICE_WORDS; i++)
+    {
+        x[i] = q[i] ^ rotr32(q[i]);
+    }
+
+    // multiply by {04}: two xtimes, bit 7 feeds back into bits 0, 1, 3 and 4
+    for (int n = 0; n < 2; n++)
+    {
+
+        uint64_t carry = x[7];
+
+        x[7] = x[6];
+        x[6] = x[5];
+        x[5] = x[4];
+        x[4] = x[3] ^ carry;
+        x[3] = x[2] ^ carry;
+        x[2] = x[1];
+        x[1] = x[0] ^ carry;
+        x[0] = carry;
+
+    }
+
+    for (int i = 0; i < BITSLICE_WORDS; i++)
+    {
+        q[i] ^= x[i];
+    }
+
+    bitsliceMixColumns(q);
+
+}
+
+
+
+/**
+ * Constant-time SubWord, runs a single word through the circuit.
+ */
+static uint32_t bitsliceSubWord(uint32_t word) {
+
+    uint64_t q[BITSLICE_WORDS] = {0};
+
+    q[0] = word;
+    bitsliceOrtho(q);
+    bitsliceSbox(q);
+    bitsliceOrtho(q);
+
+    return (uint32_t) q[0];
+
+}
+
+/**
+ * Expand the key and store the round keys in bitsliced form, each round
+ * key repeated for all four blocks of a batch. The schedule is computed
+ * with the circuit as well, so it is constant-time too.
+ */
+static void bitsliceExpandKey(aes_ctx_t* ctx) {
+
+    uint64_t* bitsliceKeys = ENGINE_KEYS(bitslice_keys_t, ctx)->q;
+    const uint32_t* key = ctx->keySchedule;
+    int keyLengthInWords = ctx->keyLengthInWords;
+    int numRounds = ctx->numRounds;
+    uint32_t w[AES_BLOCK_SIZE_WORDS * (AES_256_NUM_ROUNDS + 1)];
+    uint32_t rcon = 1;
+    int scheduleLength = AES_BLOCK_SIZE_WORDS * (numRounds + 1);
+
+    // little endian words in memory byte order, RotWord is a right rotate
+    for (int i = 0; i < keyLengthInWords; i++)
+    {
+        w[i] = __builtin_bswap32(key[i]);
+    }
+
+    for (int i = keyLengthInWords; i < scheduleLength; i++)
+    {
+
+        uint32_t temp = w[i - 1];
+
+        if (i % keyLengthInWords == 0)
+        {
+            temp = bitsliceSubWord((temp >> 8) | (temp << 24)) ^ rcon;
+            rcon = (rcon << 1) ^ ((rcon & 0x80) ? 0x11B : 0);
+        }
+        else if (keyLengthInWords == AES_256_KEY_LENGTH_WORDS && i % keyLengthInWords == 4)
+        {
+            temp = bitsliceSubWord(temp);
+        }
+
+        w[i] = w[i - keyLengthInWords] ^ temp;
+
+    }
+
+    for (int i = 0; i <= numRounds; i++)
+    {
+
+        uint64_t* q = &bitsliceKeys[BITSLICE_WORDS * i];
+
+        interleaveIn(&q[0], &q[4], &w[AES_BLOCK_SIZE_WORDS * i]);
+        q[1] = q[2] = q[3] = q[0];
+        q[5] = q[6] = q[7] = q[4];
+        bitsliceOrtho(q);
+
+    }
+
+    aesWipe(w, sizeof(w));
+
+}
+
+
+
+/**
+ * Load up to four blocks (column-major, as in memory) into a batch. Unused slots are zero.
+ */
+static void bitsliceLoad(uint64_t* q, const uint8_t* blocks, int numBlocks) {
+
+    memset(q, 0, sizeof(uint64_t) * BITSLICE_WORDS);
+
+    for (int i = 0; i < numBlocks; i++)
+    {
+
+        const uint8_t* block = blocks + (BLOCK_SIZE_BYTES * i);
+        uint32_t w[AES_BLOCK_SIZE_WORDS];
+
+        for (int c = 0; c < BLOCK_ROW_COL_SIZE; c++)
+        {
+            w[c] = (uint32_t) block[4 * c] | ((uint32_t) block[(4 * c) + 1] << 8) |
+                   ((uint32_t) block[(4 * c) + 2] << 16) | ((uint32_t) block[(4 * c) + 3] << 24);
+        }
+
+        interleaveIn(&q[i], &q[i + 4], w);
+
+    }
+
+    bitsliceOrtho(q);
+
+}
+
+static void bitsliceStore(uint8_t* blocks, uint64_t* q, int numBlocks) {
+
+    bitsliceOrtho(q);
+
+    for (int i = 0; i < numBlocks; i++)
+    {
+
+        uint8_t* block = blocks + (BLOCK_SIZE_BYTES * i);
+        uint32_t w[AES_BLOCK_SIZE_WORDS];
+
+        interleaveOut(w, q[i], q[i + 4]);
+
+        for (int c = 0; c < BLOCK_ROW_COL_SIZE; c++)
+        {
+            block[4 * c] = w[c];
+            block[(4 * c) + 1] = w[c] >> 8;
+            block[(4 * c) + 2] = w[c] >> 16;
+            block[(4 * c) + 3] = w[c] >> 24;
+        }
+
+    }
+
+}
+
+
+
+static void bitsliceEncryptBlocks(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks) {
+
+    const uint64_t* bitsliceKeys = ENGINE_KEYS(const bitslice_keys_t, ctx)->q;
+    int numRounds = ctx->numRounds;
+    uint64_t q[BITSLICE_WORDS];
+
+    for (int n = 0; n < numBlocks; n += BITSLICE_BLOCKS)
+    {
+
+        int batch = (numBlocks - n < BITSLICE_BLOCKS) ? numBlocks - n : BITSLICE_BLOCKS;
+
+        bitsliceLoad(q, in + (BLOCK_SIZE_BYTES * n), batch);
+
+        bitsliceAddRoundKey(q, bitsliceKeys);
+
+        for (int i = 1; i < numRounds; i++)
+        {
+            bitsliceSbox(q);
+            bitsliceShiftRows(q);
+            bitsliceMixColumns(q);
+            bitsliceAddRoundKey(q, &bitsliceKeys[BITSLICE_WORDS * i]);
+        }
+
+        bitsliceSbox(q);
+        bitsliceShiftRows(q);
+        bitsliceAddRoundKey(q, &bitsliceKeys[BITSLICE_WORDS * numRounds]);
+
+        bitsliceStore(out + (BLOCK_SIZE_BYTES * n), q, batch);
+
+    }
+
+}
+
+static void bitsliceDecryptBlocks(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks) {
+
+    const uint64_t* bitsliceKeys = ENGINE_KEYS(const bitslice_keys_t, ctx)->q;
+    int numRounds = ctx->numRounds;
+    uint64_t q[BITSLICE_WORDS];
+
+    for (int n = 0; n < numBlocks; n += BITSLICE_BLOCKS)
+    {
+
+        int batch = (numBlocks - n < BITSLICE_BLOCKS) ? numBlocks - n : BITSLICE_BLOCKS;
+
+        bitsliceLoad(q, in + (BLOCK_SIZE_BYTES * n), batch);
+
+        bitsliceAddRoundKey(q, &bitsliceKeys[BITSLICE_WORDS * numRounds]);
+
+        for (int i = numRounds - 1; i > 0; i--)
+        {
+            bitsliceInvShiftRows(q);
+            bitsliceInvSbox(q);
+            bitsliceAddRoundKey(q, &bitsliceKeys[BITSLICE_WORDS * i]);
+            bitsliceInvMixColumns(q);
+        }
+
+        bitsliceInvShiftRows(q);
+        bitsliceInvSbox(q);
+        bitsliceAddRoundKey(q, bitsliceKeys);
+
+        bitsliceStore(out + (BLOCK_SIZE_BYTES * n), q, batch);
+
+    }
+
+}
+
+static void bitsliceEncrypt(const aes_ctx_t* ctx, uint8_t* block) {
+
+    bitsliceEncryptBlocks(ctx, block, block, 1);
+
+}
+
+static void bitsliceDecrypt(const aes_ctx_t* ctx, uint8_t* block) {
+
+    bitsliceDecryptBlocks(ctx, block, block, 1);
+
+}
+
+
+
+const engine_t aesBitsliceEngine = {
+
+    .name = "bitslice",
+    .isSupported = bitsliceAlwaysSupported,
+    .expandKey = bitsliceExpandKey,
+    .encrypt = bitsliceEncrypt,
+    .decrypt = bitsliceDecrypt,
+    .encryptBlocks = bitsliceEncryptBlocks,
+    .decryptBlocks = bitsliceDecryptBlocks,
+    .specialize = NULL      // rounds are too large to be worth unrolling
+
+};
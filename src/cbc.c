@@ -4,6 +4,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 // implement Cipher Block Chain mode 
 
 // should we do the encyrption in a function (other than main) in aes.c 
@@ -11,7 +15,20 @@
 
 // IV is 16 bytes (same as block)
 
-void xor(uint8_t** a, uint8_t** b) {
+/*
+ * Arguments of a parallel decrypt: the whole run, each part takes its slice
+ */
+typedef struct cbc_task {
+
+    const aes_ctx_t* ctx;
+    const uint8_t* in;
+    uint8_t* out;
+    size_t numBlocks;
+    const uint8_t* prevCiphers;         // the ciphertext block before each slice
+
+} cbc_task_t;
+
+static void xorBlock(uint8_t** a, uint8_t** b) {
 
     for (int i = 0; i < BUFFER_SIZE; i++)
     {
@@ -22,6 +39,44 @@ void xor(uint8_t** a, uint8_t** b) {
 
 }
 
+/*
+ * out          - numBlocks blocks of a XOR b; may be a or b
+ * a            - the first operand
+ * b            - the second operand
+ * numBlocks    - the number of 16 byte blocks
+ */
+void aesXorBlocks(uint8_t* out, const uint8_t* a, const uint8_t* b, size_t numBlocks) {
+
+#ifdef __SSE2__
+
+    for (size_t i = 0; i < numBlocks; i++)
+    {
+
+        __m128i x = _mm_loadu_si128((const __m128i*) (a + (BUFFER_SIZE * i)));
+        __m128i y = _mm_loadu_si128((const __m128i*) (b + (BUFFER_SIZE * i)));
+
+        _mm_storeu_si128((__m128i*) (out + (BUFFER_SIZE * i)), _mm_xor_si128(x, y));
+
+    }
+
+#else
+
+    for (size_t i = 0; i < 2 * numBlocks; i++) // 8 bytes at a time
+    {
+
+        uint64_t x, y;
+
+        memcpy(&x, a + (8 * i), 8);
+        memcpy(&y, b + (8 * i), 8);
+        x ^= y;
+        memcpy(out + (8 * i), &x, 8);
+
+    }
+
+#endif
+
+}
+
 
 
 // ENCRYPT
@@ -47,61 +102,290 @@ void xor(uint8_t** a, uint8_t** b) {
 
 
 /*
- * inBuf        - the input to the encryption algorithm
- * prevCipher   - the previously computed cipher
- * keySchedule  - the key schedule
- * numRounds    - the number of encryption rounds, specific to each key length
- * iv           - the initialization vector
- * firstRun     - 1 for first run, 0 otherwise
+ * ctx          - the key, with the previous ciphertext (the iv at the start) in ctx->iv
+ * block        - the plaintext block, replaced by the ciphertext
  */
-void cbcEncrypt(uint8_t* inBuf, uint8_t* prevCipherOut, uint8_t* prevCipherIn, int numRounds, uint8_t* iv, int* firstRun) {
+void cbcEncrypt(aes_ctx_t* ctx, uint8_t* block) {
+
+    uint8_t* prev = ctx->iv;
+
+    xorBlock(&block, &prev); // xor with the iv or the previously generated ciphertext
+
+    aesEncrypt(ctx, block);
+
+    memcpy(ctx->iv, block, BUFFER_SIZE);
+
+}
 
-    if (*firstRun) 
+/*
+ * ctx          - the key, with the previous ciphertext (the iv at the start) in ctx->iv
+ * block        - the ciphertext block, replaced by the plaintext
+ */
+void cbcDecrypt(aes_ctx_t* ctx, uint8_t* block) {
+
+    uint8_t cipher[BUFFER_SIZE];
+    uint8_t* prev = ctx->iv;
+
+    memcpy(cipher, block, BUFFER_SIZE);
+
+    aesDecrypt(ctx, block);
+
+    xorBlock(&block, &prev); // xor with the iv or the previous ciphertext
+
+    memcpy(ctx->iv, cipher, BUFFER_SIZE);
+
+}
+
+/*
+ * Encrypt a run of blocks. Each block depends on the ciphertext of the
+ * one before, so they go through the engine one at a time.
+ *
+ * in           - the plaintext blocks
+ * out          - where the ciphertext goes; may be in itself, but must
+ *                not otherwise overlap it
+ */
+void cbcEncryptBlocks(aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks) {
+
+    if (in != out)
     {
-        // xor inBuf with iv
-        xor(&inBuf, &iv);
-        (*firstRun)--;
+        memcpy(out, in, numBlocks * BUFFER_SIZE);
     }
-    else
+
+    for (int i = 0; i < numBlocks; i++)
+    {
+        cbcEncrypt(ctx, out + (BUFFER_SIZE * i));
+    }
+
+}
+
+/*
+ * Encrypt several independent CBC chains under the same key. One chain
+ * is a strict sequence, but the engines can work on several blocks at
+ * once, so the chains advance in lockstep: block j of every chain still
+ * running goes to the engine in one call. CBC_MAX_STREAMS chains are
+ * advanced at a time.
+ *
+ * ctx          - the key; ctx->iv is not used
+ * streams      - the chains, each with its own iv and length
+ * numStreams   - the number of chains
+ */
+void cbcEncryptStreams(const aes_ctx_t* ctx, cbc_stream_t* streams, int numStreams) {
+
+    uint8_t lanes[CBC_MAX_STREAMS * BUFFER_SIZE]; // block j of every running chain
+    const uint8_t* prev[CBC_MAX_STREAMS];
+    int laneStream[CBC_MAX_STREAMS];
+
+    for (int first = 0; first < numStreams; first += CBC_MAX_STREAMS)
+    {
+
+        int group = (numStreams - first < CBC_MAX_STREAMS) ? numStreams - first : CBC_MAX_STREAMS;
+        cbc_stream_t* s = streams + first;
+        size_t minBlocks = s[0].numBlocks;
+        size_t maxBlocks = 0;
+
+        for (int c = 0; c < group; c++)
+        {
+
+            prev[c] = s[c].iv;
+
+            if (s[c].numBlocks < minBlocks)
+            {
+                minBlocks = s[c].numBlocks;
+            }
+
+            if (s[c].numBlocks > maxBlocks)
+            {
+                maxBlocks = s[c].numBlocks;
+            }
+
+        }
+
+        size_t j = 0;
+
+        for (; j < minBlocks; j++) // every chain still running, lane c is chain c
+        {
+
+            for (int c = 0; c < group; c++)
+            {
+                aesXorBlocks(lanes + (BUFFER_SIZE * c), s[c].in + (BUFFER_SIZE * j), prev[c], 1);
+            }
+
+            aesEncryptBlocks(ctx, lanes, lanes, group);
+
+            for (int c = 0; c < group; c++)
+            {
+
+                uint8_t* block = s[c].out + (BUFFER_SIZE * j);
+
+                memcpy(block, lanes + (BUFFER_SIZE * c), BUFFER_SIZE);
+                prev[c] = block;
+
+            }
+
+        }
+
+        for (; j < maxBlocks; j++) // the shorter chains have ended
+        {
+
+            int numLanes = 0;
+
+            for (int c = 0; c < group; c++)
+            {
+                if (j < s[c].numBlocks)
+                {
+                    aesXorBlocks(lanes + (BUFFER_SIZE * numLanes), s[c].in + (BUFFER_SIZE * j), prev[c], 1);
+                    laneStream[numLanes++] = c;
+                }
+            }
+
+            aesEncryptBlocks(ctx, lanes, lanes, numLanes);
+
+            for (int k = 0; k < numLanes; k++)
+            {
+
+                int c = laneStream[k];
+                uint8_t* block = s[c].out + (BUFFER_SIZE * j);
+
+                memcpy(block, lanes + (BUFFER_SIZE * k), BUFFER_SIZE);
+                prev[c] = block;
+
+            }
+
+        }
+
+        for (int c = 0; c < group; c++)
+        {
+            if (s[c].numBlocks > 0)
+            {
+                memcpy(s[c].iv, prev[c], BUFFER_SIZE);
+            }
+        }
+
+    }
+
+}
+
+/*
+ * Decrypt a run of blocks without touching ctx->iv. Only the XOR depends
+ * on the previous block, so each batch is decrypted together (letting the
+ * engine work on several blocks at once) and then XORed with the
+ * ciphertext before it in a separate pass.
+ *
+ * prevCipher   - the ciphertext block before in[0] (the iv at the start)
+ */
+static void cbcDecryptRun(const aes_ctx_t* ctx, const uint8_t* prevCipher, const uint8_t* in, uint8_t* out, size_t numBlocks) {
+
+    uint8_t cipher[CBC_BATCH_BLOCKS * BUFFER_SIZE]; // ciphertext of the current batch, when decrypting in place
+    uint8_t prev[BUFFER_SIZE];
+
+    memcpy(prev, prevCipher, BUFFER_SIZE);
+
+    for (size_t n = 0; n < numBlocks; n += CBC_BATCH_BLOCKS)
     {
-        // xor with previously generated ciphertext
-        xor(&inBuf, &prevCipherIn);
+
+        int batch = (numBlocks - n < CBC_BATCH_BLOCKS) ? (int) (numBlocks - n) : CBC_BATCH_BLOCKS;
+        const uint8_t* batchIn = in + (BUFFER_SIZE * n);
+        uint8_t* batchOut = out + (BUFFER_SIZE * n);
+
+        if (in == out) // the ciphertext is about to be overwritten, keep a copy for the XOR
+        {
+            memcpy(cipher, batchIn, batch * BUFFER_SIZE);
+            batchIn = cipher;
+        }
+
+        aesDecryptBlocks(ctx, batchIn, batchOut, batch);
+
+        aesXorBlocks(batchOut, batchOut, prev, 1);
+        aesXorBlocks(batchOut + BUFFER_SIZE, batchOut + BUFFER_SIZE, batchIn, batch - 1);
+
+        memcpy(prev, batchIn + (BUFFER_SIZE * (batch - 1)), BUFFER_SIZE);
+
+    }
+
+}
+
+/*
+ * Decrypt a run of blocks on the calling thread.
+ *
+ * ctx          - the key, with the previous ciphertext (the iv at the start) in ctx->iv;
+ *                updated to the last ciphertext block of this run
+ * in           - the ciphertext blocks
+ * out          - where the plaintext goes; may be in itself, but must
+ *                not otherwise overlap it
+ * numBlocks    - the number of blocks
+ */
+void cbcDecryptBlocks(aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks) {
+
+    uint8_t last[BUFFER_SIZE];
+
+    if (numBlocks == 0)
+    {
+        return;
     }
 
-    aesEncrypt(inBuf, numRounds);
+    memcpy(last, in + (BUFFER_SIZE * (numBlocks - 1)), BUFFER_SIZE);
 
-    // prevCipher = inBuf;
-    memcpy(prevCipherOut, inBuf, BUFFER_SIZE);
+    cbcDecryptRun(ctx, ctx->iv, in, out, numBlocks);
+
+    memcpy(ctx->iv, last, BUFFER_SIZE);
+
+}
+
+
+
+static void cbcDecryptTask(void* arg, int part, int numParts) {
+
+    cbc_task_t* task = arg;
+    size_t first = poolSliceStart(task->numBlocks, part, numParts);
+    size_t last = poolSliceStart(task->numBlocks, part + 1, numParts);
+
+    if (first < last)
+    {
+        cbcDecryptRun(task->ctx, task->prevCiphers + (BUFFER_SIZE * part), task->in + (BUFFER_SIZE * first), task->out + (BUFFER_SIZE * first), last - first);
+    }
 
 }
 
 /*
- * inBuf        - the input to the encryption algorithm
- * prevCipher   - the previously computed cipher
- * keySchedule  - the key schedule
- * numRounds    - the number of encryption rounds, specific to each key length
- * iv           - the initialization vector
- * firstRun     - 1 for first run, 0 otherwise
+ * Decrypt a run of blocks on every thread of the pool. Each thread takes
+ * one contiguous slice. The ciphertext block before every slice is saved
+ * first, since in place the thread before would overwrite it.
+ *
+ * Same arguments as cbcDecryptBlocks.
  */
-void cbcDecrypt(uint8_t* inBuf, uint8_t* prevCipherOut, uint8_t* prevCipherIn, int numRounds, uint8_t* iv, int* firstRun) {
+void poolCbcDecryptBlocks(thread_pool_t* pool, aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, size_t numBlocks) {
 
-    // prevCipher = inBuf;
-    memcpy(prevCipherOut, inBuf, BUFFER_SIZE); // this is probably overwriting the previous cipher we want (NOT GOOD)
+    uint8_t prevCiphers[POOL_MAX_THREADS * BUFFER_SIZE];
+    uint8_t last[BUFFER_SIZE];
+    int numParts = pool->numThreads;
 
-    // figure out how to get previous cipher out so it doesn't get overwritten
+    if (numBlocks == 0)
+    {
+        return;
+    }
 
-    aesDecrypt(inBuf, numRounds);
+    memcpy(last, in + (BUFFER_SIZE * (numBlocks - 1)), BUFFER_SIZE);
 
-    if (*firstRun)
+    if (numParts == 1 || numBlocks < (size_t) POOL_MIN_BLOCKS * numParts) // small runs stay on this thread
     {
-        // xor inBuf with iv
-        xor(&inBuf, &iv);
-        (*firstRun)--;
+        cbcDecryptRun(ctx, ctx->iv, in, out, numBlocks);
     }
     else
     {
-        // xor with previous ciphertext
-        xor(&inBuf, &prevCipherIn);
+
+        cbc_task_t task = {ctx, in, out, numBlocks, prevCiphers};
+
+        memcpy(prevCiphers, ctx->iv, BUFFER_SIZE);
+
+        for (int part = 1; part < numParts; part++)
+        {
+            memcpy(prevCiphers + (BUFFER_SIZE * part), in + (BUFFER_SIZE * (poolSliceStart(numBlocks, part, numParts) - 1)), BUFFER_SIZE);
+        }
+
+        poolRun(pool, cbcDecryptTask, &task);
+
     }
-    
+
+    memcpy(ctx->iv, last, BUFFER_SIZE);
+
 }
@@ -0,0 +1,196 @@
+#include "../inc/aes.h"
+#include "../inc/cbc.h"
+#include "../inc/ctr.h"
+#include <string.h>
+
+// implement Counter mode (NIST SP 800-38A): the keystream is the encryption
+// of iv, iv + 1, iv + 2, ... as one 128 bit big endian number, so the
+// counter of any block is known without touching the blocks before it
+
+/*
+ * Arguments of a parallel run: the whole run, each part takes its slice
+ */
+typedef struct ctr_task {
+
+    const aes_ctx_t* ctx;
+    const uint8_t* counter;             // the counter block of the first block
+    const uint8_t* in;
+    uint8_t* out;
+    size_t numBlocks;
+
+} ctr_task_t;
+
+
+
+/*
+ * iv           - the initial counter block
+ * blockIndex   - the block of the message
+ * counter      - 16 bytes, set to iv + blockIndex (mod 2^128)
+ */
+void ctrCounterAt(const uint8_t* iv, uint64_t blockIndex, uint8_t* counter) {
+
+    unsigned int carry = 0;
+
+    for (int i = BLOCK_SIZE_BYTES - 1; i >= 0; i--)
+    {
+
+        unsigned int sum = iv[i] + (unsigned int) (blockIndex & 0xff) + carry;
+
+        counter[i] = (uint8_t) sum;
+        carry = sum >> 8;
+        blockIndex >>= 8;
+
+    }
+
+}
+
+/*
+ * XOR the keystream starting at counter into numBlocks whole blocks.
+ * The counter is kept as two native words, so making a block is two
+ * byte-swapped stores; the batch is then encrypted by the engine's
+ * widest kernel in one call.
+ */
+static void ctrBlocks(const aes_ctx_t* ctx, const uint8_t* counter, const uint8_t* in, uint8_t* out, size_t numBlocks) {
+
+    uint8_t counters[CTR_BATCH_BLOCKS * BLOCK_SIZE_BYTES];
+    uint8_t keystream[CTR_BATCH_BLOCKS * BLOCK_SIZE_BYTES];
+    uint64_t high;
+    uint64_t low;
+
+    memcpy(&high, counter, 8);
+    memcpy(&low, counter + 8, 8);
+    high = __builtin_bswap64(high);
+    low = __builtin_bswap64(low);
+
+    for (size_t n = 0; n < numBlocks; n += CTR_BATCH_BLOCKS)
+    {
+
+        int batch = (numBlocks - n < CTR_BATCH_BLOCKS) ? (int) (numBlocks - n) : CTR_BATCH_BLOCKS;
+
+        for (int i = 0; i < batch; i++)
+        {
+
+            uint64_t h = __builtin_bswap64(high);
+            uint64_t l = __builtin_bswap64(low);
+
+            memcpy(counters + (BLOCK_SIZE_BYTES * i), &h, 8);
+            memcpy(counters + (BLOCK_SIZE_BYTES * i) + 8, &l, 8);
+
+            if (++low == 0)
+            {
+                high++;
+            }
+
+        }
+
+        aesEncryptBlocks(ctx, counters, keystream, batch);
+        aesXorBlocks(out + (BLOCK_SIZE_BYTES * n), in + (BLOCK_SIZE_BYTES * n), keystream, batch);
+
+    }
+
+    aesWipe(keystream, sizeof(keystream));
+
+}
+
+static void ctrTask(void* arg, int part, int numParts) {
+
+    ctr_task_t* task = arg;
+    size_t first = poolSliceStart(task->numBlocks, part, numParts);
+    size_t last = poolSliceStart(task->numBlocks, part + 1, numParts);
+    uint8_t counter[BLOCK_SIZE_BYTES];
+
+    ctrCounterAt(task->counter, first, counter);
+    ctrBlocks(task->ctx, counter, task->in + (BLOCK_SIZE_BYTES * first), task->out + (BLOCK_SIZE_BYTES * first), last - first);
+
+}
+
+/*
+ * XOR length bytes with the keystream from byte offset on, a partial
+ * block at either end done one byte at a time.
+ */
+static void ctrRun(thread_pool_t* pool, const aes_ctx_t* ctx, const uint8_t* iv, uint64_t offset, const uint8_t* in, uint8_t* out, size_t length) {
+
+    uint8_t counter[BLOCK_SIZE_BYTES];
+    uint8_t keystream[BLOCK_SIZE_BYTES];
+    uint64_t block = offset / BLOCK_SIZE_BYTES;
+    size_t skip = offset % BLOCK_SIZE_BYTES;
+
+    if (skip > 0 && length > 0) // finish the block offset starts in
+    {
+
+        size_t count = (length < BLOCK_SIZE_BYTES - skip) ? length : BLOCK_SIZE_BYTES - skip;
+
+        ctrCounterAt(iv, block, keystream);
+        aesEncrypt(ctx, keystream);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            out[i] = in[i] ^ keystream[skip + i];
+        }
+
+        in += count;
+        out += count;
+        length -= count;
+        block++;
+
+    }
+
+    size_t numBlocks = length / BLOCK_SIZE_BYTES;
+    ctr_task_t task = {ctx, counter, in, out, numBlocks};
+
+    ctrCounterAt(iv, block, counter);
+
+    if (pool && pool->numThreads > 1 && numBlocks >= (size_t) POOL_MIN_BLOCKS * pool->numThreads) {
+        poolRun(pool, ctrTask, &task);
+    }
+    else {
+        ctrBlocks(ctx, counter, in, out, numBlocks);
+    }
+
+    in += BLOCK_SIZE_BYTES * numBlocks;
+    out += BLOCK_SIZE_BYTES * numBlocks;
+    length -= BLOCK_SIZE_BYTES * numBlocks;
+
+    if (length > 0) // the start of a block
+    {
+
+        ctrCounterAt(iv, block + numBlocks, keystream);
+        aesEncrypt(ctx, keystream);
+
+        for (size_t i = 0; i < length; i++)
+        {
+            out[i] = in[i] ^ keystream[i];
+        }
+
+    }
+
+    aesWipe(keystream, sizeof(keystream));
+
+}
+
+/*
+ * ctx          - the key; only read
+ * iv           - the initial counter block, 16 bytes
+ * offset       - where in the message in starts, in bytes; any value
+ * in           - length bytes of plaintext (or ciphertext, the two are the same operation)
+ * out          - length bytes of output; may be in, but must not otherwise overlap it
+ * length       - any number of bytes; CTR does not pad
+ *
+ * Each call stands alone, so a message can be processed in pieces, out
+ * of order, or starting part way through.
+ */
+void ctrCrypt(const aes_ctx_t* ctx, const uint8_t* iv, uint64_t offset, const uint8_t* in, uint8_t* out, size_t length) {
+
+    ctrRun(NULL, ctx, iv, offset, in, out, length);
+
+}
+
+/*
+ * ctrCrypt with the whole blocks split into one contiguous slice per
+ * thread of the pool. Small runs stay on the calling thread.
+ */
+void poolCtrCrypt(thread_pool_t* pool, const aes_ctx_t* ctx, const uint8_t* iv, uint64_t offset, const uint8_t* in, uint8_t* out, size_t length) {
+
+    ctrRun(pool, ctx, iv, offset, in, out, length);
+
+}
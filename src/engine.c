@@ -0,0 +1,142 @@
+#include "../inc/aes.h"
+#include "../inc/engine.h"
+#include "../inc/aesni.h"
+#include "../inc/bitslice.h"
+#include "../inc/vpaes.h"
+#include "../inc/vaes.h"
+#include <string.h>
+
+// choose the block cipher engine for a context
+
+
+
+// engines in order of preference, fastest first
+static const engine_t* engines[] = {
+
+#ifdef ENGINE_X86
+    &aesVaes512Engine,         // AES-NI rounds on 4 blocks per ZMM register
+    &aesVaes256Engine,         // AES-NI rounds on 2 blocks per YMM register
+    &aesniEngine,
+    &aesVpaesEngine,           // SSSE3, constant-time, for CPUs without AES-NI
+#endif
+    &aesBitsliceEngine,        // constant-time, preferred over the T-tables which leak through the cache
+    &aesTtableEngine           // portable C, runs everywhere
+
+};
+
+#define NUM_ENGINES ((int) (sizeof(engines) / sizeof(engines[0])))
+
+
+
+
+/*
+ * name     - the engine to use, or NULL to use the fastest one the CPU supports
+ *
+ * Returns the selected engine, or NULL if the named engine does not exist
+ * or is not supported on this CPU.
+ */
+const engine_t* aesSelectEngine(const char* name) {
+
+    for (int i = 0; i < NUM_ENGINES; i++)
+    {
+
+        if (name != NULL && strcmp(name, engines[i]->name) != 0)
+        {
+            continue;
+        }
+
+        if (engines[i]->isSupported())
+        {
+            return engines[i];
+        }
+
+        if (name != NULL)
+        {
+            return NULL;
+        }
+
+    }
+
+    return NULL;
+
+}
+
+/*
+ * name     - the engine, as given to aesInit()
+ *
+ * Tells the caller why aesInit() could not use the engine.
+ *
+ * Returns 1 if the engine runs on this CPU, 0 if the CPU lacks the
+ * instructions it needs, or -1 if there is no engine by that name.
+ */
+int aesEngineSupported(const char* name) {
+
+    for (int i = 0; i < NUM_ENGINES; i++)
+    {
+
+        if (strcmp(name, engines[i]->name) == 0)
+        {
+            return engines[i]->isSupported() ? 1 : 0;
+        }
+
+    }
+
+    return -1;
+
+}
+
+
+
+// used for engines without their own multi-block functions
+
+static void loopEncryptBlocks(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks) {
+
+    if (in != out)
+    {
+        memcpy(out, in, numBlocks * BLOCK_SIZE_BYTES);
+    }
+
+    for (int i = 0; i < numBlocks; i++)
+    {
+        ctx->engine->encrypt(ctx, out + (BLOCK_SIZE_BYTES * i));
+    }
+
+}
+
+static void loopDecryptBlocks(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks) {
+
+    if (in != out)
+    {
+        memcpy(out, in, numBlocks * BLOCK_SIZE_BYTES);
+    }
+
+    for (int i = 0; i < numBlocks; i++)
+    {
+        ctx->engine->decrypt(ctx, out + (BLOCK_SIZE_BYTES * i));
+    }
+
+}
+
+/*
+ * ctx          - a context with its engine and key schedule set up
+ *
+ * Fill in the context's kernels. Called once per key, after the key size
+ * is known; engines with per-key-size kernels replace the generic
+ * functions so the hot loop never looks at numRounds.
+ */
+void aesSelectKernels(aes_ctx_t* ctx) {
+
+    const engine_t* engine = ctx->engine;
+    kernels_t* kernels = &ctx->kernels;
+
+    kernels->encrypt = engine->encrypt;
+    kernels->decrypt = engine->decrypt;
+    kernels->encryptBlocks = engine->encryptBlocks ? engine->encryptBlocks : loopEncryptBlocks;
+    kernels->decryptBlocks = engine->decryptBlocks ? engine->decryptBlocks : loopDecryptBlocks;
+
+    if (engine->specialize)
+    {
+        engine->specialize(ctx->numRounds, kernels);
+    }
+
+}
@@ -0,0 +1,512 @@
+#define _GNU_SOURCE // fallocate
+
+#include "../inc/aes.h"
+#include "../inc/fileio.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// file input and output for the command line tool: mapped when the files
+// allow it, so there is no stdio buffer to copy through, fread / fwrite
+// otherwise
+
+
+
+static int stdoutFd = STDOUT_FILENO;    // where an output named IO_STDIO goes, see ioKeepStdout
+
+
+
+/*
+ * A read or write on the calling thread failed: print why, the first
+ * time, and have ioClose report it.
+ */
+static void ioFailed(file_io_t* io, const char* what) {
+
+    if (!io->failed)
+    {
+        printf("Unable to %s: %s\n", what, strerror(errno));
+        io->failed = 1;
+    }
+
+}
+
+/*
+ * Keep stdout for an output named IO_STDIO: from here on, what the tool
+ * prints goes to stderr, so that it does not end up in the data.
+ */
+void ioKeepStdout(void) {
+
+    fflush(stdout);
+
+    int fd = dup(STDOUT_FILENO);
+
+    if (fd == -1)
+    {
+        return;
+    }
+
+    if (dup2(STDERR_FILENO, STDOUT_FILENO) == -1)
+    {
+        close(fd);
+        return;
+    }
+
+    stdoutFd = fd;
+
+}
+
+/*
+ * io               - the job's files
+ * inputFilename    - opened for reading, IO_STDIO for stdin
+ * outputFilename   - created (or truncated) for writing; opened read / write
+ *                    so that it can be mapped. IO_STDIO for stdout
+ * buf              - used when a file is not mapped
+ *
+ * Returns 0 on success, -1 if either file cannot be opened.
+ */
+int ioOpen(file_io_t* io, const char* inputFilename, const char* outputFilename, uint8_t* buf) {
+
+    memset(io, 0, sizeof(file_io_t));
+    io->buf = buf;
+
+    struct stat inStat;
+
+    if (strcmp(inputFilename, IO_STDIO) == 0) {
+        io->read = fdopen(dup(STDIN_FILENO), "rb"); // closed with the job, stdin stays open
+        io->inStream = 1;
+    }
+    else {
+        io->read = fopen(inputFilename, "rb");
+    }
+
+    if (io->read == NULL)
+    {
+        printf("File %s cannot be opened\n", inputFilename);
+        return -1;
+    }
+
+    if (strcmp(outputFilename, IO_STDIO) == 0) {
+        io->write = fdopen(dup(stdoutFd), "wb");
+        io->outStream = 1;
+    }
+    else {
+        io->write = fopen(outputFilename, "w+b");
+    }
+
+    if (io->write == NULL)
+    {
+        printf("File %s cannot be opened\n", outputFilename);
+        return -1;
+    }
+
+    // only regular files and devices have a size to seek to; pipes are read until they end
+    if (fstat(fileno(io->read), &inStat) == -1 || !(S_ISREG(inStat.st_mode) || S_ISBLK(inStat.st_mode)))
+    {
+        io->inStream = 1;
+    }
+
+    if (io->inStream)
+    {
+        printf("File size: unknown, %s is read to the end\n", inputFilename);
+        return 0;
+    }
+
+    fseek(io->read, 0, SEEK_END);
+    io->inSize = ftell(io->read);
+    printf("File size: %lu\n", io->inSize);
+    fseek(io->read, 0, SEEK_SET);
+
+    return 0;
+
+}
+
+/*
+ * Size the output to outSize bytes, then map both files (unless they are
+ * to go through io_uring). The blocks are allocated up front (fallocate)
+ * where the file system can, so running out of space shows up here
+ * rather than part way through, and the file is laid out in one piece;
+ * a file system without fallocate just has the file extended, and the
+ * output is not mapped there, so that a full disk is a write error
+ * rather than a SIGBUS. Either file that cannot be mapped (a pipe, a
+ * device) stays with fread / fwrite, and so does stdout, which may be a
+ * file that is being appended to.
+ *
+ * Returns 0 on success, -1 if the output cannot be given outSize bytes.
+ */
+int ioMap(file_io_t* io, unsigned long outSize) {
+
+    int fd = fileno(io->write);
+    int allocated = 0;                  // the output's blocks are there, it can be mapped
+    struct stat outStat;
+
+    // only a regular file is sized, anything else is written as it goes
+    if (!io->outStream && outSize > 0 && fstat(fd, &outStat) == 0 && S_ISREG(outStat.st_mode))
+    {
+
+        if (fallocate(fd, 0, 0, outSize) == 0)
+        {
+            allocated = 1;
+        }
+        // only a file system without fallocate falls back to extending the file; any other
+        // failure (ENOSPC, EFBIG, ...) would turn into a SIGBUS on the mapping
+        else if ((errno != EOPNOTSUPP && errno != ENOSYS) || ftruncate(fd, outSize) == -1)
+        {
+            printf("Unable to allocate %lu bytes for the output file: %s\n", outSize, strerror(errno));
+            return -1;
+        }
+
+        io->outSize = outSize; // trimmed by ioClose if less is written
+
+    }
+
+    if (io->useRing)
+    {
+        return 0;
+    }
+
+    if (io->inSize > 0)
+    {
+
+        void* map = mmap(NULL, io->inSize, PROT_READ, MAP_PRIVATE, fileno(io->read), 0);
+
+        if (map != MAP_FAILED)
+        {
+            madvise(map, io->inSize, MADV_SEQUENTIAL); // read ahead, drop pages once passed
+            io->inMap = map;
+        }
+
+    }
+
+    if (allocated)
+    {
+
+        void* map = mmap(NULL, io->outSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        if (map != MAP_FAILED)
+        {
+            madvise(map, io->outSize, MADV_SEQUENTIAL);
+            io->outMap = map;
+        }
+
+    }
+
+    return 0;
+
+}
+
+/*
+ * Move to byte offset of the input.
+ *
+ * Returns 0 on success, -1 if the input cannot seek there (a pipe that
+ * is not already at offset).
+ */
+int ioSeek(file_io_t* io, unsigned long offset) {
+
+    if (!io->inMap && offset != io->inPos && fseek(io->read, (long) offset, SEEK_SET) == -1)
+    {
+        return -1;
+    }
+
+    io->inPos = offset;
+
+    return 0;
+
+}
+
+/*
+ * Hand whatever is not mapped to a reader and a writer thread, so that
+ * reading the next chunk and writing the last overlap en/de-crypting this
+ * one. The reader reads inLength bytes from the current position in
+ * chunkSize pieces; from here on, every ioRead() must ask for chunkSize
+ * bytes, or for all that is left. A streamed input is read to its end
+ * instead. Pipes are enlarged to hold a chunk (see pipeResize). If the
+ * threads cannot be started, the files are read and written on the
+ * calling thread as before.
+ */
+void ioStart(file_io_t* io, unsigned long inLength, size_t chunkSize) {
+
+    struct stat inStat;
+    struct stat outStat;
+
+    if (io->inMap && io->outMap)
+    {
+        return;
+    }
+
+    if (io->inStream)
+    {
+        inLength = ULONG_MAX;
+    }
+
+    // the ring reads and writes at offsets, so only for regular files
+    if (io->useRing && !io->inStream && !io->outStream && fstat(fileno(io->read), &inStat) == 0 && S_ISREG(inStat.st_mode) &&
+        fstat(fileno(io->write), &outStat) == 0 && S_ISREG(outStat.st_mode))
+    {
+
+        fflush(io->write);
+
+        if (ringStart(&io->ring, fileno(io->read), io->inPos, (inLength < io->inSize - io->inPos) ? inLength : io->inSize - io->inPos,
+                      fileno(io->write), io->outPos, chunkSize, chunkSize + BLOCK_SIZE_BYTES, io->direct) == 0)
+        {
+            io->ringed = 1;
+            return;
+        }
+
+        printf("io_uring is not available, reading and writing on threads instead\n");
+
+    }
+
+    if (!io->inMap) {
+        pipeResize(fileno(io->read), chunkSize);
+    }
+
+    if (!io->outMap) {
+        pipeResize(fileno(io->write), chunkSize);
+    }
+
+    if (pipelineStart(&io->pipeline, io->inMap ? NULL : io->read, inLength,
+                      io->outMap ? NULL : io->write, chunkSize, chunkSize + BLOCK_SIZE_BYTES, io->direct) == 0)
+    {
+        io->piped = 1;
+    }
+
+}
+
+/*
+ * Point data at the next length bytes of input (fewer at the end).
+ * Mapped, that is the input's own pages; otherwise they are read into
+ * buf, or come from the reader thread.
+ *
+ * Returns the number of bytes, 0 at the end of the input.
+ */
+size_t ioRead(file_io_t* io, const uint8_t** data, size_t length) {
+
+    size_t bytesRead = 0;
+
+    if (io->inMap)
+    {
+        bytesRead = (io->inSize - io->inPos < length) ? io->inSize - io->inPos : length;
+        *data = io->inMap + io->inPos;
+    }
+    else if (io->ringed)
+    {
+        io->current = ringNext(&io->ring); // en/de-crypted in place, then written from there
+        bytesRead = io->current->length;
+        *data = io->current->data;
+    }
+    else if (io->piped)
+    {
+        io->current = pipelineNext(&io->pipeline); // en/de-crypted in place, then goes to the writer
+        io->inEnded = (io->current->length == 0);
+        bytesRead = io->current->length;
+        *data = io->current->data;
+    }
+    else
+    {
+        bytesRead = fread(io->buf, sizeof(uint8_t), length, io->read);
+        *data = io->buf;
+
+        if (bytesRead < length && ferror(io->read)) {
+            ioFailed(io, "read the input file");
+        }
+    }
+
+    io->inPos += bytesRead;
+
+    return bytesRead;
+
+}
+
+/*
+ * Copy the last length bytes of the input to data (a tag), without
+ * moving the read position.
+ *
+ * Returns 0 on success, -1 if the input is shorter or cannot be read.
+ */
+int ioReadTail(file_io_t* io, uint8_t* data, size_t length) {
+
+    if (io->inSize < length)
+    {
+        return -1;
+    }
+
+    if (io->inMap)
+    {
+        memcpy(data, io->inMap + io->inSize - length, length);
+        return 0;
+    }
+
+    if (fseek(io->read, (long) (io->inSize - length), SEEK_SET) == -1 ||
+        fread(data, sizeof(uint8_t), length, io->read) != length ||
+        fseek(io->read, (long) io->inPos, SEEK_SET) == -1)
+    {
+        return -1;
+    }
+
+    return 0;
+
+}
+
+/*
+ * Where the next output bytes go: the output's own pages when mapped,
+ * otherwise the buffer just read (so it is en/de-crypted in place) or an
+ * empty one for the writer. With the reader running, output that does
+ * not follow a read (a final block, a tag) waits for the end of the
+ * input: until then the reader is the one taking empty buffers.
+ */
+uint8_t* ioOutput(file_io_t* io) {
+
+    if (io->outMap)
+    {
+        return io->outMap + io->outPos;
+    }
+
+    if (io->ringed)
+    {
+
+        if (!io->current)
+        {
+            io->current = ringTake(&io->ring);
+        }
+
+        return io->current->data;
+
+    }
+
+    if (io->piped)
+    {
+
+        if (!io->current && io->pipeline.read && !io->inEnded)
+        {
+            io->current = pipelineNext(&io->pipeline); // the empty buffer that ends the input
+            io->inEnded = 1;
+        }
+        else if (!io->current)
+        {
+            io->current = pipelineTake(&io->pipeline);
+        }
+
+        return io->current->data;
+
+    }
+
+    return io->buf;
+
+}
+
+/*
+ * The next length bytes at ioOutput are done
+ */
+void ioCommit(file_io_t* io, size_t length) {
+
+    if (io->ringed)
+    {
+        ioOutput(io);
+        io->current->length = length;
+        ringWrite(&io->ring, io->current);
+        io->current = NULL;
+    }
+    else if (io->piped && !io->outMap)
+    {
+        ioOutput(io); // a buffer, even for nothing (a final with no partial block)
+        io->current->length = length;
+        pipelineWrite(&io->pipeline, io->current);
+        io->current = NULL;
+    }
+    else if (io->piped && io->current)
+    {
+        pipelineRelease(&io->pipeline, io->current); // read, but written to the map
+        io->current = NULL;
+    }
+    else if (!io->outMap && fwrite(io->buf, sizeof(uint8_t), length, io->write) != length)
+    {
+        ioFailed(io, "write the output file");
+    }
+
+    io->outPos += length;
+
+}
+
+/*
+ * Append bytes from elsewhere (a tag)
+ */
+void ioWriteBytes(file_io_t* io, const uint8_t* data, size_t length) {
+
+    if (io->ringed || (io->piped && !io->outMap))
+    {
+        memcpy(ioOutput(io), data, length);
+        ioCommit(io, length);
+        return;
+    }
+
+    if (io->outMap) {
+        memcpy(io->outMap + io->outPos, data, length);
+    }
+    else if (fwrite(data, sizeof(uint8_t), length, io->write) != length) {
+        ioFailed(io, "write the output file");
+    }
+
+    io->outPos += length;
+
+}
+
+/*
+ * Unmap and close whatever is open. The output is trimmed to what was
+ * written, in case that is less than it was sized for.
+ *
+ * Returns 0, or -1 if the input could not all be read or the output
+ * could not all be written (printed when it happened); the output is
+ * then not to be kept.
+ */
+int ioClose(file_io_t* io) {
+
+    int result = io->failed ? -1 : 0;
+
+    if (io->ringed && ringFinish(&io->ring) == -1)
+    {
+        result = -1;
+    }
+
+    if (io->piped && pipelineFinish(&io->pipeline) == -1)
+    {
+        result = -1;
+    }
+
+    if (io->inMap) {
+        munmap((void*) io->inMap, io->inSize);
+    }
+
+    if (io->outMap) {
+        munmap(io->outMap, io->outSize);
+    }
+
+    if (io->outPos < io->outSize && ftruncate(fileno(io->write), io->outPos) == -1)
+    {
+        printf("Unable to resize the output file!\n");
+        result = -1;
+    }
+
+    if (io->read) {
+        fclose(io->read);
+    }
+
+    // what is still in the stdio buffer is written now, and can fail too
+    if (io->write && fclose(io->write) == EOF && result == 0)
+    {
+        printf("Unable to write the output file: %s\n", strerror(errno));
+        result = -1;
+    }
+
+    uint8_t* buf = io->buf;
+
+    memset(io, 0, sizeof(file_io_t));
+    io->buf = buf;
+
+    return result;
+
+}
@@ -1,2 +1,1268 @@
+#include "../inc/aes.h"
+#include "../inc/aesni.h"
+#include "../inc/cbc.h"
+#include "../inc/gcm.h"
+#include "../inc/vaes.h"
+#include <string.h>
 
-// perform the Galois Counter Mode (SIV) 
+// perform the Galois Counter Mode (NIST SP 800-38D): CTR encryption with a
+// GHASH of the ciphertext for the authentication tag, and its nonce misuse
+// resistant variant AES-GCM-SIV (RFC 8452)
+
+#ifdef ENGINE_X86
+#include <immintrin.h>
+
+#define GCM_PCLMUL_TARGET __attribute__((target("pclmul,ssse3")))
+#define GCM_STITCHED_TARGET __attribute__((target("aes,pclmul,ssse3")))
+#endif
+
+
+
+/*
+ * Arguments of a parallel AES-GCM-SIV CTR pass, each part takes its slice
+ */
+typedef struct siv_ctr_task {
+
+    const aes_ctx_t* ctx;
+    const uint8_t* counter;             // the counter block of the first block
+    const uint8_t* in;
+    uint8_t* out;
+    size_t numBlocks;
+
+} siv_ctr_task_t;
+
+
+
+static const uint8_t zeroBlock[BLOCK_SIZE_BYTES] = {0};
+
+// reduction of the 4 bits shifted out of the table multiply, (x^128 + x^7 + x^2 + x + 1) times each
+static const uint64_t last4[16] = {
+    0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+
+
+static uint64_t load64(const uint8_t* p) {
+
+    uint64_t v = 0;
+
+    for (int i = 0; i < 8; i++)
+    {
+        v = (v << 8) | p[i];
+    }
+
+    return v;
+
+}
+
+static void store64(uint8_t* p, uint64_t v) {
+
+    for (int i = 7; i >= 0; i--)
+    {
+        p[i] = (uint8_t) v;
+        v >>= 8;
+    }
+
+}
+
+// AES-GCM-SIV numbers are little endian
+
+static uint32_t loadLe32(const uint8_t* p) {
+
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+
+}
+
+static void storeLe32(uint8_t* p, uint32_t v) {
+
+    for (int i = 0; i < 4; i++)
+    {
+        p[i] = (uint8_t) v;
+        v >>= 8;
+    }
+
+}
+
+static void storeLe64(uint8_t* p, uint64_t v) {
+
+    for (int i = 0; i < 8; i++)
+    {
+        p[i] = (uint8_t) v;
+        v >>= 8;
+    }
+
+}
+
+/*
+ * Add one to the last 32 bits of a counter block (inc32)
+ */
+static void incrementCounter(uint8_t* counter) {
+
+    for (int i = BLOCK_SIZE_BYTES - 1; i >= BLOCK_SIZE_BYTES - 4; i--)
+    {
+        if (++counter[i] != 0)
+        {
+            break;
+        }
+    }
+
+}
+
+
+
+// ********************************************************************************
+// GHASH WITH TABLES
+// ********************************************************************************
+
+/*
+ * Precompute H times every 4 bit value (Shoup's method), for CPUs without
+ * a carry-less multiply. The lookups depend on the data, like the T-tables.
+ */
+static void ghashTableInit(gcm_ctx_t* gcm, const uint8_t* h) {
+
+    uint64_t vh = load64(h);
+    uint64_t vl = load64(h + 8);
+
+    gcm->tableHigh[0] = 0;
+    gcm->tableLow[0] = 0;
+    gcm->tableHigh[8] = vh;
+    gcm->tableLow[8] = vl;
+
+    for (int i = 4; i > 0; i >>= 1) // H times x, x^2, x^3 in the bit reflected order
+    {
+
+        uint64_t t = (vl & 1) * 0xe1000000U;
+
+        vl = (vh << 63) | (vl >> 1);
+        vh = (vh >> 1) ^ (t << 32);
+
+        gcm->tableHigh[i] = vh;
+        gcm->tableLow[i] = vl;
+
+    }
+
+    for (int i = 2; i <= 8; i *= 2) // the rest are sums of those
+    {
+        for (int j = 1; j < i; j++)
+        {
+            gcm->tableHigh[i + j] = gcm->tableHigh[i] ^ gcm->tableHigh[j];
+            gcm->tableLow[i + j] = gcm->tableLow[i] ^ gcm->tableLow[j];
+        }
+    }
+
+}
+
+/*
+ * x = x * H, 4 bits at a time
+ */
+static void ghashMultiplyTable(const gcm_ctx_t* gcm, uint8_t* x) {
+
+    uint8_t lo = x[15] & 0xf;
+    uint64_t zh = gcm->tableHigh[lo];
+    uint64_t zl = gcm->tableLow[lo];
+
+    for (int i = 15; i >= 0; i--)
+    {
+
+        uint8_t hi = x[i] >> 4;
+        uint8_t rem;
+
+        lo = x[i] & 0xf;
+
+        if (i != 15)
+        {
+            rem = zl & 0xf;
+            zl = (zh << 60) | (zl >> 4);
+            zh = (zh >> 4) ^ (last4[rem] << 48) ^ gcm->tableHigh[lo];
+            zl ^= gcm->tableLow[lo];
+        }
+
+        rem = zl & 0xf;
+        zl = (zh << 60) | (zl >> 4);
+        zh = (zh >> 4) ^ (last4[rem] << 48) ^ gcm->tableHigh[hi];
+        zl ^= gcm->tableLow[hi];
+
+    }
+
+    store64(x, zh);
+    store64(x + 8, zl);
+
+}
+
+static void ghashBlocksTable(gcm_ctx_t* gcm, const uint8_t* data, size_t numBlocks) {
+
+    for (size_t n = 0; n < numBlocks; n++)
+    {
+
+        for (int i = 0; i < BLOCK_SIZE_BYTES; i++)
+        {
+            gcm->hash[i] ^= data[(BLOCK_SIZE_BYTES * n) + i];
+        }
+
+        ghashMultiplyTable(gcm, gcm->hash);
+
+    }
+
+}
+
+
+
+// ********************************************************************************
+// GHASH WITH PCLMULQDQ
+// ********************************************************************************
+
+#ifdef ENGINE_X86
+
+static int pclmulSupported(void) {
+
+    __builtin_cpu_init();
+
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+
+}
+
+/*
+ * Reverse the bytes of a block: GHASH treats a block as one 128 bit
+ * number with the first byte most significant.
+ */
+GCM_PCLMUL_TARGET
+KERNEL_INLINE __m128i byteReverse(__m128i x) {
+
+    return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+
+}
+
+/*
+ * Add the 256 bit carry-less product a * b into lo / mid / hi, left
+ * unreduced so several products can share one reduction.
+ */
+GCM_PCLMUL_TARGET
+KERNEL_INLINE void ghashMultiplyAdd(__m128i a, __m128i b, __m128i* lo, __m128i* mid, __m128i* hi) {
+
+    *lo = _mm_xor_si128(*lo, _mm_clmulepi64_si128(a, b, 0x00));
+    *hi = _mm_xor_si128(*hi, _mm_clmulepi64_si128(a, b, 0x11));
+    *mid = _mm_xor_si128(*mid, _mm_clmulepi64_si128(a, b, 0x10));
+    *mid = _mm_xor_si128(*mid, _mm_clmulepi64_si128(a, b, 0x01));
+
+}
+
+/*
+ * Reduce a 256 bit product modulo x^128 + x^7 + x^2 + x + 1 (Gueron and
+ * Kounavis, "Intel Carry-Less Multiplication Instruction and its Usage
+ * for Computing the GCM Mode"). The operands are bit reflected, so the
+ * product is first shifted left by one.
+ */
+GCM_PCLMUL_TARGET
+KERNEL_INLINE __m128i ghashReduce(__m128i lo, __m128i mid, __m128i hi) {
+
+    lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+    __m128i carryLo = _mm_srli_epi32(lo, 31);
+    __m128i carryHi = _mm_srli_epi32(hi, 31);
+    __m128i carryOut = _mm_srli_si128(carryLo, 12);
+
+    lo = _mm_or_si128(_mm_slli_epi32(lo, 1), _mm_slli_si128(carryLo, 4));
+    hi = _mm_or_si128(_mm_slli_epi32(hi, 1), _mm_slli_si128(carryHi, 4));
+    hi = _mm_or_si128(hi, carryOut);
+
+    __m128i a = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)), _mm_slli_epi32(lo, 25));
+    __m128i b = _mm_srli_si128(a, 4);
+
+    lo = _mm_xor_si128(lo, _mm_slli_si128(a, 12));
+
+    __m128i c = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)), _mm_srli_epi32(lo, 7));
+
+    lo = _mm_xor_si128(lo, _mm_xor_si128(c, b));
+
+    return _mm_xor_si128(hi, lo);
+
+}
+
+/*
+ * Reduce a 256 bit product for POLYVAL (RFC 8452): the operands are in
+ * their natural order, and dot(a, b) = a * b * x^-128 modulo
+ * x^128 + x^127 + x^126 + x^121 + 1 takes two folds of the low half.
+ */
+GCM_PCLMUL_TARGET
+KERNEL_INLINE __m128i polyvalReduce(__m128i lo, __m128i mid, __m128i hi) {
+
+    const __m128i poly = _mm_set_epi64x((long long) 0xc200000000000000ULL, 0);
+
+    lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+    lo = _mm_xor_si128(_mm_shuffle_epi32(lo, 0x4e), _mm_clmulepi64_si128(lo, poly, 0x10));
+    lo = _mm_xor_si128(_mm_shuffle_epi32(lo, 0x4e), _mm_clmulepi64_si128(lo, poly, 0x10));
+
+    return _mm_xor_si128(hi, lo);
+
+}
+
+/*
+ * GHASH and POLYVAL share everything but the byte order of a block and
+ * the reduction; polyval is a constant, so each caller gets its own copy.
+ */
+GCM_PCLMUL_TARGET
+KERNEL_INLINE __m128i hashLoad(const uint8_t* p, int polyval) {
+
+    __m128i x = _mm_loadu_si128((const __m128i*) p);
+
+    return polyval ? x : byteReverse(x);
+
+}
+
+GCM_PCLMUL_TARGET
+KERNEL_INLINE __m128i hashMultiply(__m128i a, __m128i b, int polyval) {
+
+    __m128i lo = _mm_setzero_si128();
+    __m128i mid = _mm_setzero_si128();
+    __m128i hi = _mm_setzero_si128();
+
+    ghashMultiplyAdd(a, b, &lo, &mid, &hi);
+
+    return polyval ? polyvalReduce(lo, mid, hi) : ghashReduce(lo, mid, hi);
+
+}
+
+/*
+ * Keep H^1..H^GCM_AGGREGATE for aggregated reduction
+ */
+GCM_PCLMUL_TARGET
+KERNEL_INLINE void hashPclmulInit(gcm_ctx_t* gcm, const uint8_t* h, int polyval) {
+
+    __m128i* powers = (__m128i*) gcm->hPowers;
+
+    powers[0] = hashLoad(h, polyval);
+
+    for (int i = 1; i < GCM_AGGREGATE; i++)
+    {
+        powers[i] = hashMultiply(powers[i - 1], powers[0], polyval);
+    }
+
+}
+
+/*
+ * Hash GCM_AGGREGATE blocks per reduction: with Y the hash so far,
+ * Y' = (Y + X1) H^8 + X2 H^7 + ... + X8 H, the products summed unreduced.
+ */
+GCM_PCLMUL_TARGET
+KERNEL_INLINE void hashBlocksPclmul(gcm_ctx_t* gcm, const uint8_t* data, size_t numBlocks, int polyval) {
+
+    const __m128i* powers = (const __m128i*) gcm->hPowers;
+    __m128i y = hashLoad(gcm->hash, polyval);
+    size_t n = 0;
+
+    for (; n + GCM_AGGREGATE <= numBlocks; n += GCM_AGGREGATE)
+    {
+
+        __m128i lo = _mm_setzero_si128();
+        __m128i mid = _mm_setzero_si128();
+        __m128i hi = _mm_setzero_si128();
+
+        #pragma GCC unroll 8
+        for (int j = 0; j < GCM_AGGREGATE; j++)
+        {
+
+            __m128i x = hashLoad(data + (BLOCK_SIZE_BYTES * (n + j)), polyval);
+
+            if (j == 0)
+            {
+                x = _mm_xor_si128(x, y);
+            }
+
+            ghashMultiplyAdd(x, powers[GCM_AGGREGATE - 1 - j], &lo, &mid, &hi);
+
+        }
+
+        y = polyval ? polyvalReduce(lo, mid, hi) : ghashReduce(lo, mid, hi);
+
+    }
+
+    for (; n < numBlocks; n++)
+    {
+        __m128i x = hashLoad(data + (BLOCK_SIZE_BYTES * n), polyval);
+        y = hashMultiply(_mm_xor_si128(x, y), powers[0], polyval);
+    }
+
+    _mm_storeu_si128((__m128i*) gcm->hash, polyval ? y : byteReverse(y));
+
+}
+
+GCM_PCLMUL_TARGET
+static void ghashPclmulInit(gcm_ctx_t* gcm, const uint8_t* h) {
+
+    hashPclmulInit(gcm, h, 0);
+
+}
+
+GCM_PCLMUL_TARGET
+static void ghashBlocksPclmul(gcm_ctx_t* gcm, const uint8_t* data, size_t numBlocks) {
+
+    hashBlocksPclmul(gcm, data, numBlocks, 0);
+
+}
+
+GCM_PCLMUL_TARGET
+static void polyvalPclmulInit(gcm_ctx_t* gcm, const uint8_t* h) {
+
+    hashPclmulInit(gcm, h, 1);
+
+}
+
+GCM_PCLMUL_TARGET
+static void polyvalBlocksPclmul(gcm_ctx_t* gcm, const uint8_t* data, size_t numBlocks) {
+
+    hashBlocksPclmul(gcm, data, numBlocks, 1);
+
+}
+
+#endif // ENGINE_X86
+
+/*
+ * hash = GHASH(hash, data), whole blocks
+ */
+static void ghashBlocks(gcm_ctx_t* gcm, const uint8_t* data, size_t numBlocks) {
+
+#ifdef ENGINE_X86
+    if (gcm->usePclmul)
+    {
+        ghashBlocksPclmul(gcm, data, numBlocks);
+        return;
+    }
+#endif
+
+    ghashBlocksTable(gcm, data, numBlocks);
+
+}
+
+
+
+// ********************************************************************************
+// COUNTER MODE
+// ********************************************************************************
+
+#ifdef ENGINE_X86
+
+/**
+ * AES-NI CTR and PCLMULQDQ GHASH in one pass, GCM_AGGREGATE blocks per
+ * iteration. The multiplies for eight ciphertext blocks are spread over
+ * the AES rounds of eight counter blocks, so both units stay busy and
+ * the data is only read once. Encrypting hashes the previous iteration's
+ * output (the ciphertext), decrypting hashes the input as it comes in.
+ *
+ * Returns the number of blocks done, a multiple of GCM_AGGREGATE.
+ */
+GCM_STITCHED_TARGET
+KERNEL_INLINE size_t gcmStitchedKernel(gcm_ctx_t* gcm, const uint8_t* in, uint8_t* out, size_t numBlocks, int numRounds) {
+
+    const __m128i* roundKeys = (const __m128i*) gcm->roundKeys;
+    const __m128i* powers = (const __m128i*) gcm->hPowers;
+    const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+    __m128i k[AES_256_NUM_ROUNDS + 1];
+    __m128i h[GCM_AGGREGATE];
+    __m128i y = byteReverse(_mm_loadu_si128((const __m128i*) gcm->hash));
+    __m128i counter = byteReverse(_mm_loadu_si128((const __m128i*) gcm->counter)); // inc32 is a 32 bit add on the low lane
+    int decrypt = gcm->decrypt;
+    size_t n = 0;
+
+    #pragma GCC unroll 15
+    for (int i = 0; i <= numRounds; i++)
+    {
+        k[i] = roundKeys[i];
+    }
+
+    #pragma GCC unroll 8
+    for (int j = 0; j < GCM_AGGREGATE; j++)
+    {
+        h[j] = powers[j];
+    }
+
+    for (; n + GCM_AGGREGATE <= numBlocks; n += GCM_AGGREGATE)
+    {
+
+        __m128i s[GCM_AGGREGATE];
+        __m128i x[GCM_AGGREGATE];
+        __m128i lo = _mm_setzero_si128();
+        __m128i mid = _mm_setzero_si128();
+        __m128i hi = _mm_setzero_si128();
+        int hashNow = decrypt || n > 0; // the first encrypted blocks are hashed next time round
+        const uint8_t* cipher = decrypt ? in + (BLOCK_SIZE_BYTES * n) : out + (BLOCK_SIZE_BYTES * (n - GCM_AGGREGATE));
+
+        #pragma GCC unroll 8
+        for (int j = 0; j < GCM_AGGREGATE; j++)
+        {
+            s[j] = _mm_xor_si128(byteReverse(counter), k[0]);
+            counter = _mm_add_epi32(counter, one);
+        }
+
+        if (hashNow)
+        {
+
+            #pragma GCC unroll 8
+            for (int j = 0; j < GCM_AGGREGATE; j++)
+            {
+                x[j] = byteReverse(_mm_loadu_si128((const __m128i*) (cipher + (BLOCK_SIZE_BYTES * j))));
+            }
+
+            x[0] = _mm_xor_si128(x[0], y);
+
+        }
+
+        #pragma GCC unroll 14
+        for (int i = 1; i < numRounds; i++)
+        {
+
+            #pragma GCC unroll 8
+            for (int j = 0; j < GCM_AGGREGATE; j++)
+            {
+                s[j] = _mm_aesenc_si128(s[j], k[i]);
+            }
+
+            if (hashNow && i <= GCM_AGGREGATE) // one multiply per round, numRounds > GCM_AGGREGATE
+            {
+                ghashMultiplyAdd(x[i - 1], h[GCM_AGGREGATE - i], &lo, &mid, &hi);
+            }
+
+        }
+
+        if (hashNow)
+        {
+            y = ghashReduce(lo, mid, hi);
+        }
+
+        #pragma GCC unroll 8
+        for (int j = 0; j < GCM_AGGREGATE; j++)
+        {
+
+            __m128i block = _mm_loadu_si128((const __m128i*) (in + (BLOCK_SIZE_BYTES * (n + j))));
+
+            s[j] = _mm_aesenclast_si128(s[j], k[numRounds]);
+            _mm_storeu_si128((__m128i*) (out + (BLOCK_SIZE_BYTES * (n + j))), _mm_xor_si128(block, s[j]));
+
+        }
+
+    }
+
+    _mm_storeu_si128((__m128i*) gcm->hash, byteReverse(y));
+    _mm_storeu_si128((__m128i*) gcm->counter, byteReverse(counter));
+
+    if (!decrypt && n > 0) // the last blocks encrypted
+    {
+        ghashBlocksPclmul(gcm, out + (BLOCK_SIZE_BYTES * (n - GCM_AGGREGATE)), GCM_AGGREGATE);
+    }
+
+    aesWipe(k, sizeof(k));
+
+    return n;
+
+}
+
+GCM_STITCHED_TARGET
+static size_t gcmStitched(gcm_ctx_t* gcm, const uint8_t* in, uint8_t* out, size_t numBlocks) {
+
+    switch (gcm->aes->numRounds) // constant round counts, so the round loop unrolls
+    {
+        case AES_128_NUM_ROUNDS: return gcmStitchedKernel(gcm, in, out, numBlocks, AES_128_NUM_ROUNDS);
+        case AES_192_NUM_ROUNDS: return gcmStitchedKernel(gcm, in, out, numBlocks, AES_192_NUM_ROUNDS);
+        case AES_256_NUM_ROUNDS: return gcmStitchedKernel(gcm, in, out, numBlocks, AES_256_NUM_ROUNDS);
+    }
+
+    return 0;
+
+}
+
+#endif // ENGINE_X86
+
+/*
+ * CTR and GHASH for any engine: GCM_BATCH_BLOCKS of keystream per engine
+ * call, XORed in and hashed while the batch is still in cache.
+ */
+static void gcmBlocks(gcm_ctx_t* gcm, const uint8_t* in, uint8_t* out, size_t numBlocks) {
+
+    uint8_t keystream[GCM_BATCH_BLOCKS * BLOCK_SIZE_BYTES];
+
+    for (size_t n = 0; n < numBlocks; n += GCM_BATCH_BLOCKS)
+    {
+
+        int batch = (numBlocks - n < GCM_BATCH_BLOCKS) ? (int) (numBlocks - n) : GCM_BATCH_BLOCKS;
+        const uint8_t* batchIn = in + (BLOCK_SIZE_BYTES * n);
+        uint8_t* batchOut = out + (BLOCK_SIZE_BYTES * n);
+
+        for (int i = 0; i < batch; i++)
+        {
+            memcpy(keystream + (BLOCK_SIZE_BYTES * i), gcm->counter, BLOCK_SIZE_BYTES);
+            incrementCounter(gcm->counter);
+        }
+
+        aesEncryptBlocks(gcm->aes, keystream, keystream, batch);
+
+        if (gcm->decrypt) // hash the ciphertext before it is overwritten
+        {
+            ghashBlocks(gcm, batchIn, batch);
+        }
+
+        aesXorBlocks(batchOut, batchIn, keystream, batch);
+
+        if (!gcm->decrypt)
+        {
+            ghashBlocks(gcm, batchOut, batch);
+        }
+
+    }
+
+    aesWipe(keystream, sizeof(keystream));
+
+}
+
+
+
+// ********************************************************************************
+// INTERFACE
+// ********************************************************************************
+
+/*
+ * gcm          - the state to set up
+ * aes          - an initialized context, only read (several messages can share it)
+ * iv           - the iv, GCM_IV_LENGTH bytes recommended
+ * ivLength     - bytes in the iv, at least 1
+ * decrypt      - 0 to encrypt, 1 to decrypt
+ *
+ * Returns 0 on success, -1 if the iv is empty.
+ */
+int gcmInit(gcm_ctx_t* gcm, const aes_ctx_t* aes, const uint8_t* iv, size_t ivLength, int decrypt) {
+
+    uint8_t h[BLOCK_SIZE_BYTES] = {0};
+
+    if (ivLength == 0)
+    {
+        return -1;
+    }
+
+    memset(gcm, 0, sizeof(gcm_ctx_t));
+
+    gcm->aes = aes;
+    gcm->decrypt = decrypt;
+
+    aesEncrypt(aes, h); // the hash key H = E(K, 0)
+
+#ifdef ENGINE_X86
+
+    if (pclmulSupported())
+    {
+
+        gcm->usePclmul = 1;
+        ghashPclmulInit(gcm, h);
+
+        // the engines with AES instructions get the combined kernel
+        if (aes->engine == &aesniEngine || aes->engine == &aesVaes256Engine || aes->engine == &aesVaes512Engine)
+        {
+
+            aesni_keys_t keys;
+
+            aesniExpandRoundKeys(aes->keySchedule, aes->keyLengthInWords, aes->numRounds, &keys);
+            memcpy(gcm->roundKeys, keys.enc, BLOCK_SIZE_BYTES * (aes->numRounds + 1));
+            aesWipe(&keys, sizeof(keys));
+
+            gcm->useStitched = 1;
+
+        }
+
+    }
+
+#endif
+
+    if (!gcm->usePclmul)
+    {
+        ghashTableInit(gcm, h);
+    }
+
+    aesWipe(h, sizeof(h));
+
+    if (ivLength == GCM_IV_LENGTH) // J0 = IV || 0^31 || 1
+    {
+        memcpy(gcm->j0, iv, GCM_IV_LENGTH);
+        gcm->j0[BLOCK_SIZE_BYTES - 1] = 1;
+    }
+    else // J0 = GHASH(IV, zero padded, || 0^64 || bit length of IV)
+    {
+
+        uint8_t last[BLOCK_SIZE_BYTES] = {0};
+        size_t fullBlocks = ivLength / BLOCK_SIZE_BYTES;
+
+        ghashBlocks(gcm, iv, fullBlocks);
+
+        if (ivLength % BLOCK_SIZE_BYTES != 0)
+        {
+            memcpy(last, iv + (BLOCK_SIZE_BYTES * fullBlocks), ivLength % BLOCK_SIZE_BYTES);
+            ghashBlocks(gcm, last, 1);
+            memset(last, 0, sizeof(last));
+        }
+
+        store64(last + 8, (uint64_t) ivLength * 8);
+        ghashBlocks(gcm, last, 1);
+
+        memcpy(gcm->j0, gcm->hash, BLOCK_SIZE_BYTES);
+        memset(gcm->hash, 0, BLOCK_SIZE_BYTES);
+
+    }
+
+    memcpy(gcm->counter, gcm->j0, BLOCK_SIZE_BYTES);
+    incrementCounter(gcm->counter);
+
+    return 0;
+
+}
+
+/*
+ * Authenticate additional data that is not encrypted. Call at most once,
+ * before gcmUpdate.
+ */
+void gcmAad(gcm_ctx_t* gcm, const uint8_t* aad, size_t length) {
+
+    size_t fullBlocks = length / BLOCK_SIZE_BYTES;
+
+    ghashBlocks(gcm, aad, fullBlocks);
+
+    if (length % BLOCK_SIZE_BYTES != 0) // zero padded
+    {
+        uint8_t last[BLOCK_SIZE_BYTES] = {0};
+        memcpy(last, aad + (BLOCK_SIZE_BYTES * fullBlocks), length % BLOCK_SIZE_BYTES);
+        ghashBlocks(gcm, last, 1);
+    }
+
+    gcm->aadLength += length;
+
+}
+
+/*
+ * gcm          - the state
+ * in           - the next length bytes of plaintext (or ciphertext when decrypting)
+ * out          - length bytes of output; may be in, but must not otherwise overlap it
+ * length       - any number of bytes; GCM does not pad
+ *
+ * Returns 0, or -1 if the message would grow past GCM_MAX_LENGTH, where
+ * the 32 bit counter would wrap around to the one that masks the tag
+ * (nothing is en/de-crypted then).
+ */
+int gcmUpdate(gcm_ctx_t* gcm, const uint8_t* in, uint8_t* out, size_t length) {
+
+    if ((uint64_t) length > GCM_MAX_LENGTH - gcm->textLength)
+    {
+        return -1;
+    }
+
+    gcm->textLength += length;
+
+    // finish the block the last update stopped in
+    while (gcm->blockUsed > 0 && length > 0)
+    {
+
+        uint8_t byteIn = *in;
+        uint8_t byteOut = byteIn ^ gcm->keystream[gcm->blockUsed];
+
+        gcm->hash[gcm->blockUsed] ^= gcm->decrypt ? byteIn : byteOut; // hash the ciphertext byte
+        *out = byteOut;
+
+        in++;
+        out++;
+        length--;
+
+        if (++gcm->blockUsed == BLOCK_SIZE_BYTES)
+        {
+            ghashBlocks(gcm, zeroBlock, 1); // the block was XORed into the hash already, multiply by H
+            gcm->blockUsed = 0;
+        }
+
+    }
+
+    size_t numBlocks = length / BLOCK_SIZE_BYTES;
+    size_t done = 0;
+
+#ifdef ENGINE_X86
+    if (gcm->useStitched)
+    {
+        done = gcmStitched(gcm, in, out, numBlocks);
+    }
+#endif
+
+    gcmBlocks(gcm, in + (BLOCK_SIZE_BYTES * done), out + (BLOCK_SIZE_BYTES * done), numBlocks - done);
+
+    in += BLOCK_SIZE_BYTES * numBlocks;
+    out += BLOCK_SIZE_BYTES * numBlocks;
+    length -= BLOCK_SIZE_BYTES * numBlocks;
+
+    if (length > 0) // start a block, finished by the next update or final
+    {
+
+        memcpy(gcm->keystream, gcm->counter, BLOCK_SIZE_BYTES);
+        incrementCounter(gcm->counter);
+        aesEncrypt(gcm->aes, gcm->keystream);
+
+        for (size_t i = 0; i < length; i++)
+        {
+
+            uint8_t byteIn = in[i];
+            uint8_t byteOut = byteIn ^ gcm->keystream[i];
+
+            gcm->hash[i] ^= gcm->decrypt ? byteIn : byteOut;
+            out[i] = byteOut;
+
+        }
+
+        gcm->blockUsed = (int) length;
+
+    }
+
+    return 0;
+
+}
+
+/*
+ * Finish the message and write its GCM_TAG_LENGTH byte tag. The state
+ * is wiped afterwards.
+ */
+void gcmFinal(gcm_ctx_t* gcm, uint8_t* tag) {
+
+    uint8_t lengths[BLOCK_SIZE_BYTES];
+
+    if (gcm->blockUsed > 0) // a partial last block, zero padded
+    {
+        ghashBlocks(gcm, zeroBlock, 1);
+        gcm->blockUsed = 0;
+    }
+
+    store64(lengths, gcm->aadLength * 8);
+    store64(lengths + 8, gcm->textLength * 8);
+    ghashBlocks(gcm, lengths, 1);
+
+    memcpy(tag, gcm->j0, BLOCK_SIZE_BYTES);
+    aesEncrypt(gcm->aes, tag);
+
+    for (int i = 0; i < GCM_TAG_LENGTH; i++)
+    {
+        tag[i] ^= gcm->hash[i];
+    }
+
+    aesWipe(gcm, sizeof(gcm_ctx_t));
+
+}
+
+/*
+ * Finish the message and compare its tag with the expected one, in
+ * constant time.
+ *
+ * Returns 0 if the tags match, -1 if the message is not authentic.
+ */
+int gcmVerify(gcm_ctx_t* gcm, const uint8_t* tag) {
+
+    uint8_t computed[GCM_TAG_LENGTH];
+    uint8_t diff = 0;
+
+    gcmFinal(gcm, computed);
+
+    for (int i = 0; i < GCM_TAG_LENGTH; i++)
+    {
+        diff |= computed[i] ^ tag[i];
+    }
+
+    aesWipe(computed, sizeof(computed));
+
+    return (diff == 0) ? 0 : -1;
+
+}
+
+
+
+
+// ********************************************************************************
+// AES-GCM-SIV
+// ********************************************************************************
+
+/*
+ * Set up POLYVAL with key h. PCLMULQDQ works on POLYVAL's own byte order;
+ * the tables use POLYVAL(H, X) = ByteReverse(GHASH(mulX_GHASH(ByteReverse(H)),
+ * ByteReverse(X))) (RFC 8452, appendix A) and keep the hash byte reversed.
+ */
+static void polyvalInit(gcm_ctx_t* polyval, const uint8_t* h) {
+
+    uint8_t hGhash[BLOCK_SIZE_BYTES];
+
+    memset(polyval, 0, sizeof(gcm_ctx_t));
+
+#ifdef ENGINE_X86
+    if (pclmulSupported())
+    {
+        polyval->usePclmul = 1;
+        polyvalPclmulInit(polyval, h);
+        return;
+    }
+#endif
+
+    for (int i = 0; i < BLOCK_SIZE_BYTES; i++)
+    {
+        hGhash[i] = h[BLOCK_SIZE_BYTES - 1 - i];
+    }
+
+    uint8_t carry = hGhash[BLOCK_SIZE_BYTES - 1] & 1; // mulX_GHASH: shift right, reduce what fell off
+
+    for (int i = BLOCK_SIZE_BYTES - 1; i > 0; i--)
+    {
+        hGhash[i] = (uint8_t) ((hGhash[i] >> 1) | (hGhash[i - 1] << 7));
+    }
+
+    hGhash[0] = (uint8_t) ((hGhash[0] >> 1) ^ (carry ? 0xe1 : 0));
+
+    ghashTableInit(polyval, hGhash);
+    aesWipe(hGhash, sizeof(hGhash));
+
+}
+
+static void polyvalBlocks(gcm_ctx_t* polyval, const uint8_t* data, size_t numBlocks) {
+
+#ifdef ENGINE_X86
+    if (polyval->usePclmul)
+    {
+        polyvalBlocksPclmul(polyval, data, numBlocks);
+        return;
+    }
+#endif
+
+    uint8_t block[BLOCK_SIZE_BYTES];
+
+    for (size_t n = 0; n < numBlocks; n++)
+    {
+
+        for (int i = 0; i < BLOCK_SIZE_BYTES; i++)
+        {
+            block[i] = data[(BLOCK_SIZE_BYTES * n) + BLOCK_SIZE_BYTES - 1 - i];
+        }
+
+        ghashBlocksTable(polyval, block, 1);
+
+    }
+
+}
+
+/*
+ * Hash length bytes, the last block zero padded
+ */
+static void polyvalPadded(gcm_ctx_t* polyval, const uint8_t* data, size_t length) {
+
+    size_t fullBlocks = length / BLOCK_SIZE_BYTES;
+
+    polyvalBlocks(polyval, data, fullBlocks);
+
+    if (length % BLOCK_SIZE_BYTES != 0)
+    {
+        uint8_t last[BLOCK_SIZE_BYTES] = {0};
+        memcpy(last, data + (BLOCK_SIZE_BYTES * fullBlocks), length % BLOCK_SIZE_BYTES);
+        polyvalBlocks(polyval, last, 1);
+    }
+
+}
+
+/*
+ * CTR with a little endian 32 bit counter in the first word, which wraps
+ * without touching the rest of the block. Counters are built
+ * GCM_BATCH_BLOCKS at a time and encrypted by the engine in one call.
+ */
+static void sivCtrTask(void* arg, int part, int numParts) {
+
+    siv_ctr_task_t* task = arg;
+    size_t first = poolSliceStart(task->numBlocks, part, numParts);
+    size_t last = poolSliceStart(task->numBlocks, part + 1, numParts);
+    uint8_t counters[GCM_BATCH_BLOCKS * BLOCK_SIZE_BYTES];
+    uint8_t keystream[GCM_BATCH_BLOCKS * BLOCK_SIZE_BYTES];
+    uint32_t count = loadLe32(task->counter) + (uint32_t) first; // mod 2^32
+
+    for (int i = 0; i < GCM_BATCH_BLOCKS; i++)
+    {
+        memcpy(counters + (BLOCK_SIZE_BYTES * i), task->counter, BLOCK_SIZE_BYTES);
+    }
+
+    while (first < last)
+    {
+
+        int batch = (last - first > GCM_BATCH_BLOCKS) ? GCM_BATCH_BLOCKS : (int) (last - first);
+
+        for (int i = 0; i < batch; i++)
+        {
+            storeLe32(counters + (BLOCK_SIZE_BYTES * i), count++);
+        }
+
+        aesEncryptBlocks(task->ctx, counters, keystream, batch);
+        aesXorBlocks(task->out + (BLOCK_SIZE_BYTES * first), task->in + (BLOCK_SIZE_BYTES * first), keystream, batch);
+
+        first += batch;
+
+    }
+
+    aesWipe(keystream, sizeof(keystream));
+
+}
+
+/*
+ * siv          - the state to set up
+ * aes          - the key-generating key, 128 or 256 bits, only read
+ * nonce        - GCM_SIV_NONCE_LENGTH bytes
+ *
+ * Derives this message's authentication and encryption keys. Encrypting
+ * takes two passes over the plaintext: gcmSivAad and gcmSivHash, then
+ * gcmSivTag, gcmSivSetTag and gcmSivCrypt. Decrypting takes one:
+ * gcmSivSetTag with the received tag, gcmSivCrypt, gcmSivHash on the
+ * plaintext, then gcmSivVerify.
+ *
+ * Returns 0 on success, -1 if the key is 192 bits.
+ */
+int gcmSivInit(gcm_siv_ctx_t* siv, const aes_ctx_t* aes, const uint8_t* nonce) {
+
+    uint8_t block[BLOCK_SIZE_BYTES];
+    uint8_t keys[BLOCK_SIZE_BYTES + (AES_256_KEY_LENGTH / 8)]; // authentication key, then encryption key
+    int numHalves = 2 + (aes->keyLengthInWords / 2); // 8 bytes taken from each derivation block
+
+    if (aes->keyLengthInWords != AES_128_KEY_LENGTH_WORDS && aes->keyLengthInWords != AES_256_KEY_LENGTH_WORDS)
+    {
+        return -1;
+    }
+
+    memset(siv, 0, sizeof(gcm_siv_ctx_t));
+    memcpy(siv->nonce, nonce, GCM_SIV_NONCE_LENGTH);
+
+    for (int i = 0; i < numHalves; i++) // AES(K, LE32(i) || nonce), first half
+    {
+
+        storeLe32(block, (uint32_t) i);
+        memcpy(block + 4, nonce, GCM_SIV_NONCE_LENGTH);
+        aesEncrypt(aes, block);
+
+        memcpy(keys + (8 * i), block, 8);
+
+    }
+
+    polyvalInit(&siv->polyval, keys);
+
+    int result = aesInit(&siv->encryption, keys + BLOCK_SIZE_BYTES, aes->keyLengthInWords * 32, aes->engine->name);
+
+    aesWipe(block, sizeof(block));
+    aesWipe(keys, sizeof(keys));
+
+    return result;
+
+}
+
+/*
+ * Authenticate additional data that is not encrypted. Call at most once,
+ * before gcmSivHash.
+ */
+void gcmSivAad(gcm_siv_ctx_t* siv, const uint8_t* aad, size_t length) {
+
+    polyvalPadded(&siv->polyval, aad, length);
+    siv->aadLength += length;
+
+}
+
+/*
+ * Authenticate the next length bytes of plaintext. length must be a
+ * multiple of the block size in every call but the last.
+ */
+void gcmSivHash(gcm_siv_ctx_t* siv, const uint8_t* plaintext, size_t length) {
+
+    polyvalPadded(&siv->polyval, plaintext, length);
+    siv->textLength += length;
+
+}
+
+/*
+ * Finish POLYVAL and write the GCM_TAG_LENGTH byte tag, which is also
+ * the synthetic iv. Call once, after all the plaintext has been hashed.
+ */
+void gcmSivTag(gcm_siv_ctx_t* siv, uint8_t* tag) {
+
+    uint8_t lengths[BLOCK_SIZE_BYTES];
+
+    storeLe64(lengths, siv->aadLength * 8);
+    storeLe64(lengths + 8, siv->textLength * 8);
+    polyvalBlocks(&siv->polyval, lengths, 1);
+
+    if (siv->polyval.usePclmul)
+    {
+        memcpy(tag, siv->polyval.hash, BLOCK_SIZE_BYTES);
+    }
+    else
+    {
+        for (int i = 0; i < BLOCK_SIZE_BYTES; i++) // the tables keep it byte reversed
+        {
+            tag[i] = siv->polyval.hash[BLOCK_SIZE_BYTES - 1 - i];
+        }
+    }
+
+    for (int i = 0; i < GCM_SIV_NONCE_LENGTH; i++)
+    {
+        tag[i] ^= siv->nonce[i];
+    }
+
+    tag[BLOCK_SIZE_BYTES - 1] &= 0x7f;
+
+    aesEncrypt(&siv->encryption, tag);
+
+}
+
+/*
+ * Start the CTR pass from a tag: the one gcmSivTag made when encrypting,
+ * the received one when decrypting.
+ */
+void gcmSivSetTag(gcm_siv_ctx_t* siv, const uint8_t* tag) {
+
+    memcpy(siv->counter, tag, BLOCK_SIZE_BYTES);
+    siv->counter[BLOCK_SIZE_BYTES - 1] |= 0x80;
+
+}
+
+/*
+ * siv          - the state, after gcmSivSetTag
+ * in           - the next length bytes of plaintext (or ciphertext)
+ * out          - length bytes of output; may be in, but must not otherwise overlap it
+ * length       - a multiple of the block size in every call but the last
+ * pool         - threads to split the blocks across, or NULL for the calling thread
+ */
+void gcmSivCrypt(gcm_siv_ctx_t* siv, const uint8_t* in, uint8_t* out, size_t length, thread_pool_t* pool) {
+
+    size_t numBlocks = length / BLOCK_SIZE_BYTES;
+    siv_ctr_task_t task = {&siv->encryption, siv->counter, in, out, numBlocks};
+
+    if (pool && pool->numThreads > 1 && numBlocks >= (size_t) POOL_MIN_BLOCKS * pool->numThreads) {
+        poolRun(pool, sivCtrTask, &task);
+    }
+    else {
+        sivCtrTask(&task, 0, 1);
+    }
+
+    storeLe32(siv->counter, loadLe32(siv->counter) + (uint32_t) numBlocks);
+
+    if (length % BLOCK_SIZE_BYTES != 0) // the last, partial block
+    {
+
+        uint8_t keystream[BLOCK_SIZE_BYTES];
+
+        memcpy(keystream, siv->counter, BLOCK_SIZE_BYTES);
+        aesEncrypt(&siv->encryption, keystream);
+
+        for (size_t i = 0; i < length % BLOCK_SIZE_BYTES; i++)
+        {
+            out[(BLOCK_SIZE_BYTES * numBlocks) + i] = in[(BLOCK_SIZE_BYTES * numBlocks) + i] ^ keystream[i];
+        }
+
+        storeLe32(siv->counter, loadLe32(siv->counter) + 1);
+        aesWipe(keystream, sizeof(keystream));
+
+    }
+
+}
+
+/*
+ * Finish the message and compare its tag with the expected one, in
+ * constant time. The state is wiped afterwards.
+ *
+ * Returns 0 if the tags match, -1 if the message is not authentic.
+ */
+int gcmSivVerify(gcm_siv_ctx_t* siv, const uint8_t* tag) {
+
+    uint8_t computed[GCM_TAG_LENGTH];
+    uint8_t diff = 0;
+
+    gcmSivTag(siv, computed);
+
+    for (int i = 0; i < GCM_TAG_LENGTH; i++)
+    {
+        diff |= computed[i] ^ tag[i];
+    }
+
+    aesWipe(computed, sizeof(computed));
+    gcmSivClear(siv);
+
+    return (diff == 0) ? 0 : -1;
+
+}
+
+void gcmSivClear(gcm_siv_ctx_t* siv) {
+
+    aesClear(&siv->encryption);
+    aesWipe(siv, sizeof(gcm_siv_ctx_t));
+
+}
+
+static int gcmSivCheckLengths(size_t aadLength, size_t length) {
+
+    if ((uint64_t) aadLength > GCM_SIV_MAX_LENGTH || (uint64_t) length > GCM_SIV_MAX_LENGTH)
+    {
+        return -1;
+    }
+
+    return 0;
+
+}
+
+/*
+ * aes          - the key-generating key, 128 or 256 bits
+ * nonce        - GCM_SIV_NONCE_LENGTH bytes
+ * aad          - additional data to authenticate, aadLength bytes (may be NULL if 0)
+ * in / out     - length bytes; out may be in, but must not otherwise overlap it
+ * tag          - GCM_TAG_LENGTH bytes, written when encrypting, checked when decrypting
+ * pool         - threads for the CTR pass, or NULL
+ *
+ * A whole message at once: the plaintext is read twice, so it should
+ * be in memory (or mapped) rather than streamed.
+ *
+ * Returns 0 on success, -1 if the arguments are invalid or (decrypting)
+ * the message is not authentic, in which case out is zeroed.
+ */
+int gcmSivEncrypt(const aes_ctx_t* aes, const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+                  const uint8_t* in, uint8_t* out, size_t length, uint8_t* tag, thread_pool_t* pool) {
+
+    gcm_siv_ctx_t siv;
+
+    if (gcmSivCheckLengths(aadLength, length) == -1 || gcmSivInit(&siv, aes, nonce) == -1)
+    {
+        return -1;
+    }
+
+    gcmSivAad(&siv, aad, aadLength);
+    gcmSivHash(&siv, in, length);
+    gcmSivTag(&siv, tag);
+
+    gcmSivSetTag(&siv, tag);
+    gcmSivCrypt(&siv, in, out, length, pool);
+
+    gcmSivClear(&siv);
+
+    return 0;
+
+}
+
+int gcmSivDecrypt(const aes_ctx_t* aes, const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+                  const uint8_t* in, uint8_t* out, size_t length, const uint8_t* tag, thread_pool_t* pool) {
+
+    gcm_siv_ctx_t siv;
+
+    if (gcmSivCheckLengths(aadLength, length) == -1 || gcmSivInit(&siv, aes, nonce) == -1)
+    {
+        return -1;
+    }
+
+    gcmSivAad(&siv, aad, aadLength);
+
+    gcmSivSetTag(&siv, tag);
+    gcmSivCrypt(&siv, in, out, length, pool);
+    gcmSivHash(&siv, out, length);
+
+    if (gcmSivVerify(&siv, tag) == -1)
+    {
+        aesWipe(out, length);
+        return -1;
+    }
+
+    return 0;
+
+}
@@ -0,0 +1,513 @@
+#define _GNU_SOURCE // strndup
+
+#include "../inc/inplace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// en/de-crypting a file over itself for the command line tool, with a
+// journal so that a run cut short can be finished
+//
+// The file is rewritten a segment at a time. Before a segment is
+// touched, the journal gets a digest of each of its sectors (and, to
+// decrypt CBC, the block the chain needs after it) and is synced; after
+// it is written back, the file is synced. After a crash, a sector of the
+// journaled segment whose digest still matches has not been rewritten
+// and one whose digest does not has, so the segment can be finished
+// without a copy of it: every byte is written once, to where it was.
+
+
+
+#define DIGEST_PRIME 0x9E3779B97F4A7C15ULL
+
+
+
+/*
+ * A 64 bit digest, four lanes at a time to keep up with the cipher. Not
+ * cryptographic: it only has to tell a sector from its en/de-cryption.
+ */
+static uint64_t digest(const uint8_t* data, size_t length) {
+
+    uint64_t lanes[4] = {length, DIGEST_PRIME, ~(uint64_t) length, ~DIGEST_PRIME};
+    uint64_t result = length;
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32)
+    {
+
+        for (int lane = 0; lane < 4; lane++)
+        {
+
+            uint64_t word;
+            memcpy(&word, data + i + (8 * lane), 8);
+
+            lanes[lane] = (lanes[lane] ^ word) * DIGEST_PRIME;
+            lanes[lane] ^= lanes[lane] >> 31;
+
+        }
+
+    }
+
+    for (; i < length; i++)
+    {
+        lanes[0] = (lanes[0] ^ data[i]) * DIGEST_PRIME;
+    }
+
+    for (int lane = 0; lane < 4; lane++)
+    {
+        result = (result ^ lanes[lane]) * DIGEST_PRIME;
+        result ^= result >> 31;
+    }
+
+    return result;
+
+}
+
+/*
+ * Returns 0 once length bytes at offset have been read, -1 otherwise.
+ */
+static int readFull(int fd, uint8_t* data, size_t length, uint64_t offset) {
+
+    while (length > 0)
+    {
+
+        ssize_t bytesRead = pread(fd, data, length, (off_t) offset);
+
+        if (bytesRead <= 0)
+        {
+
+            if (bytesRead == -1 && errno == EINTR) {
+                continue;
+            }
+
+            return -1;
+
+        }
+
+        data += bytesRead;
+        length -= bytesRead;
+        offset += bytesRead;
+
+    }
+
+    return 0;
+
+}
+
+/*
+ * Returns 0 once length bytes have been written at offset, -1 otherwise.
+ */
+static int writeFull(int fd, const uint8_t* data, size_t length, uint64_t offset) {
+
+    while (length > 0)
+    {
+
+        ssize_t bytesWritten = pwrite(fd, data, length, (off_t) offset);
+
+        if (bytesWritten <= 0)
+        {
+
+            if (bytesWritten == -1 && errno == EINTR) {
+                continue;
+            }
+
+            return -1;
+
+        }
+
+        data += bytesWritten;
+        length -= bytesWritten;
+        offset += bytesWritten;
+
+    }
+
+    return 0;
+
+}
+
+
+
+/*
+ * Sync the directory a new file was created in, so that the file is
+ * found again after a crash; syncing the file itself does not see to it.
+ */
+static void syncDirectory(const char* path) {
+
+    const char* slash = strrchr(path, '/');
+    char* dir = (slash == NULL) ? strdup(".") : strndup(path, (slash == path) ? 1 : (size_t) (slash - path));
+
+    if (!dir)
+    {
+        return;
+    }
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+
+    if (fd != -1)
+    {
+        fsync(fd);
+        close(fd);
+    }
+
+    free(dir);
+
+}
+
+
+
+/*
+ * Where a slot starts in the journal file
+ */
+static uint64_t slotOffset(uint64_t sequence) {
+
+    uint64_t slotSize = (sizeof(inplace_journal_t) + INPLACE_SECTOR - 1) / INPLACE_SECTOR * INPLACE_SECTOR;
+
+    return (sequence % 2) * slotSize;
+
+}
+
+static uint64_t journalChecksum(inplace_journal_t* journal) {
+
+    uint64_t checksum = journal->checksum;
+
+    journal->checksum = 0;
+    uint64_t result = digest((const uint8_t*) journal, sizeof(inplace_journal_t));
+    journal->checksum = checksum;
+
+    return result;
+
+}
+
+/*
+ * Read a slot into inplace->journal.
+ *
+ * Returns 0 if it holds a whole entry, -1 if it is empty or torn.
+ */
+static int journalRead(inplace_t* inplace, int slot) {
+
+    inplace_journal_t* journal = inplace->journal;
+
+    if (readFull(inplace->journalFd, (uint8_t*) journal, sizeof(inplace_journal_t), slotOffset(slot)) == -1)
+    {
+        return -1;
+    }
+
+    if (memcmp(journal->magic, INPLACE_MAGIC, sizeof(journal->magic)) != 0 || journalChecksum(journal) != journal->checksum ||
+        journal->length > INPLACE_SEGMENT)
+    {
+        return -1;
+    }
+
+    return 0;
+
+}
+
+/*
+ * Leave the newest whole entry of the journal in inplace->journal.
+ *
+ * Returns 0, or -1 if there is none: the run before never got as far as
+ * touching the file, or there was no run before.
+ */
+static int journalLatest(inplace_t* inplace) {
+
+    uint64_t sequence[2];
+    int valid[2];
+
+    for (int slot = 0; slot < 2; slot++)
+    {
+        valid[slot] = (journalRead(inplace, slot) == 0);
+        sequence[slot] = inplace->journal->sequence;
+    }
+
+    if (!valid[0] && !valid[1])
+    {
+        return -1;
+    }
+
+    int latest = (valid[0] && (!valid[1] || sequence[0] > sequence[1])) ? 0 : 1;
+
+    return journalRead(inplace, latest);
+
+}
+
+/*
+ * Write inplace->journal to its slot and wait for it to reach the disk.
+ *
+ * Returns 0, or -1 if it did not.
+ */
+static int journalWrite(inplace_t* inplace) {
+
+    inplace_journal_t* journal = inplace->journal;
+
+    journal->checksum = journalChecksum(journal);
+
+    if (writeFull(inplace->journalFd, (const uint8_t*) journal, sizeof(inplace_journal_t), slotOffset(journal->sequence)) == -1 ||
+        fdatasync(inplace->journalFd) == -1)
+    {
+        return -1;
+    }
+
+    return 0;
+
+}
+
+/*
+ * Finish the segment in inplace->journal, left part rewritten by a run
+ * that was cut short: en/de-crypt the sectors that still match their
+ * digests, in order, and carry the chain through the ones that do not.
+ *
+ * chain    - set to the chaining value after the segment
+ *
+ * Returns 0, or -1 if the segment cannot be read or written.
+ */
+static int journalReplay(inplace_t* inplace, inplace_crypt_t crypt, void* arg, uint8_t* chain) {
+
+    inplace_journal_t* journal = inplace->journal;
+
+    memcpy(chain, journal->chain, BLOCK_SIZE_BYTES);
+
+    if (readFull(inplace->fd, inplace->buf, journal->length, journal->offset) == -1)
+    {
+        printf("Unable to read the file at byte %llu!\n", (unsigned long long) journal->offset);
+        return -1;
+    }
+
+    for (size_t i = 0; i < journal->length; i += INPLACE_SECTOR)
+    {
+
+        inplace_sector_t* sector = &journal->sectors[i / INPLACE_SECTOR];
+        size_t length = (journal->length - i < INPLACE_SECTOR) ? journal->length - i : INPLACE_SECTOR;
+        uint8_t* data = inplace->buf + i;
+
+        if (digest(data, length) == sector->digest) // not yet rewritten
+        {
+            crypt(arg, data, journal->offset + i, length, chain);
+        }
+        else if (journal->run.decrypt) // the ciphertext it chains on is gone
+        {
+            memcpy(chain, sector->last, BLOCK_SIZE_BYTES);
+        }
+        else if (length >= BLOCK_SIZE_BYTES)
+        {
+            memcpy(chain, data + length - BLOCK_SIZE_BYTES, BLOCK_SIZE_BYTES);
+        }
+
+    }
+
+    if (writeFull(inplace->fd, inplace->buf, journal->length, journal->offset) == -1 || fdatasync(inplace->fd) == -1)
+    {
+        printf("Unable to write the file at byte %llu!\n", (unsigned long long) journal->offset);
+        return -1;
+    }
+
+    return 0;
+
+}
+
+
+
+/*
+ * inplace      - set up for the file
+ * filename     - opened for reading and writing, neither truncated nor
+ *                created; a device will do
+ *
+ * Returns 0 on success, -1 if the file cannot be opened or the buffers
+ * not allocated.
+ */
+int inplaceOpen(inplace_t* inplace, const char* filename) {
+
+    memset(inplace, 0, sizeof(inplace_t));
+    inplace->fd = -1;
+    inplace->journalFd = -1;
+
+    inplace->journalName = malloc(strlen(filename) + sizeof(INPLACE_JOURNAL_SUFFIX));
+    if (!inplace->journalName)
+    {
+        printf("Unable to allocate journal name!\n");
+        return -1;
+    }
+
+    strcpy(inplace->journalName, filename);
+    strcat(inplace->journalName, INPLACE_JOURNAL_SUFFIX);
+
+    if ((inplace->fd = open(filename, O_RDWR)) == -1)
+    {
+        printf("File %s cannot be opened\n", filename);
+        return -1;
+    }
+
+    off_t size = lseek(inplace->fd, 0, SEEK_END); // st_size is 0 for a device
+
+    if (size == -1)
+    {
+        printf("File %s cannot be rewritten in place\n", filename);
+        return -1;
+    }
+
+    inplace->fileSize = (unsigned long) size;
+    printf("File size: %lu\n", inplace->fileSize);
+
+    inplace->buf = malloc(INPLACE_SEGMENT);
+    inplace->journal = malloc(sizeof(inplace_journal_t));
+
+    if (!inplace->buf || !inplace->journal)
+    {
+        printf("Unable to allocate I/O buffer!\n");
+        return -1;
+    }
+
+    return 0;
+
+}
+
+/*
+ * En/de-crypt the file from run->start to the end, over itself. If the
+ * journal is left from an earlier run with the same settings, that run
+ * is finished instead of starting again; with other settings, nothing
+ * is done. The journal is removed once the whole file has been written.
+ *
+ * inplace  - opened with inplaceOpen
+ * run      - the settings, fileSize being inplace->fileSize
+ * crypt    - en/de-crypts part of the file
+ * arg      - passed to crypt
+ *
+ * Returns the number of bytes en/de-crypted by this run and the one
+ * before, or -1 on error (printed). The file is then left with the
+ * journal to finish it.
+ */
+long inplaceRun(inplace_t* inplace, const inplace_run_t* run, inplace_crypt_t crypt, void* arg) {
+
+    inplace_journal_t* journal = inplace->journal;
+    uint64_t offset = run->start;
+    uint64_t sequence = 0;
+    uint8_t chain[BLOCK_SIZE_BYTES];
+
+    memcpy(chain, run->iv, BLOCK_SIZE_BYTES);
+
+    if ((inplace->journalFd = open(inplace->journalName, O_RDWR | O_CREAT, 0600)) == -1)
+    {
+        printf("Journal %s cannot be opened\n", inplace->journalName);
+        return -1;
+    }
+
+    syncDirectory(inplace->journalName);
+
+    if (journalLatest(inplace) == 0)
+    {
+
+        if (memcmp(&journal->run, run, sizeof(inplace_run_t)) != 0)
+        {
+            printf("%s is left from a run with another key, mode, iv or file! Finish that run first.\n", inplace->journalName);
+            return -1;
+        }
+
+        if (journalReplay(inplace, crypt, arg, chain) == -1)
+        {
+            return -1;
+        }
+
+        offset = journal->offset + journal->length;
+        sequence = journal->sequence + 1;
+
+        printf("Resuming an interrupted run at byte %llu\n", (unsigned long long) offset);
+
+    }
+
+    while (offset < run->fileSize)
+    {
+
+        size_t length = (run->fileSize - offset < INPLACE_SEGMENT) ? run->fileSize - offset : INPLACE_SEGMENT;
+
+        if (readFull(inplace->fd, inplace->buf, length, offset) == -1)
+        {
+            printf("Unable to read the file at byte %llu!\n", (unsigned long long) offset);
+            return -1;
+        }
+
+        memset(journal, 0, sizeof(inplace_journal_t));
+        memcpy(journal->magic, INPLACE_MAGIC, sizeof(journal->magic));
+        journal->run = *run;
+        journal->sequence = sequence;
+        journal->offset = offset;
+        journal->length = length;
+        memcpy(journal->chain, chain, BLOCK_SIZE_BYTES);
+
+        for (size_t i = 0; i < length; i += INPLACE_SECTOR)
+        {
+
+            inplace_sector_t* sector = &journal->sectors[i / INPLACE_SECTOR];
+            size_t sectorLength = (length - i < INPLACE_SECTOR) ? length - i : INPLACE_SECTOR;
+
+            sector->digest = digest(inplace->buf + i, sectorLength);
+
+            if (run->decrypt && sectorLength >= BLOCK_SIZE_BYTES)
+            {
+                memcpy(sector->last, inplace->buf + i + sectorLength - BLOCK_SIZE_BYTES, BLOCK_SIZE_BYTES);
+            }
+
+        }
+
+        if (journalWrite(inplace) == -1)
+        {
+            printf("Unable to write the journal %s!\n", inplace->journalName);
+            return -1;
+        }
+
+        crypt(arg, inplace->buf, offset, length, chain);
+
+        if (writeFull(inplace->fd, inplace->buf, length, offset) == -1 || fdatasync(inplace->fd) == -1)
+        {
+            printf("Unable to write the file at byte %llu!\n", (unsigned long long) offset);
+            return -1;
+        }
+
+        offset += length;
+        sequence++;
+
+    }
+
+    close(inplace->journalFd);
+    inplace->journalFd = -1;
+    unlink(inplace->journalName);
+
+    return (long) (run->fileSize - run->start);
+
+}
+
+/*
+ * Close the file and the journal (which stays if the run did not
+ * finish), and free the buffers. Does nothing if inplaceOpen was never
+ * called.
+ */
+void inplaceClose(inplace_t* inplace) {
+
+    if (!inplace->journalName)
+    {
+        return;
+    }
+
+    if (inplace->fd != -1) {
+        close(inplace->fd);
+    }
+
+    if (inplace->journalFd != -1) {
+        close(inplace->journalFd);
+    }
+
+    if (inplace->buf) {
+        aesWipe(inplace->buf, INPLACE_SEGMENT);
+        free(inplace->buf);
+    }
+
+    if (inplace->journal) {
+        free(inplace->journal);
+    }
+
+    free(inplace->journalName);
+
+    memset(inplace, 0, sizeof(inplace_t));
+
+}
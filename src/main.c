@@ -0,0 +1,1085 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <time.h>
+
+#include "../inc/aes.h"
+#include "../inc/cbc.h"
+#include "../inc/ctr.h"
+#include "../inc/fileio.h"
+#include "../inc/gcm.h"
+#include "../inc/inplace.h"
+#include "../inc/key.h"
+#include "../inc/parse.h"
+#include "../inc/stream.h"
+#include "../inc/threads.h"
+#include "../inc/xts.h"
+
+// the aes command line tool, built on libaes
+
+
+
+/*
+ * A file being CBC encrypted in lockstep with others (see encryptInterleaved)
+ */
+typedef struct file_lane {
+
+    file_io_t io;                       // read is NULL once the lane has run out of files
+    const file_job_t* job;              // the file in this lane
+    uint8_t* buf;
+    uint8_t iv[BLOCK_SIZE_BYTES];       // chaining value of the file in this lane
+
+} file_lane_t;
+
+
+
+// ********************************************************************************
+// GLOBALS
+// ********************************************************************************
+
+file_io_t fileIo;               // the files of the job being run
+inplace_t inplace;              // the file with -inplace, instead of fileIo
+aes_key_t* key = NULL;          // the key given with -K
+uint8_t* iv = NULL;             // the iv given with -iv
+options_t options;              // optional settings (engine, ...)
+aes_ctx_t ctx;                  // expanded key and chaining state
+xts_ctx_t xts;                  // the expanded key pair, for XTS instead of ctx
+uint8_t* ioBuf = NULL;          // file data, en/de-crypted in place
+thread_pool_t pool;             // workers for ECB and CBC decryption
+int poolStarted = 0;            // 1 once pool needs poolDestroy
+file_job_t* jobs = NULL;        // every input / output / iv group, in order
+file_lane_t lanes[CBC_MAX_STREAMS]; // files being encrypted together
+
+
+
+// ********************************************************************************
+// FUNCTIONS
+// ********************************************************************************
+
+
+
+void cleanup() {
+
+    ioClose(&fileIo);
+    inplaceClose(&inplace);
+
+    for (int i = 0; i < CBC_MAX_STREAMS; i++)
+    {
+
+        ioClose(&lanes[i].io);
+
+        if (lanes[i].buf) {
+            free(lanes[i].buf);
+        }
+
+    }
+
+    if (key) {
+
+        if (key->keyWords) {
+            free(key->keyWords);
+        }
+
+        free(key);
+
+    }
+
+    if (iv) {
+        free(iv);
+    }
+
+    if (options.moreFiles) {
+        free(options.moreFiles);
+    }
+
+    if (jobs) {
+        free(jobs);
+    }
+
+    if (ioBuf) {
+        free(ioBuf);
+    }
+
+    if (poolStarted) {
+        poolDestroy(&pool);
+    }
+
+    aesClear(&ctx);
+    xtsClear(&xts);
+
+}
+
+
+
+/*
+ * Open a job's input and output file, exiting if either cannot be opened.
+ *
+ * Returns the size of the input file.
+ */
+unsigned long openJob(const file_job_t* job, file_io_t* io, uint8_t* buf) {
+
+    if (ioOpen(io, job->inputFilename, job->outputFilename, buf) == -1)
+    {
+        cleanup();
+        exit(-1);
+    }
+
+    io->useRing = options.uring || options.direct;
+    io->direct = options.direct;
+
+    return io->inSize;
+
+}
+
+/*
+ * Remove a job's output after it failed part way. Only a regular file is
+ * removed: stdout, a pipe or a device (-out /dev/null) is left alone.
+ *
+ * Returns 0 if the output was removed, -1 if not.
+ */
+int removeOutput(const char* outputFilename) {
+
+    struct stat outStat;
+
+    if (strcmp(outputFilename, IO_STDIO) != 0 && stat(outputFilename, &outStat) == 0 && S_ISREG(outStat.st_mode))
+    {
+        return remove(outputFilename);
+    }
+
+    return -1;
+
+}
+
+/*
+ * The output of a job could not be written: remove what there is of it
+ * and exit. The reason has been printed already.
+ */
+void outputFailed(const file_job_t* job, file_io_t* io) {
+
+    ioClose(io);
+    removeOutput(job->outputFilename);
+
+    cleanup();
+    exit(-1);
+
+}
+
+/*
+ * En/de-crypt one file through the stream interface.
+ *
+ * Returns the size of the input file (as read, if it was streamed).
+ */
+unsigned long runStream(const file_job_t* job, aes_stream_t* stream, size_t readSize) {
+
+    unsigned long fileSize = openJob(job, &fileIo, ioBuf);
+    const uint8_t* data = NULL;
+    size_t bytesRead = 0;
+
+    if (ioMap(&fileIo, (fileSize + BLOCK_SIZE_BYTES - 1) / BLOCK_SIZE_BYTES * BLOCK_SIZE_BYTES) == -1) // zero-padded to whole blocks
+    {
+        outputFailed(job, &fileIo);
+    }
+
+    ioStart(&fileIo, fileSize, readSize);
+
+    while ((bytesRead = ioRead(&fileIo, &data, readSize)) != 0) // READ FROM INPUT FILE
+    {
+
+        // the state is column-major (FIPS-197 3.4), the same order as the bytes in the file,
+        // so blocks go from the input's pages to the output's as they are
+        size_t length = aesStreamUpdate(stream, data, bytesRead, ioOutput(&fileIo));
+
+        ioCommit(&fileIo, length); // WRITE TO OUTPUT FILE
+
+    }
+
+    ioCommit(&fileIo, aesStreamFinal(stream, ioOutput(&fileIo))); // zero-padded last block
+
+    if (fileIo.inStream) { // known now
+        fileSize = fileIo.inPos;
+    }
+
+    if (ioClose(&fileIo) == -1)
+    {
+        outputFailed(job, &fileIo);
+    }
+
+    return fileSize;
+
+}
+
+/*
+ * Read the tag from the end of an authenticated file.
+ *
+ * Returns the number of bytes before the tag.
+ */
+unsigned long readTag(const file_job_t* job, unsigned long fileSize, uint8_t* tag) {
+
+    if (fileIo.inStream)
+    {
+        printf("The GCM tag is at the end of %s, which cannot be read ahead (a pipe)!\n", job->inputFilename);
+        cleanup();
+        exit(-1);
+    }
+
+    if (fileSize < GCM_TAG_LENGTH)
+    {
+        printf("File %s is too short to hold a GCM tag!\n", job->inputFilename);
+        cleanup();
+        exit(-1);
+    }
+
+    if (ioReadTail(&fileIo, tag, GCM_TAG_LENGTH) == -1)
+    {
+        printf("Unable to read the GCM tag from %s!\n", job->inputFilename);
+        cleanup();
+        exit(-1);
+    }
+
+    return fileSize - GCM_TAG_LENGTH;
+
+}
+
+/*
+ * The tag did not match: remove what was written and exit. Decrypting
+ * to stdout is refused up front (parseInput), so the output is a file;
+ * one that is not a regular file (a pipe, a device) is left alone.
+ */
+void authenticationFailed(const file_job_t* job) {
+
+    ioClose(&fileIo);
+
+    if (removeOutput(job->outputFilename) == 0) {
+        printf("Authentication failed! %s was removed.\n", job->outputFilename);
+    }
+    else {
+        printf("Authentication failed! What was written to %s must not be used.\n", job->outputFilename);
+    }
+
+    cleanup();
+    exit(-1);
+
+}
+
+/*
+ * En/de-crypt one file with GCM. Encrypting appends the tag to the
+ * output; decrypting takes the tag from the end of the input and checks
+ * it once the whole file has been read. The plaintext is written as it
+ * is decrypted, so if the tag does not match the output file is removed
+ * (which is why decrypting to stdout is not allowed).
+ *
+ * Returns the size of the input file.
+ */
+unsigned long runGcm(const file_job_t* job, int mode, size_t readSize) {
+
+    gcm_ctx_t gcm;
+    uint8_t tag[GCM_TAG_LENGTH];
+    unsigned long fileSize = openJob(job, &fileIo, ioBuf);
+    unsigned long remaining = fileSize; // bytes to en/de-crypt
+    const uint8_t* data = NULL;
+    size_t bytesRead = 0;
+
+    if (mode == 1)
+    {
+        remaining = readTag(job, fileSize, tag);
+    }
+
+    if (remaining > GCM_MAX_LENGTH) // a stream is checked as it is read, by gcmUpdate
+    {
+        printf("File %s is too large for AES-GCM!\n", job->inputFilename);
+        cleanup();
+        exit(-1);
+    }
+
+    if (ioMap(&fileIo, (mode == 0) ? fileSize + GCM_TAG_LENGTH : remaining) == -1)
+    {
+        outputFailed(job, &fileIo);
+    }
+
+    ioStart(&fileIo, remaining, readSize);
+
+    gcmInit(&gcm, &ctx, job->iv, GCM_IV_LENGTH, mode);
+
+    if (fileIo.inStream)
+    {
+        remaining = ULONG_MAX; // until the input ends
+    }
+
+    while (remaining > 0 && (bytesRead = ioRead(&fileIo, &data, (remaining < readSize) ? remaining : readSize)) != 0)
+    {
+
+        if (gcmUpdate(&gcm, data, ioOutput(&fileIo), bytesRead) == -1)
+        {
+            printf("%s is too large for AES-GCM!\n", job->inputFilename);
+            outputFailed(job, &fileIo);
+        }
+
+        ioCommit(&fileIo, bytesRead);
+        remaining -= bytesRead;
+
+    }
+
+    if (mode == 0)
+    {
+
+        gcmFinal(&gcm, tag);
+        ioWriteBytes(&fileIo, tag, GCM_TAG_LENGTH);
+
+        if (fileIo.inStream) {
+            fileSize = fileIo.inPos;
+        }
+
+    }
+    else if (gcmVerify(&gcm, tag) == -1)
+    {
+        authenticationFailed(job);
+    }
+
+    if (ioClose(&fileIo) == -1)
+    {
+        outputFailed(job, &fileIo);
+    }
+
+    return fileSize;
+
+}
+
+/*
+ * En/de-crypt one file with AES-GCM-SIV. The tag is computed over the
+ * whole plaintext before any of it can be encrypted, so encrypting reads
+ * the input twice: once for POLYVAL, once for CTR. The input is mapped,
+ * so the second pass reads the page cache rather than the disk.
+ * Decrypting needs one pass, since the tag (at the end of the file, as
+ * with GCM) gives the counter up front.
+ *
+ * Returns the size of the input file.
+ */
+unsigned long runGcmSiv(const file_job_t* job, int mode, size_t readSize) {
+
+    gcm_siv_ctx_t siv;
+    uint8_t tag[GCM_TAG_LENGTH];
+    thread_pool_t* threads = poolStarted ? &pool : NULL;
+    unsigned long fileSize = openJob(job, &fileIo, ioBuf);
+    const uint8_t* data = NULL;
+    size_t bytesRead = 0;
+
+    if (gcmSivInit(&siv, &ctx, job->iv) == -1)
+    {
+        printf("AES-GCM-SIV keys must be 128 or 256 bits!\n");
+        cleanup();
+        exit(-1);
+    }
+
+    if (mode == 0)
+    {
+
+        if (fileIo.inStream)
+        {
+            printf("AES-GCM-SIV reads %s twice, so it cannot be a pipe!\n", job->inputFilename);
+            cleanup();
+            exit(-1);
+        }
+
+        if (fileSize > GCM_SIV_MAX_LENGTH)
+        {
+            printf("File %s is too large for AES-GCM-SIV!\n", job->inputFilename);
+            cleanup();
+            exit(-1);
+        }
+
+        if (ioMap(&fileIo, fileSize + GCM_TAG_LENGTH) == -1)
+        {
+            outputFailed(job, &fileIo);
+        }
+
+        while ((bytesRead = ioRead(&fileIo, &data, readSize)) != 0)
+        {
+            gcmSivHash(&siv, data, bytesRead);
+        }
+
+        gcmSivTag(&siv, tag);
+        gcmSivSetTag(&siv, tag);
+
+        if (ioSeek(&fileIo, 0) == -1)
+        {
+            printf("File %s cannot be read twice!\n", job->inputFilename);
+            cleanup();
+            exit(-1);
+        }
+
+        ioStart(&fileIo, fileSize, readSize);
+
+        while ((bytesRead = ioRead(&fileIo, &data, readSize)) != 0)
+        {
+            gcmSivCrypt(&siv, data, ioOutput(&fileIo), bytesRead, threads);
+            ioCommit(&fileIo, bytesRead);
+        }
+
+        ioWriteBytes(&fileIo, tag, GCM_TAG_LENGTH);
+
+        gcmSivClear(&siv);
+
+    }
+    else
+    {
+
+        unsigned long remaining = readTag(job, fileSize, tag);
+
+        if (ioMap(&fileIo, remaining) == -1)
+        {
+            outputFailed(job, &fileIo);
+        }
+
+        ioStart(&fileIo, remaining, readSize);
+        gcmSivSetTag(&siv, tag);
+
+        while (remaining > 0 && (bytesRead = ioRead(&fileIo, &data, (remaining < readSize) ? remaining : readSize)) != 0)
+        {
+
+            uint8_t* plaintext = ioOutput(&fileIo);
+
+            gcmSivCrypt(&siv, data, plaintext, bytesRead, threads);
+            gcmSivHash(&siv, plaintext, bytesRead); // the tag covers the plaintext
+
+            ioCommit(&fileIo, bytesRead);
+            remaining -= bytesRead;
+
+        }
+
+        if (gcmSivVerify(&siv, tag) == -1)
+        {
+            authenticationFailed(job);
+        }
+
+    }
+
+    if (ioClose(&fileIo) == -1)
+    {
+        outputFailed(job, &fileIo);
+    }
+
+    return fileSize;
+
+}
+
+/*
+ * Check that a file can be en/de-crypted from byte seek on, exiting if
+ * not: with CTR (sectorSize 0) seek must be within the file, with XTS the
+ * start of a sector, and the last sector long enough to steal from.
+ */
+void checkSeek(const file_job_t* job, unsigned long fileSize, uint64_t seek, size_t sectorSize) {
+
+    if (sectorSize == 0 && seek > fileSize)
+    {
+        printf("Cannot seek to byte %llu, %s is only %lu bytes!\n", (unsigned long long) seek, job->inputFilename, fileSize);
+        cleanup();
+        exit(-1);
+    }
+
+    if (sectorSize == 0)
+    {
+        return;
+    }
+
+    if (seek % sectorSize != 0 || seek > fileSize)
+    {
+        printf("Cannot seek to byte %llu! It must be the start of a sector of %s.\n", (unsigned long long) seek, job->inputFilename);
+        cleanup();
+        exit(-1);
+    }
+
+    if ((fileSize - seek) % sectorSize != 0 && (fileSize - seek) % sectorSize < BLOCK_SIZE_BYTES)
+    {
+        printf("The last sector of %s is under %d bytes, too short for XTS!\n", job->inputFilename, BLOCK_SIZE_BYTES);
+        cleanup();
+        exit(-1);
+    }
+
+}
+
+/*
+ * En/de-crypt one file with CTR, from byte seek of the input on. The
+ * counter of every block comes straight from its offset, so nothing
+ * before seek is read, and each read is split across the pool.
+ *
+ * Returns the number of bytes en/de-crypted.
+ */
+unsigned long runCtr(const file_job_t* job, uint64_t seek, size_t readSize) {
+
+    unsigned long fileSize = openJob(job, &fileIo, ioBuf);
+    uint64_t offset = seek; // of the next read, in the input
+    const uint8_t* data = NULL;
+    size_t bytesRead = 0;
+
+    if (!fileIo.inStream) {
+        checkSeek(job, fileSize, seek, 0);
+    }
+
+    if (ioMap(&fileIo, fileSize - seek) == -1)
+    {
+        outputFailed(job, &fileIo);
+    }
+
+    if (ioSeek(&fileIo, seek) == -1)
+    {
+        printf("Cannot seek in %s!\n", job->inputFilename);
+        cleanup();
+        exit(-1);
+    }
+
+    ioStart(&fileIo, fileSize - seek, readSize);
+
+    while ((bytesRead = ioRead(&fileIo, &data, readSize)) != 0)
+    {
+
+        poolCtrCrypt(&pool, &ctx, job->iv, offset, data, ioOutput(&fileIo), bytesRead);
+
+        ioCommit(&fileIo, bytesRead);
+        offset += bytesRead;
+
+    }
+
+    if (fileIo.inStream) {
+        fileSize = fileIo.inPos;
+    }
+
+    if (ioClose(&fileIo) == -1)
+    {
+        outputFailed(job, &fileIo);
+    }
+
+    return fileSize - seek;
+
+}
+
+/*
+ * En/de-crypt one file with XTS, one tweak per sector of the input: the
+ * first sector is number 0, or seek / sectorSize with -seek. Every read
+ * is a whole number of sectors, split across the pool. A last sector
+ * that is not whole is handled with ciphertext stealing, so the output
+ * is the same size as the input.
+ *
+ * Returns the number of bytes en/de-crypted.
+ */
+unsigned long runXts(const file_job_t* job, int mode, uint64_t seek, size_t sectorSize, size_t readSize) {
+
+    unsigned long fileSize = openJob(job, &fileIo, ioBuf);
+    uint64_t sector = seek / sectorSize;
+    const uint8_t* data = NULL;
+    size_t bytesRead = 0;
+
+    if (!fileIo.inStream) { // otherwise the last sector is only checked once it is read
+        checkSeek(job, fileSize, seek, sectorSize);
+    }
+
+    if (ioMap(&fileIo, fileSize - seek) == -1)
+    {
+        outputFailed(job, &fileIo);
+    }
+
+    if (ioSeek(&fileIo, seek) == -1)
+    {
+        printf("Cannot seek in %s!\n", job->inputFilename);
+        cleanup();
+        exit(-1);
+    }
+
+    ioStart(&fileIo, fileSize - seek, readSize);
+
+    while ((bytesRead = ioRead(&fileIo, &data, readSize)) != 0) // readSize is whole sectors
+    {
+
+        int result = (mode == 0) ? xtsEncrypt(&xts, sector, sectorSize, data, ioOutput(&fileIo), bytesRead, &pool) :
+                                   xtsDecrypt(&xts, sector, sectorSize, data, ioOutput(&fileIo), bytesRead, &pool);
+
+        if (result == -1)
+        {
+            printf("The last sector of %s is under %d bytes, too short for XTS!\n", job->inputFilename, BLOCK_SIZE_BYTES);
+            cleanup();
+            exit(-1);
+        }
+
+        ioCommit(&fileIo, bytesRead);
+        sector += bytesRead / sectorSize;
+
+    }
+
+    if (fileIo.inStream) {
+        fileSize = fileIo.inPos;
+    }
+
+    if (ioClose(&fileIo) == -1)
+    {
+        outputFailed(job, &fileIo);
+    }
+
+    return fileSize - seek;
+
+}
+
+/*
+ * En/de-crypt part of the file with -inplace (an inplace_crypt_t)
+ *
+ * arg          - the inplace_run_t of the run
+ */
+void inplaceCrypt(void* arg, uint8_t* data, uint64_t offset, size_t length, uint8_t* chain) {
+
+    const inplace_run_t* run = arg;
+
+    if (run->mode == AES_MODE_ECB)
+    {
+
+        if (run->decrypt) {
+            poolDecryptBlocks(&pool, &ctx, data, data, length / BLOCK_SIZE_BYTES);
+        }
+        else {
+            poolEncryptBlocks(&pool, &ctx, data, data, length / BLOCK_SIZE_BYTES);
+        }
+
+    }
+    else if (run->mode == AES_MODE_CBC)
+    {
+
+        aesSetIv(&ctx, chain);
+
+        if (run->decrypt) {
+            poolCbcDecryptBlocks(&pool, &ctx, data, data, length / BLOCK_SIZE_BYTES);
+        }
+        else {
+            cbcEncryptBlocks(&ctx, data, data, (int) (length / BLOCK_SIZE_BYTES)); // at most INPLACE_SEGMENT
+        }
+
+        memcpy(chain, ctx.iv, BLOCK_SIZE_BYTES);
+
+    }
+    else if (run->mode == AES_MODE_CTR)
+    {
+        poolCtrCrypt(&pool, &ctx, run->iv, offset, data, data, length);
+    }
+    else if (run->decrypt)
+    {
+        xtsDecrypt(&xts, offset / run->sectorSize, run->sectorSize, data, data, length, &pool);
+    }
+    else
+    {
+        xtsEncrypt(&xts, offset / run->sectorSize, run->sectorSize, data, data, length, &pool);
+    }
+
+}
+
+/*
+ * En/de-crypt a file over itself with -inplace, from byte seek on. Only
+ * modes that keep the length can: CTR and XTS on any file, ECB and CBC on
+ * a whole number of blocks, there being nowhere to put the padding
+ * (-seek is for CTR and XTS only). The file is
+ * rewritten with pread / pwrite a segment at a time, behind a journal
+ * (see inplace.c) that a rerun of the same command picks up after a
+ * crash.
+ *
+ * Returns the number of bytes en/de-crypted.
+ */
+unsigned long runInplace(const file_job_t* job, int encryptionMode, int mode, uint64_t seek, size_t sectorSize) {
+
+    inplace_run_t run;
+
+    if (inplaceOpen(&inplace, job->inputFilename) == -1)
+    {
+        cleanup();
+        exit(-1);
+    }
+
+    if ((encryptionMode == AES_MODE_ECB || encryptionMode == AES_MODE_CBC) && inplace.fileSize % BLOCK_SIZE_BYTES != 0)
+    {
+        printf("%s is not a whole number of blocks, so it cannot be en/de-crypted in place!\n", job->inputFilename);
+        cleanup();
+        exit(-1);
+    }
+
+    checkSeek(job, inplace.fileSize, seek, (encryptionMode == AES_MODE_XTS) ? sectorSize : 0);
+
+    memset(&run, 0, sizeof(inplace_run_t));
+    run.mode = (uint32_t) encryptionMode;
+    run.decrypt = (uint32_t) mode;
+    run.fileSize = inplace.fileSize;
+    run.start = seek;
+
+    if (encryptionMode == AES_MODE_XTS) {
+        run.sectorSize = sectorSize;
+    }
+
+    if (encryptionMode == AES_MODE_CBC || encryptionMode == AES_MODE_CTR) {
+        memcpy(run.iv, job->iv, BLOCK_SIZE_BYTES);
+    }
+
+    memcpy(run.keyCheck, "in-place journal", BLOCK_SIZE_BYTES);
+
+    if (encryptionMode == AES_MODE_XTS)
+    {
+        aesEncrypt(&xts.data, run.keyCheck);
+        aesEncrypt(&xts.tweak, run.keyCheck);
+    }
+    else
+    {
+        aesEncrypt(&ctx, run.keyCheck);
+    }
+
+    long length = inplaceRun(&inplace, &run, inplaceCrypt, &run);
+
+    if (length == -1)
+    {
+        cleanup();
+        exit(-1);
+    }
+
+    inplaceClose(&inplace);
+
+    return (unsigned long) length;
+
+}
+
+/*
+ * A file of the lockstep CBC could not be written: remove it and the
+ * files still being written in the other lanes, and exit. The files
+ * already finished are kept.
+ */
+void lanesFailed(const file_job_t* job) {
+
+    removeOutput(job->outputFilename);
+
+    for (int i = 0; i < CBC_MAX_STREAMS; i++)
+    {
+
+        if (lanes[i].io.read)
+        {
+            ioClose(&lanes[i].io);
+            removeOutput(lanes[i].job->outputFilename);
+        }
+
+    }
+
+    cleanup();
+    exit(-1);
+
+}
+
+/*
+ * CBC encrypt several files at once. A single chain cannot keep the AES
+ * unit busy, so up to CBC_MAX_STREAMS files are read a chunk at a time
+ * and their chains advanced together by cbcEncryptStreams. When a file
+ * ends, the next one takes its lane. Each output is the same as
+ * encrypting the file on its own.
+ *
+ * Returns the total size of the input files.
+ */
+unsigned long encryptInterleaved(const file_job_t* files, int numFiles) {
+
+    cbc_stream_t streams[CBC_MAX_STREAMS];
+    file_lane_t* streamLane[CBC_MAX_STREAMS];
+    unsigned long totalSize = 0;
+    int nextFile = 0;
+
+    for (int i = 0; i < CBC_MAX_STREAMS && i < numFiles; i++)
+    {
+
+        lanes[i].buf = malloc(CHUNK_SIZE);
+        if (!lanes[i].buf)
+        {
+            printf("Unable to allocate I/O buffer!\n");
+            cleanup();
+            exit(-1);
+        }
+
+        openJob(&files[nextFile], &lanes[i].io, lanes[i].buf);
+        lanes[i].job = &files[nextFile];
+        memcpy(lanes[i].iv, files[nextFile].iv, BLOCK_SIZE_BYTES);
+        nextFile++;
+
+    }
+
+    for (;;)
+    {
+
+        int numStreams = 0;
+
+        for (int i = 0; i < CBC_MAX_STREAMS; i++)
+        {
+
+            file_lane_t* lane = &lanes[i];
+            const uint8_t* data = NULL;
+            size_t bytesRead = 0;
+
+            // the lanes are not mapped: the chains are advanced in place in buf
+            while (lane->io.read && (bytesRead = ioRead(&lane->io, &data, CHUNK_SIZE)) == 0)
+            {
+
+                // this file is done, move the lane on to the next one
+                if (ioClose(&lane->io) == -1)
+                {
+                    lanesFailed(lane->job);
+                }
+
+                if (nextFile < numFiles)
+                {
+                    openJob(&files[nextFile], &lane->io, lane->buf);
+                    lane->job = &files[nextFile];
+                    memcpy(lane->iv, files[nextFile].iv, BLOCK_SIZE_BYTES);
+                    nextFile++;
+                }
+
+            }
+
+            if (!lane->io.read)
+            {
+                continue;
+            }
+
+            totalSize += bytesRead; // counted as read, a pipe has no size up front
+
+            if (bytesRead % BLOCK_SIZE_BYTES != 0) // the end of the file, zero-fill the last partial block
+            {
+                size_t padding = BLOCK_SIZE_BYTES - (bytesRead % BLOCK_SIZE_BYTES);
+                memset(lane->buf + bytesRead, 0, padding);
+                bytesRead += padding;
+            }
+
+            streams[numStreams].in = lane->buf;
+            streams[numStreams].out = lane->buf;
+            streams[numStreams].numBlocks = bytesRead / BLOCK_SIZE_BYTES;
+            memcpy(streams[numStreams].iv, lane->iv, BLOCK_SIZE_BYTES);
+            streamLane[numStreams] = lane;
+            numStreams++;
+
+        }
+
+        if (numStreams == 0)
+        {
+            break;
+        }
+
+        cbcEncryptStreams(&ctx, streams, numStreams);
+
+        for (int s = 0; s < numStreams; s++)
+        {
+            ioCommit(&streamLane[s]->io, BLOCK_SIZE_BYTES * streams[s].numBlocks);
+            memcpy(streamLane[s]->iv, streams[s].iv, BLOCK_SIZE_BYTES);
+        }
+
+    }
+
+    return totalSize;
+
+}
+
+
+
+int main(int argc, char** argv) {
+
+    uint8_t keyBytes[2 * AES_256_KEY_LENGTH / 8] = {0}; // room for an XTS key pair
+
+    char* inputFilename = NULL; // input filename pointer
+    char* outputFilename = NULL; // output filename pointer
+    int mode = 0;               // 0 for encryption, 1 for decryption
+    aes_stream_t stream;        // partial block and chaining state between reads
+    size_t readSize = CHUNK_SIZE; // bytes per read
+    int numJobs = 0;
+    unsigned long totalSize = 0;
+
+
+    int encryptionMode = parseInput(argc, argv, &mode, &key, &iv, &inputFilename, &outputFilename, &options);
+
+    if (encryptionMode == -1) // an error occurred when parsing userInput (either by fault of user or system)
+    {
+        // error message cause is displayed by parse.c
+        cleanup();
+        exit(-1);
+    }
+
+    for (int i = 0; i < key->keyCanonLength; i++) // key words are big endian
+    {
+        keyBytes[4 * i] = key->keyWords[i] >> 24;
+        keyBytes[(4 * i) + 1] = key->keyWords[i] >> 16;
+        keyBytes[(4 * i) + 2] = key->keyWords[i] >> 8;
+        keyBytes[(4 * i) + 3] = key->keyWords[i];
+    }
+
+    int initResult = (encryptionMode == AES_MODE_XTS) ?
+        xtsInit(&xts, keyBytes, key->keyCanonLength * 32, options.engineName) :
+        aesInit(&ctx, keyBytes, key->keyCanonLength * 32, options.engineName);
+
+    aesWipe(keyBytes, sizeof(keyBytes));
+
+    if (initResult == -1) // expand given key, pick the engine (parse.c has checked the key, so -engine is the problem)
+    {
+
+        if (aesEngineSupported(options.engineName) == 0) {
+            printf("Engine %s is not supported on this CPU!\n", options.engineName);
+        }
+        else {
+            printf("Unknown engine %s!\n", options.engineName);
+        }
+
+        cleanup();
+        exit(-1);
+
+    }
+
+    // the files from -in / -out first, then any further groups
+    jobs = malloc(sizeof(file_job_t) * (1 + options.numMoreFiles));
+    if (!jobs)
+    {
+        printf("Unable to allocate file list!\n");
+        cleanup();
+        exit(-1);
+    }
+
+    jobs[0].inputFilename = inputFilename;
+    jobs[0].outputFilename = outputFilename;
+
+    if (iv)
+    {
+        memcpy(jobs[0].iv, iv, BLOCK_SIZE_BYTES);
+    }
+
+    memcpy(jobs + 1, options.moreFiles, sizeof(file_job_t) * options.numMoreFiles);
+    numJobs = 1 + options.numMoreFiles;
+
+    for (int i = 0; i < numJobs; i++)
+    {
+
+        if (strcmp(jobs[i].outputFilename, IO_STDIO) == 0) // the output goes to stdout, the messages to stderr
+        {
+            ioKeepStdout();
+            break;
+        }
+
+    }
+
+
+
+    printf("Engine: %s\n", (encryptionMode == AES_MODE_XTS) ? xts.data.engine->name : ctx.engine->name);
+
+    if (encryptionMode == AES_MODE_ECB) {
+        printf("USING ECB MODE!\n");
+    }
+    else if (encryptionMode == AES_MODE_CBC) {
+        printf("USING CBC MODE!\n");
+    }
+    else if (encryptionMode == AES_MODE_GCM) {
+        printf("USING GCM MODE!\n");
+    }
+    else if (encryptionMode == AES_MODE_GCM_SIV) {
+        printf("USING GCM-SIV MODE!\n");
+    }
+    else if (encryptionMode == AES_MODE_CTR) {
+        printf("USING CTR MODE!\n");
+    }
+    else if (encryptionMode == AES_MODE_XTS) {
+        printf("USING XTS MODE!\n");
+    }
+
+    if ((encryptionMode == AES_MODE_ECB || encryptionMode == AES_MODE_CBC) && aesStreamInit(&stream, &ctx, encryptionMode, mode) == -1)
+    {
+        printf("Mode is not supported by the stream interface!\n");
+        cleanup();
+        exit(-1);
+    }
+
+    // blocks (or CTR keystream) independent of each other, split each read across the cores
+    if (encryptionMode == AES_MODE_ECB || (encryptionMode == AES_MODE_CBC && mode == 1) ||
+        encryptionMode == AES_MODE_GCM_SIV || encryptionMode == AES_MODE_CTR || encryptionMode == AES_MODE_XTS)
+    {
+
+        int numThreads = options.numThreads ? options.numThreads : poolDefaultThreads();
+
+        if (poolInit(&pool, numThreads) == -1)
+        {
+            printf("Unable to start %d worker threads!\n", numThreads);
+            cleanup();
+            exit(-1);
+        }
+
+        poolStarted = 1;
+        readSize = CHUNK_SIZE * (size_t) numThreads; // a full chunk for every thread
+
+        printf("Threads: %d\n", numThreads);
+
+    }
+
+    // room for a block carried over from the previous read (see aesStreamUpdate)
+    ioBuf = malloc(readSize + BLOCK_SIZE_BYTES);
+    if (!ioBuf)
+    {
+        printf("Unable to allocate I/O buffer!\n");
+        cleanup();
+        exit(-1);
+    }
+
+
+
+    // printf("Progress:\n");
+
+
+
+    struct timespec startTime, endTime; // wall clock, clock() would add up the CPU time of every thread
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+
+    if (options.inplace)
+    {
+        totalSize = runInplace(&jobs[0], encryptionMode, mode, options.seek, options.sectorSize ? options.sectorSize : XTS_SECTOR_SIZE);
+    }
+    else if (encryptionMode == AES_MODE_CBC && mode == 0 && numJobs > 1) // independent chains, run them together
+    {
+        totalSize = encryptInterleaved(jobs, numJobs);
+    }
+    else if (encryptionMode == AES_MODE_GCM)
+    {
+        totalSize = runGcm(&jobs[0], mode, readSize);
+    }
+    else if (encryptionMode == AES_MODE_GCM_SIV)
+    {
+        totalSize = runGcmSiv(&jobs[0], mode, readSize);
+    }
+    else if (encryptionMode == AES_MODE_CTR)
+    {
+        totalSize = runCtr(&jobs[0], options.seek, readSize);
+    }
+    else if (encryptionMode == AES_MODE_XTS)
+    {
+        totalSize = runXts(&jobs[0], mode, options.seek, options.sectorSize ? options.sectorSize : XTS_SECTOR_SIZE, readSize);
+    }
+    else
+    {
+
+        for (int i = 0; i < numJobs; i++)
+        {
+
+            aesStreamInit(&stream, &ctx, encryptionMode, mode);
+            stream.pool = poolStarted ? &pool : NULL;
+
+            if (encryptionMode == AES_MODE_CBC)
+            {
+                aesSetIv(&ctx, jobs[i].iv);
+            }
+
+            totalSize += runStream(&jobs[i], &stream, readSize);
+
+        }
+
+    }
+
+
+    clock_gettime(CLOCK_MONOTONIC, &endTime);
+
+    printf("\nTime to en/de-crypt %lu bytes : %fs\n", totalSize, (endTime.tv_sec - startTime.tv_sec) + (endTime.tv_nsec - startTime.tv_nsec) / 1e9);
+
+
+    cleanup();
+
+    // system("leaks aes"); // used to check for memory leaks
+
+    return 0;
+
+}
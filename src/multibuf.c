@@ -0,0 +1,132 @@
+#include "../inc/aes.h"
+#include "../inc/aesni.h"
+#include "../inc/cbc.h"
+#include "../inc/multibuf.h"
+
+// multi-buffer interface: many short messages, each with its own key,
+// set up and en/de-crypted together
+
+
+
+/*
+ * Fallback for CPUs without AES-NI: one job at a time, with its key
+ * expanded into a context on the stack (no allocation) by the fastest
+ * engine available.
+ */
+static void multiCryptEach(const aes_job_t* jobs, int numJobs, int keyLengthBits, int mode, int decrypt) {
+
+    aes_ctx_t ctx;
+
+    for (int j = 0; j < numJobs; j++)
+    {
+
+        aesInit(&ctx, jobs[j].key, keyLengthBits, NULL);
+
+        if (mode == AES_MODE_CBC)
+        {
+            aesSetIv(&ctx, jobs[j].iv);
+        }
+
+        aesCryptBlocks(&ctx, mode, decrypt, jobs[j].in, jobs[j].out, jobs[j].length / BLOCK_SIZE_BYTES);
+
+    }
+
+    aesClear(&ctx);
+
+}
+
+static int multiCrypt(const aes_job_t* jobs, int numJobs, int keyLengthBits, int mode, int decrypt) {
+
+    int keyLengthInWords = 0;
+    int numRounds = 0;
+
+    switch (keyLengthBits)
+    {
+        case AES_128_KEY_LENGTH:
+            keyLengthInWords = AES_128_KEY_LENGTH_WORDS;
+            numRounds = AES_128_NUM_ROUNDS;
+            break;
+        case AES_192_KEY_LENGTH:
+            keyLengthInWords = AES_192_KEY_LENGTH_WORDS;
+            numRounds = AES_192_NUM_ROUNDS;
+            break;
+        case AES_256_KEY_LENGTH:
+            keyLengthInWords = AES_256_KEY_LENGTH_WORDS;
+            numRounds = AES_256_NUM_ROUNDS;
+            break;
+        default:
+            return -1;
+    }
+
+    if (mode != AES_MODE_ECB && mode != AES_MODE_CBC)
+    {
+        return -1;
+    }
+
+    for (int j = 0; j < numJobs; j++)
+    {
+        if (jobs[j].length % BLOCK_SIZE_BYTES != 0)
+        {
+            return -1;
+        }
+    }
+
+#ifdef ENGINE_X86
+
+    if (aesniSupported())
+    {
+
+        for (int first = 0; first < numJobs; first += MULTIBUF_LANES)
+        {
+
+            int group = (numJobs - first < MULTIBUF_LANES) ? numJobs - first : MULTIBUF_LANES;
+
+            if (decrypt) {
+                aesniMultiDecrypt(jobs + first, group, keyLengthInWords, numRounds, mode);
+            }
+            else {
+                aesniMultiEncrypt(jobs + first, group, keyLengthInWords, numRounds, mode);
+            }
+
+        }
+
+        return 0;
+
+    }
+
+#endif
+
+    (void) keyLengthInWords;
+    (void) numRounds;
+
+    multiCryptEach(jobs, numJobs, keyLengthBits, mode, decrypt);
+
+    return 0;
+
+}
+
+/*
+ * jobs             - the messages, each with its own key (and iv for CBC)
+ * numJobs          - the number of messages
+ * keyLengthBits    - 128, 192 or 256, the same for every job
+ * mode             - AES_MODE_ECB or AES_MODE_CBC
+ *
+ * With AES-NI, MULTIBUF_LANES keys are expanded together and their
+ * messages en/de-crypted side by side, so the setup per message is a
+ * few instructions and short messages still keep the AES unit busy.
+ * Nothing is allocated and no round keys are left behind.
+ *
+ * Returns 0 on success, -1 if the arguments are invalid (nothing is
+ * en/de-crypted then).
+ */
+int aesMultiEncrypt(const aes_job_t* jobs, int numJobs, int keyLengthBits, int mode) {
+
+    return multiCrypt(jobs, numJobs, keyLengthBits, mode, 0);
+
+}
+
+int aesMultiDecrypt(const aes_job_t* jobs, int numJobs, int keyLengthBits, int mode) {
+
+    return multiCrypt(jobs, numJobs, keyLengthBits, mode, 1);
+
+}
@@ -1,10 +1,15 @@
 #include "../inc/aes.h"
+#include "../inc/fileio.h"
+#include "../inc/gcm.h"
 #include "../inc/key.h"
+#include "../inc/parse.h"
+#include "../inc/threads.h"
+#include "../inc/xts.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define COMP_MAX_LEN 10
+#define COMP_MAX_LEN 16
 
 
 
@@ -53,6 +58,226 @@ int characterToHex(char c) {
 
 
 
+/*
+ * hex              - the iv as 2 * ivLength hex characters, high digit of each byte first
+ * iv               - the iv
+ * ivLength         - the number of bytes expected
+ */
+int parseIv(const char* hex, uint8_t* iv, int ivLength) {
+
+    int ivInputLength = strnlen(hex, 64);
+    int ivPieceBit = 0;
+    uint8_t ivPiece = 0;
+
+    if (ivInputLength != ivLength * 2)
+    {
+        printf("Incorrect iv size! Must be %d bytes!\n", ivLength);
+        return -1;
+    }
+
+    for (int i = 0; i < ivInputLength; i++)
+    {
+
+        ivPieceBit = characterToHex(hex[i]);
+
+        if (ivPieceBit == -1)
+        {
+            printf("Illegal character! Key can only use 0123456789ABCDEF!\n");
+            return -1;
+        }
+
+        if ((i + 1) % 2 == 0)
+        {
+
+            ivPiece |= ivPieceBit;
+
+            iv[i / 2] = ivPiece;
+            ivPiece = 0;
+
+        }
+        else
+        {
+            ivPiece = ivPieceBit << 4;
+        }
+
+    }
+
+    return 0;
+
+}
+
+
+
+/*
+ * argc             - the number of command line arguments
+ * argv             - the command line input
+ * first            - index of the first optional argument
+ * options          - the optional settings, filled in from the arguments
+ */
+int parseOptions(int argc, char** argv, int first, options_t* options) {
+
+    options->engineName = NULL;
+    options->numThreads = 0;
+    options->numMoreFiles = 0;
+    options->seek = 0;
+    options->sectorSize = 0;
+    options->uring = 0;
+    options->direct = 0;
+    options->inplace = 0;
+
+    // every group is 6 arguments, so this is enough for all of them
+    options->moreFiles = malloc(sizeof(file_job_t) * ((argc - first) / 6 + 1));
+    if (!options->moreFiles)
+    {
+        printf("Unable to allocate file list!\n");
+        return -1;
+    }
+
+    for (int i = first; i < argc; i++)
+    {
+
+        if (strncmp(argv[i], "-iv", COMP_MAX_LEN) == 0 && i + 5 < argc &&
+            strncmp(argv[i + 2], "-in", COMP_MAX_LEN) == 0 && strncmp(argv[i + 4], "-out", COMP_MAX_LEN) == 0)
+        {
+
+            file_job_t* file = &options->moreFiles[options->numMoreFiles];
+
+            if (parseIv(argv[i + 1], file->iv, BUFFER_SIZE) == -1)
+            {
+                return -1;
+            }
+
+            file->inputFilename = argv[i + 3];
+            file->outputFilename = argv[i + 5];
+            options->numMoreFiles++;
+            i += 5;
+
+        }
+        else if (strncmp(argv[i], "-engine", COMP_MAX_LEN) == 0 && i + 1 < argc)
+        {
+            options->engineName = argv[++i];
+        }
+        else if (strncmp(argv[i], "-threads", COMP_MAX_LEN) == 0 && i + 1 < argc)
+        {
+
+            char* end = NULL;
+            long numThreads = strtol(argv[++i], &end, 10);
+
+            if (*argv[i] == '\0' || *end != '\0' || numThreads < 1 || numThreads > POOL_MAX_THREADS)
+            {
+                printf("Illegal thread count %s! Must be between 1 and %d!\n", argv[i], POOL_MAX_THREADS);
+                return -1;
+            }
+
+            options->numThreads = (int) numThreads;
+
+        }
+        else if (strncmp(argv[i], "-seek", COMP_MAX_LEN) == 0 && i + 1 < argc)
+        {
+
+            char* end = NULL;
+            unsigned long long seek = strtoull(argv[++i], &end, 10);
+
+            if (*argv[i] == '\0' || *argv[i] == '-' || *end != '\0')
+            {
+                printf("Illegal seek offset %s! Must be a number of bytes!\n", argv[i]);
+                return -1;
+            }
+
+            options->seek = (uint64_t) seek;
+
+        }
+        else if (strncmp(argv[i], "-sector", COMP_MAX_LEN) == 0 && i + 1 < argc)
+        {
+
+            i++;
+
+            if (strncmp(argv[i], "512", COMP_MAX_LEN) == 0) {
+                options->sectorSize = 512;
+            }
+            else if (strncmp(argv[i], "4096", COMP_MAX_LEN) == 0) {
+                options->sectorSize = 4096;
+            }
+            else
+            {
+                printf("Illegal sector size %s! Must be 512 or 4096!\n", argv[i]);
+                return -1;
+            }
+
+        }
+        else if (strncmp(argv[i], "-uring", COMP_MAX_LEN) == 0)
+        {
+            options->uring = 1;
+        }
+        else if (strncmp(argv[i], "-direct", COMP_MAX_LEN) == 0)
+        {
+            options->direct = 1;
+        }
+        else if (strncmp(argv[i], "-inplace", COMP_MAX_LEN) == 0)
+        {
+            options->inplace = 1;
+        }
+        else
+        {
+            printf("Unknown option %s!\n", argv[i]);
+            return -1;
+        }
+
+    }
+
+    return 0;
+
+}
+
+/*
+ * Check that -inplace goes with the rest: a mode that keeps the length of
+ * the file, the same file in and out, and just the one.
+ *
+ * Returns 0, or -1 if it does not (printed).
+ */
+int checkInplace(const options_t* options, int encryptionMode, const char* inputFilename, const char* outputFilename) {
+
+    if (!options->inplace)
+    {
+        return 0;
+    }
+
+    if (encryptionMode == AES_MODE_GCM || encryptionMode == AES_MODE_GCM_SIV)
+    {
+        printf("-inplace is only allowed with -aes-ecb, -aes-cbc, -aes-ctr and -aes-xts!\n");
+        return -1;
+    }
+
+    if (strcmp(inputFilename, IO_STDIO) == 0)
+    {
+        printf("-inplace rewrites a file, not stdin and stdout!\n");
+        return -1;
+    }
+
+    if (strcmp(inputFilename, outputFilename) != 0)
+    {
+        printf("-inplace rewrites %s, so -out must be %s too!\n", inputFilename, inputFilename);
+        return -1;
+    }
+
+    if (options->numMoreFiles > 0)
+    {
+        printf("-inplace takes a single -in -out file!\n");
+        return -1;
+    }
+
+    if (options->uring || options->direct)
+    {
+        printf("-inplace reads and writes the file itself, -uring and -direct are not allowed with it!\n");
+        return -1;
+    }
+
+    return 0;
+
+}
+
+
+
 // go through input
 // look for markers (-e, -K, -iv)
 // check input and output files
@@ -65,18 +290,17 @@ int characterToHex(char c) {
  * mode             - 0 for encryption, 1 for decryption
  * keySchedule      - the key schedule that will be used for encryption
  * iv               - the iv that will be used for encryption
+ * options          - optional settings given after the output file
  */
-int parseInput(int argc, char** argv, int* mode, key_t** key, uint8_t** iv, char** inputFilename, char** outputFilename) {
+int parseInput(int argc, char** argv, int* mode, aes_key_t** key, uint8_t** iv, char** inputFilename, char** outputFilename, options_t* options) {
 
-    int encryptionMode = 0;
-    int ivInputLength = 0;
+    int encryptionMode = AES_MODE_ECB;
     int keyInputLength = 0;
+    int xts = (argc > 2 && strncmp(argv[2], "-aes-xts", COMP_MAX_LEN) == 0); // takes a pair of keys
     int addToKeyWords = 7;      
     int keyIndex = 0;      
     int keyPieceBit = 0;     
     uint32_t keyPiece = 0;  
-    int ivPieceBit = 0;    
-    uint8_t ivPiece = 0;
 
     
     
@@ -106,14 +330,14 @@ int parseInput(int argc, char** argv, int* mode, key_t** key, uint8_t** iv, char
     if (strncmp(argv[3], "-K", COMP_MAX_LEN) == 0)
     {
 
-        (*key) = malloc(sizeof(key_t));
+        (*key) = malloc(sizeof(aes_key_t));
         if (!(*key))
         {
             printf("Unable to allocate key structure!\n");
             return -1;
         }
 
-        keyInputLength = strnlen(argv[4], 64); // determine key length of input
+        keyInputLength = strnlen(argv[4], 129); // determine key length of input
 
         if (keyInputLength * 4 == 128)
         {
@@ -152,14 +376,33 @@ int parseInput(int argc, char** argv, int* mode, key_t** key, uint8_t** iv, char
                 printf("Unable to allocate space for 256 bit key!\n");
                 return -1;
             }
-            (*key)->numRounds = AES_256_NUM_ROUNDS;
+            (*key)->numRounds = xts ? AES_128_NUM_ROUNDS : AES_256_NUM_ROUNDS; // XTS: two 128 bit keys
             (*key)->keyCanonLength = AES_256_KEY_LENGTH_WORDS;
+            (*key)->RconArraySize = xts ? 10 : 7;
+
+        }
+        else if (keyInputLength * 4 == 512 && xts)
+        {
+
+            (*key)->keyWords = malloc(sizeof(uint512_t));
+            if (!(*key)->keyWords)
+            {
+                printf("Unable to allocate space for 512 bit key!\n");
+                return -1;
+            }
+            (*key)->numRounds = AES_256_NUM_ROUNDS;
+            (*key)->keyCanonLength = 2 * AES_256_KEY_LENGTH_WORDS;
             (*key)->RconArraySize = 7;
 
         }
+        else if (xts)
+        {
+            printf("Invalid key length! XTS keys must be of size 256 or 512 bits!\n");
+            return -1;
+        }
         else
         {
-            printf("Invalid key length! Keys must be of size 128, 192, or 256 bits!");
+            printf("Invalid key length! Keys must be of size 128, 192, or 256 bits!\n");
             return -1;
         }
 
@@ -203,14 +446,56 @@ int parseInput(int argc, char** argv, int* mode, key_t** key, uint8_t** iv, char
 
 
 
-    if (strncmp(argv[2], "-aes-ecb", COMP_MAX_LEN) == 0)
+    if (strncmp(argv[2], "-aes-ecb", COMP_MAX_LEN) == 0 || xts)
     {
 
-        if (strncmp(argv[5], "-in", COMP_MAX_LEN) == 0 && strncmp(argv[7], "-out", COMP_MAX_LEN) == 0)
+        if (xts)
+        {
+
+            encryptionMode = AES_MODE_XTS;
+
+            // Key1 == Key2 would make the tweak the encryption of the sector number under the data key
+            if (memcmp((*key)->keyWords, (*key)->keyWords + ((*key)->keyCanonLength / 2), sizeof(uint32_t) * ((*key)->keyCanonLength / 2)) == 0)
+            {
+                printf("The two halves of an XTS key must differ!\n");
+                return -1;
+            }
+
+        }
+
+        if (argc >= 9 && strncmp(argv[5], "-in", COMP_MAX_LEN) == 0 && strncmp(argv[7], "-out", COMP_MAX_LEN) == 0)
         {
             *inputFilename = argv[6];
             *outputFilename = argv[8];
 
+            if (parseOptions(argc, argv, 9, options) == -1)
+            {
+                return -1;
+            }
+
+            if (options->numMoreFiles > 0)
+            {
+                printf("Several -iv -in -out groups are only allowed with -aes-cbc!\n");
+                return -1;
+            }
+
+            if (options->seek > 0 && !xts)
+            {
+                printf("-seek is only allowed with -aes-ctr and -aes-xts!\n");
+                return -1;
+            }
+
+            if (options->sectorSize > 0 && !xts)
+            {
+                printf("-sector is only allowed with -aes-xts!\n");
+                return -1;
+            }
+
+            if (checkInplace(options, encryptionMode, *inputFilename, *outputFilename) == -1)
+            {
+                return -1;
+            }
+
             return encryptionMode;
         }
 
@@ -220,11 +505,19 @@ int parseInput(int argc, char** argv, int* mode, key_t** key, uint8_t** iv, char
 
         if (strncmp(argv[2], "-aes-cbc", COMP_MAX_LEN) == 0)
         {
-            encryptionMode = 1;
+            encryptionMode = AES_MODE_CBC;
         }
         else if (strncmp(argv[2], "-aes-gcm", COMP_MAX_LEN) == 0)
         {
-            encryptionMode = 2;
+            encryptionMode = AES_MODE_GCM;
+        }
+        else if (strncmp(argv[2], "-aes-gcm-siv", COMP_MAX_LEN) == 0)
+        {
+            encryptionMode = AES_MODE_GCM_SIV;
+        }
+        else if (strncmp(argv[2], "-aes-ctr", COMP_MAX_LEN) == 0)
+        {
+            encryptionMode = AES_MODE_CTR;
         }
         else
         {
@@ -241,50 +534,62 @@ int parseInput(int argc, char** argv, int* mode, key_t** key, uint8_t** iv, char
             return -1;
         }
 
-        ivInputLength = strnlen(argv[6], 64);
-
-        if (ivInputLength != BUFFER_SIZE * 2)
+        if (parseIv(argv[6], *iv, (encryptionMode == AES_MODE_GCM || encryptionMode == AES_MODE_GCM_SIV) ? GCM_IV_LENGTH : BUFFER_SIZE) == -1)
         {
-            printf("Incorrect iv size! Must be 16 bytes!\n");
             return -1;
         }
 
-        for (int i = 0; i < ivInputLength; i++)
+        if (encryptionMode == AES_MODE_GCM_SIV && (*key)->keyCanonLength == AES_192_KEY_LENGTH_WORDS)
         {
+            printf("AES-GCM-SIV keys must be 128 or 256 bits!\n");
+            return -1;
+        }
+
+
 
-            ivPieceBit = characterToHex(argv[6][i]);
+        // get input filename
+        // get output filename
+        if (argc >= 11 && strncmp(argv[7], "-in", COMP_MAX_LEN) == 0 && strncmp(argv[9], "-out", COMP_MAX_LEN) == 0)
+        {
+            *inputFilename = argv[8];
+            *outputFilename = argv[10];
 
-            if (ivPieceBit == -1)
+            if (parseOptions(argc, argv, 11, options) == -1)
             {
-                printf("Illegal character! Key can only use 0123456789ABCDEF!\n");
                 return -1;
             }
 
-            if ((i + 1) % 2 == 0)
+            if (options->numMoreFiles > 0 && encryptionMode != AES_MODE_CBC)
             {
-
-                ivPiece |= ivPieceBit << 4;
-
-               
-                (*iv)[i / 2] = ivPiece;
-                ivPiece = 0;
-
+                printf("Several -iv -in -out groups are only allowed with -aes-cbc!\n");
+                return -1;
             }
-            else
+
+            if (options->seek > 0 && encryptionMode != AES_MODE_CTR)
             {
-                ivPiece = ivPieceBit;
+                printf("-seek is only allowed with -aes-ctr and -aes-xts!\n");
+                return -1;
             }
-            
-        }
 
+            if (options->sectorSize > 0)
+            {
+                printf("-sector is only allowed with -aes-xts!\n");
+                return -1;
+            }
 
+            // the plaintext is written as it is decrypted, and only authenticated at the end,
+            // when a file can still be removed but what went to stdout cannot be taken back
+            if ((encryptionMode == AES_MODE_GCM || encryptionMode == AES_MODE_GCM_SIV) && *mode == 1 &&
+                strcmp(*outputFilename, IO_STDIO) == 0)
+            {
+                printf("-aes-gcm and -aes-gcm-siv cannot decrypt to stdout, the tag is only checked once everything is written!\n");
+                return -1;
+            }
 
-        // get input filename
-        // get output filename
-        if (strncmp(argv[7], "-in", COMP_MAX_LEN) == 0 && strncmp(argv[9], "-out", COMP_MAX_LEN) == 0)
-        {
-            *inputFilename = argv[8];
-            *outputFilename = argv[10];
+            if (checkInplace(options, encryptionMode, *inputFilename, *outputFilename) == -1)
+            {
+                return -1;
+            }
 
             return encryptionMode;
         }
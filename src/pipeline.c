@@ -0,0 +1,379 @@
+#define _GNU_SOURCE // sync_file_range, F_SETPIPE_SZ
+
+#include "../inc/pipeline.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// reader / cipher / writer pipeline for the command line tool's files
+// that are not mapped
+
+
+
+static void queueInit(buffer_queue_t* queue) {
+
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->waiting, 0);
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->ready, NULL);
+
+}
+
+static void queueDestroy(buffer_queue_t* queue) {
+
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->ready);
+
+}
+
+/*
+ * Wake the consumer if it is parked. Taking the lock means it is either
+ * in pthread_cond_wait already or has yet to check the queue, and will
+ * then see the push.
+ */
+static void queueWake(buffer_queue_t* queue) {
+
+    if (atomic_load(&queue->waiting))
+    {
+        pthread_mutex_lock(&queue->lock);
+        pthread_cond_signal(&queue->ready);
+        pthread_mutex_unlock(&queue->lock);
+    }
+
+}
+
+/*
+ * Never full: there are fewer buffers (plus the writer's end marker) than slots.
+ */
+static void queuePush(buffer_queue_t* queue, io_buffer_t* buffer) {
+
+    unsigned long tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    queue->slots[tail % PIPELINE_QUEUE_SLOTS] = buffer;
+    atomic_store(&queue->tail, tail + 1); // publishes the slot; ordered before the load of waiting
+
+    queueWake(queue);
+
+}
+
+/*
+ * stop     - checked while the queue is empty, NULL to wait regardless
+ *
+ * Returns the oldest buffer (NULL for the writer's end marker), or NULL
+ * if the queue is empty and stop is set.
+ */
+static io_buffer_t* queuePop(buffer_queue_t* queue, atomic_int* stop) {
+
+    unsigned long head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+    if (atomic_load(&queue->tail) == head)
+    {
+
+        pthread_mutex_lock(&queue->lock);
+        atomic_store(&queue->waiting, 1);
+
+        while (atomic_load(&queue->tail) == head && !(stop && atomic_load(stop)))
+        {
+            pthread_cond_wait(&queue->ready, &queue->lock);
+        }
+
+        atomic_store(&queue->waiting, 0);
+        pthread_mutex_unlock(&queue->lock);
+
+        if (atomic_load(&queue->tail) == head)
+        {
+            return NULL; // stopped
+        }
+
+    }
+
+    io_buffer_t* buffer = queue->slots[head % PIPELINE_QUEUE_SLOTS];
+
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+    return buffer;
+
+}
+
+
+
+static void* pipelineReader(void* arg) {
+
+    io_pipeline_t* pipeline = arg;
+    io_buffer_t* buffer = NULL;
+
+    while (!atomic_load(&pipeline->stop) && (buffer = queuePop(&pipeline->free, &pipeline->stop)) != NULL)
+    {
+
+        size_t length = (pipeline->inLeft < pipeline->chunkSize) ? pipeline->inLeft : pipeline->chunkSize;
+
+        size_t bytesRead = fread(buffer->data, sizeof(uint8_t), length, pipeline->read);
+
+        if (bytesRead < length && ferror(pipeline->read))
+        {
+            printf("Unable to read the input file: %s\n", strerror(errno));
+            pipeline->readFailed = 1;
+            pipeline->inLeft = bytesRead; // what was read goes through, then the input ends
+        }
+
+        buffer->length = bytesRead;
+        pipeline->inLeft -= bytesRead;
+
+        if (pipeline->dropCache)
+        {
+            pipeline->readOffset += bytesRead;
+            cacheDrop(fileno(pipeline->read), pipeline->readOffset);
+        }
+
+        queuePush(&pipeline->filled, buffer); // the caller's from here on
+
+        if (bytesRead == 0) // the end, an empty buffer for the caller to keep
+        {
+            break;
+        }
+
+    }
+
+    return NULL;
+
+}
+
+static void* pipelineWriter(void* arg) {
+
+    io_pipeline_t* pipeline = arg;
+    io_buffer_t* buffer = NULL;
+
+    while ((buffer = queuePop(&pipeline->written, NULL)) != NULL)
+    {
+
+        // after a failure the rest is only drained, the output is not going to be kept
+        if (!pipeline->writeFailed && fwrite(buffer->data, sizeof(uint8_t), buffer->length, pipeline->write) != buffer->length)
+        {
+            printf("Unable to write the output file: %s\n", strerror(errno));
+            pipeline->writeFailed = 1;
+        }
+
+        if (pipeline->dropCache && !pipeline->writeFailed && fflush(pipeline->write) == 0)
+        {
+            cacheWriteBehind(fileno(pipeline->write), pipeline->writeOffset, buffer->length);
+        }
+
+        pipeline->writeOffset += buffer->length;
+
+        queuePush(&pipeline->free, buffer);
+
+    }
+
+    return NULL;
+
+}
+
+/*
+ * pipeline     - the pipeline to start
+ * read         - read by the reader thread from its current position, NULL for no reader
+ * inLength     - bytes the reader reads at most
+ * write        - written by the writer thread, NULL for no writer
+ * chunkSize    - bytes per read; every buffer from pipelineNext() holds
+ *                this many, except the last
+ * bufferSize   - bytes per buffer, at least chunkSize
+ * dropCache    - 1 to drop what has been read from the page cache and to
+ *                write back behind the writer, so a large file does not
+ *                push everything else out of memory
+ *
+ * Returns 0 on success, -1 if the buffers or threads could not be set up
+ * (nothing is left running then).
+ */
+int pipelineStart(io_pipeline_t* pipeline, FILE* read, unsigned long inLength, FILE* write, size_t chunkSize, size_t bufferSize,
+                  int dropCache) {
+
+    memset(pipeline, 0, sizeof(io_pipeline_t));
+
+    pipeline->inLeft = inLength;
+    pipeline->chunkSize = chunkSize;
+    pipeline->dropCache = dropCache;
+    pipeline->readOffset = read ? (unsigned long) ftell(read) : 0;
+    pipeline->writeOffset = write ? (unsigned long) ftell(write) : 0;
+    atomic_init(&pipeline->stop, 0);
+
+    queueInit(&pipeline->free);
+    queueInit(&pipeline->filled);
+    queueInit(&pipeline->written);
+
+    for (int i = 0; i < PIPELINE_BUFFERS; i++)
+    {
+
+        pipeline->buffers[i].data = malloc(bufferSize);
+        if (!pipeline->buffers[i].data)
+        {
+            pipelineFinish(pipeline);
+            return -1;
+        }
+
+        queuePush(&pipeline->free, &pipeline->buffers[i]);
+
+    }
+
+    pipeline->read = read;
+
+    if (read && pthread_create(&pipeline->reader, NULL, pipelineReader, pipeline) != 0)
+    {
+        pipeline->read = NULL; // not running, for pipelineFinish
+        pipelineFinish(pipeline);
+        return -1;
+    }
+
+    pipeline->write = write;
+
+    if (write && pthread_create(&pipeline->writer, NULL, pipelineWriter, pipeline) != 0)
+    {
+        pipeline->write = NULL;
+        pipelineFinish(pipeline);
+        return -1;
+    }
+
+    return 0;
+
+}
+
+/*
+ * Returns the next buffer read. At the end of the input it is empty
+ * (length 0), and the reader is done with the free queue.
+ */
+io_buffer_t* pipelineNext(io_pipeline_t* pipeline) {
+
+    return queuePop(&pipeline->filled, NULL);
+
+}
+
+/*
+ * Returns an empty buffer, for output when there is no reader (or it has
+ * finished).
+ */
+io_buffer_t* pipelineTake(io_pipeline_t* pipeline) {
+
+    return queuePop(&pipeline->free, NULL);
+
+}
+
+/*
+ * Queue length bytes of buffer for the writer
+ */
+void pipelineWrite(io_pipeline_t* pipeline, io_buffer_t* buffer) {
+
+    queuePush(&pipeline->written, buffer);
+
+}
+
+/*
+ * Hand back a buffer that is not to be written, when there is no writer.
+ */
+void pipelineRelease(io_pipeline_t* pipeline, io_buffer_t* buffer) {
+
+    queuePush(&pipeline->free, buffer);
+
+}
+
+/*
+ * Stop the reader, wait for the writer to write everything queued, and
+ * free the buffers.
+ *
+ * Returns 0, or -1 if a read or a write failed (printed when it did).
+ */
+int pipelineFinish(io_pipeline_t* pipeline) {
+
+    if (pipeline->read)
+    {
+
+        atomic_store(&pipeline->stop, 1);
+
+        pthread_mutex_lock(&pipeline->free.lock);
+        pthread_cond_signal(&pipeline->free.ready);
+        pthread_mutex_unlock(&pipeline->free.lock);
+
+        pthread_join(pipeline->reader, NULL);
+
+    }
+
+    if (pipeline->write)
+    {
+        queuePush(&pipeline->written, NULL);
+        pthread_join(pipeline->writer, NULL);
+    }
+
+    for (int i = 0; i < PIPELINE_BUFFERS; i++)
+    {
+        free(pipeline->buffers[i].data);
+    }
+
+    queueDestroy(&pipeline->free);
+    queueDestroy(&pipeline->filled);
+    queueDestroy(&pipeline->written);
+
+    int failed = pipeline->readFailed || pipeline->writeFailed;
+
+    memset(pipeline, 0, sizeof(io_pipeline_t));
+
+    return failed ? -1 : 0;
+
+}
+
+
+
+/*
+ * If fd is a pipe, have it hold size bytes (or as near as it is allowed),
+ * so that a chunk goes through in one read or write rather than 64 KiB
+ * (the default) at a time, each waking the other end. Without privilege
+ * a pipe is capped at /proc/sys/fs/pipe-max-size (1 MiB by default);
+ * halving until it fits finds that. A pipe is never made smaller.
+ */
+void pipeResize(int fd, size_t size) {
+
+    struct stat fdStat;
+
+    if (fstat(fd, &fdStat) == -1 || !S_ISFIFO(fdStat.st_mode))
+    {
+        return;
+    }
+
+    int current = fcntl(fd, F_GETPIPE_SZ);
+
+    while (current > 0 && size > (size_t) current && fcntl(fd, F_SETPIPE_SZ, (int) size) == -1)
+    {
+        size /= 2;
+    }
+
+}
+
+/*
+ * Drop a file being read from the page cache, up to end. Everything
+ * before is dropped each time, not just the last read: pages are cached
+ * in folios that can be larger than a read, and one is only dropped once
+ * the range covers all of it. Not an error on a pipe; there is nothing
+ * cached to drop.
+ */
+void cacheDrop(int fd, unsigned long end) {
+
+    posix_fadvise(fd, 0, (off_t) end, POSIX_FADV_DONTNEED);
+
+}
+
+/*
+ * Start writing back length bytes at offset of a file just written, and
+ * wait for and drop everything before offset (started by the previous
+ * call). Writeback then runs one chunk behind the writer, and the dirty
+ * pages never build up to what the kernel would flush on its own.
+ */
+void cacheWriteBehind(int fd, unsigned long offset, size_t length) {
+
+    sync_file_range(fd, (off_t) offset, (off_t) length, SYNC_FILE_RANGE_WRITE);
+
+    if (offset > 0)
+    {
+        sync_file_range(fd, 0, (off_t) offset, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(fd, 0, (off_t) offset, POSIX_FADV_DONTNEED);
+    }
+
+}
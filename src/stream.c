@@ -0,0 +1,176 @@
+#include "../inc/aes.h"
+#include "../inc/cbc.h"
+#include "../inc/stream.h"
+#include <string.h>
+
+// streaming interface: feed any number of bytes at a time, whole blocks
+// go to the engine directly from the caller's buffer
+
+
+
+/*
+ * Run whole blocks through the stream's mode. in and out may be the same
+ * buffer, but must not otherwise overlap.
+ */
+static void streamBlocks(aes_stream_t* stream, const uint8_t* in, uint8_t* out, size_t numBlocks) {
+
+    if (stream->pool && (stream->mode == AES_MODE_ECB || stream->decrypt)) // split the whole run
+    {
+
+        if (stream->mode == AES_MODE_CBC) {
+            poolCbcDecryptBlocks(stream->pool, stream->ctx, in, out, numBlocks);
+        }
+        else if (stream->decrypt) {
+            poolDecryptBlocks(stream->pool, stream->ctx, in, out, numBlocks);
+        }
+        else {
+            poolEncryptBlocks(stream->pool, stream->ctx, in, out, numBlocks);
+        }
+
+        return;
+
+    }
+
+    aesCryptBlocks(stream->ctx, stream->mode, stream->decrypt, in, out, numBlocks);
+
+}
+
+
+
+/*
+ * stream       - the stream to set up
+ * ctx          - an initialized context; for CBC its iv is the chaining
+ *                value and is updated as the stream goes
+ * mode         - AES_MODE_ECB or AES_MODE_CBC
+ * decrypt      - 0 to encrypt, 1 to decrypt
+ *
+ * The stream runs on the calling thread; set stream->pool afterwards to
+ * spread ECB and CBC decryption over a thread pool (CBC encryption is a
+ * chain and always stays on one thread).
+ *
+ * Returns 0 on success, -1 if the mode is not supported.
+ */
+int aesStreamInit(aes_stream_t* stream, aes_ctx_t* ctx, int mode, int decrypt) {
+
+    if (mode != AES_MODE_ECB && mode != AES_MODE_CBC)
+    {
+        return -1;
+    }
+
+    stream->ctx = ctx;
+    stream->mode = mode;
+    stream->decrypt = decrypt;
+    stream->partialLength = 0;
+    stream->pool = NULL;
+
+    return 0;
+
+}
+
+/*
+ * stream       - the stream
+ * in           - the next inLength bytes of input
+ * out          - where the output goes, room for inLength + BLOCK_SIZE_BYTES - 1
+ *                bytes; may be in itself (in place), but must not otherwise
+ *                overlap it
+ *
+ * When no partial block is pending (every earlier update was a multiple
+ * of the block size), the blocks are processed directly from in to out.
+ * Otherwise the output runs ahead of the input by the pending bytes, so
+ * in place the input is first moved up to make room.
+ *
+ * Returns the number of bytes written to out, always a multiple of the
+ * block size.
+ */
+size_t aesStreamUpdate(aes_stream_t* stream, const uint8_t* in, size_t inLength, uint8_t* out) {
+
+    size_t written = 0;
+
+    if (stream->partialLength > 0)
+    {
+
+        size_t need = BLOCK_SIZE_BYTES - stream->partialLength;
+
+        if (inLength < need) // still not a whole block
+        {
+            memcpy(stream->partial + stream->partialLength, in, inLength);
+            stream->partialLength += inLength;
+            return 0;
+        }
+
+        memcpy(stream->partial + stream->partialLength, in, need);
+
+        const uint8_t* rest = in + need;
+        size_t numBlocks = (inLength - need) / BLOCK_SIZE_BYTES;
+        size_t tail = (inLength - need) % BLOCK_SIZE_BYTES;
+
+        if (out == in)
+        {
+
+            // the output is BLOCK_SIZE_BYTES - need bytes ahead of the input: save
+            // the tail, then move the whole blocks up behind the completed block
+            uint8_t tailBytes[BLOCK_SIZE_BYTES];
+
+            memcpy(tailBytes, rest + (BLOCK_SIZE_BYTES * numBlocks), tail);
+            memmove(out + BLOCK_SIZE_BYTES, rest, BLOCK_SIZE_BYTES * numBlocks);
+
+            streamBlocks(stream, stream->partial, out, 1);
+            streamBlocks(stream, out + BLOCK_SIZE_BYTES, out + BLOCK_SIZE_BYTES, numBlocks);
+
+            memcpy(stream->partial, tailBytes, tail);
+
+        }
+        else
+        {
+
+            streamBlocks(stream, stream->partial, out, 1);
+            streamBlocks(stream, rest, out + BLOCK_SIZE_BYTES, numBlocks);
+
+            memcpy(stream->partial, rest + (BLOCK_SIZE_BYTES * numBlocks), tail);
+
+        }
+
+        stream->partialLength = tail;
+
+        return BLOCK_SIZE_BYTES * (numBlocks + 1);
+
+    }
+
+    size_t numBlocks = inLength / BLOCK_SIZE_BYTES;
+    size_t tail = inLength % BLOCK_SIZE_BYTES;
+
+    streamBlocks(stream, in, out, numBlocks);
+    written = BLOCK_SIZE_BYTES * numBlocks;
+
+    memcpy(stream->partial, in + written, tail);
+    stream->partialLength = tail;
+
+    return written;
+
+}
+
+/*
+ * stream       - the stream
+ * out          - room for one block
+ *
+ * Zero-pad and process a pending partial block.
+ *
+ * Returns the number of bytes written to out, 0 or BLOCK_SIZE_BYTES.
+ */
+size_t aesStreamFinal(aes_stream_t* stream, uint8_t* out) {
+
+    if (stream->partialLength == 0)
+    {
+        return 0;
+    }
+
+    memset(stream->partial + stream->partialLength, 0, BLOCK_SIZE_BYTES - stream->partialLength); // zero-fill the last partial block
+
+    streamBlocks(stream, stream->partial, out, 1);
+
+    stream->partialLength = 0;
+    aesWipe(stream->partial, sizeof(stream->partial));
+
+    return BLOCK_SIZE_BYTES;
+
+}
@@ -0,0 +1,256 @@
+#include "../inc/aes.h"
+#include "../inc/threads.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+// worker pool for splitting independent blocks across cores
+
+
+
+
+/*
+ * Arguments of an ECB task: the whole range, each part takes its slice
+ */
+typedef struct blocks_task {
+
+    const aes_ctx_t* ctx;
+    const uint8_t* in;
+    uint8_t* out;
+    size_t numBlocks;
+    int decrypt;
+
+} blocks_task_t;
+
+
+
+/*
+ * Returns the number of online cores, 1 if it cannot be found.
+ */
+int poolDefaultThreads(void) {
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (cores > 0) ? (int) cores : 1;
+
+}
+
+
+
+static void* poolWorker(void* arg) {
+
+    pool_worker_t* worker = arg;
+    thread_pool_t* pool = worker->pool;
+    unsigned long seen = 0;
+
+    for (;;)
+    {
+
+        pthread_mutex_lock(&pool->lock);
+
+        while (pool->generation == seen && !pool->stop)
+        {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+
+        if (pool->stop)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+
+        seen = pool->generation;
+        pool_task_t task = pool->task;
+        void* taskArg = pool->arg;
+
+        pthread_mutex_unlock(&pool->lock);
+
+        task(taskArg, worker->part, pool->numThreads);
+
+        pthread_mutex_lock(&pool->lock);
+
+        if (--pool->pending == 0)
+        {
+            pthread_cond_signal(&pool->done);
+        }
+
+        pthread_mutex_unlock(&pool->lock);
+
+    }
+
+    return NULL;
+
+}
+
+/*
+ * pool         - the pool to start
+ * numThreads   - threads to run tasks on, counting the caller of poolRun()
+ *
+ * Returns 0 on success, -1 if the threads could not be started (the pool
+ * is then already torn down and must not be passed to poolDestroy).
+ */
+int poolInit(thread_pool_t* pool, int numThreads) {
+
+    if (numThreads < 1 || numThreads > POOL_MAX_THREADS)
+    {
+        return -1;
+    }
+
+    pool->numThreads = 1;
+    pool->workers = NULL;
+    pool->task = NULL;
+    pool->arg = NULL;
+    pool->generation = 0;
+    pool->pending = 0;
+    pool->stop = 0;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    if (numThreads == 1)
+    {
+        return 0;
+    }
+
+    pool->workers = malloc(sizeof(pool_worker_t) * (numThreads - 1));
+    if (!pool->workers)
+    {
+        poolDestroy(pool);
+        return -1;
+    }
+
+    for (int i = 0; i < numThreads - 1; i++)
+    {
+
+        pool->workers[i].pool = pool;
+        pool->workers[i].part = i + 1;
+
+        if (pthread_create(&pool->workers[i].thread, NULL, poolWorker, &pool->workers[i]) != 0)
+        {
+            poolDestroy(pool);
+            return -1;
+        }
+
+        pool->numThreads++; // only count threads that are running, for poolDestroy
+
+    }
+
+    return 0;
+
+}
+
+/*
+ * pool         - the pool
+ * task         - run once on every thread of the pool, part 0 on this one
+ * arg          - passed to task
+ *
+ * Returns once every part has finished.
+ */
+void poolRun(thread_pool_t* pool, pool_task_t task, void* arg) {
+
+    if (pool->numThreads == 1)
+    {
+        task(arg, 0, 1);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+
+    pool->task = task;
+    pool->arg = arg;
+    pool->pending = pool->numThreads - 1;
+    pool->generation++;
+
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    task(arg, 0, pool->numThreads);
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (pool->pending > 0)
+    {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+}
+
+void poolDestroy(thread_pool_t* pool) {
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->numThreads - 1; i++)
+    {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+
+    free(pool->workers);
+    pool->workers = NULL;
+    pool->numThreads = 1;
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+
+}
+
+
+
+/*
+ * Split numBlocks into numParts contiguous slices of whole blocks and
+ * return the start of slice part. Slice part ends where part + 1 starts.
+ */
+size_t poolSliceStart(size_t numBlocks, int part, int numParts) {
+
+    return (numBlocks / numParts) * part + ((size_t) part < numBlocks % numParts ? (size_t) part : numBlocks % numParts);
+
+}
+
+static void blocksTask(void* arg, int part, int numParts) {
+
+    blocks_task_t* task = arg;
+    size_t first = poolSliceStart(task->numBlocks, part, numParts);
+    size_t last = poolSliceStart(task->numBlocks, part + 1, numParts);
+
+    // ECB only reads the context, which the threads share
+    aesEcbBlocks(task->ctx, task->decrypt, task->in + (BLOCK_SIZE_BYTES * first),
+                 task->out + (BLOCK_SIZE_BYTES * first), last - first);
+
+}
+
+/*
+ * Run independent blocks (ECB) through the context on every thread of
+ * the pool. Each thread gets one contiguous slice, so the results land at
+ * the same offsets as the input. The context is only read, never copied.
+ * Small runs stay on the calling thread.
+ */
+static void poolBlocks(thread_pool_t* pool, const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, size_t numBlocks, int decrypt) {
+
+    blocks_task_t task = {ctx, in, out, numBlocks, decrypt};
+
+    if (pool->numThreads == 1 || numBlocks < (size_t) POOL_MIN_BLOCKS * pool->numThreads)
+    {
+        blocksTask(&task, 0, 1);
+        return;
+    }
+
+    poolRun(pool, blocksTask, &task);
+
+}
+
+void poolEncryptBlocks(thread_pool_t* pool, const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, size_t numBlocks) {
+
+    poolBlocks(pool, ctx, in, out, numBlocks, 0);
+
+}
+
+void poolDecryptBlocks(thread_pool_t* pool, const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, size_t numBlocks) {
+
+    poolBlocks(pool, ctx, in, out, numBlocks, 1);
+
+}
@@ -0,0 +1,573 @@
+#define _GNU_SOURCE // O_DIRECT
+
+#include "../inc/uring.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// io_uring backend for the command line tool's files, through the raw
+// system calls (no liburing)
+
+
+
+static int ringSetup(unsigned entries, struct io_uring_params* params) {
+
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+
+}
+
+static int ringEnter(io_ring_t* ring, unsigned minComplete) {
+
+    int submitted = 0;
+
+    do {
+        submitted = (int) syscall(__NR_io_uring_enter, ring->fd, ring->toSubmit, minComplete,
+                                  minComplete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (submitted == -1 && errno == EINTR);
+
+    if (submitted > 0)
+    {
+        ring->toSubmit -= (unsigned) submitted;
+    }
+
+    return submitted;
+
+}
+
+static int ringRegister(io_ring_t* ring, unsigned opcode, const void* arg, unsigned count) {
+
+    return (int) syscall(__NR_io_uring_register, ring->fd, opcode, arg, count);
+
+}
+
+/*
+ * Open the file behind fd again, as a separate open file, with O_DIRECT.
+ *
+ * Returns the new descriptor, -1 if the file system does not take
+ * O_DIRECT (tmpfs on older kernels) or there is no /proc.
+ */
+static int ringReopenDirect(int fd, int flags) {
+
+    char path[32];
+
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+
+    return open(path, flags | O_DIRECT | O_CLOEXEC);
+
+}
+
+/*
+ * Queue a read or write of the whole of buffer->wanted at buffer->offset.
+ * There is one entry per buffer, so the ring never runs out. O_DIRECT
+ * needs an aligned offset and length: a read is rounded up (it stops at
+ * the end of the file anyway, and the buffers have room), a write that
+ * is not aligned (the last) goes through the page cache.
+ */
+static void ringQueue(io_ring_t* ring, ring_buffer_t* buffer, int write) {
+
+    unsigned tail = *ring->sqTail;
+    unsigned index = tail & *ring->sqMask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    int bufferIndex = (int) (buffer - ring->buffers);
+    size_t length = buffer->wanted;
+
+    if (write) {
+        buffer->direct = (ring->outDirectFd != -1 && buffer->offset % URING_ALIGNMENT == 0 && length % URING_ALIGNMENT == 0);
+    }
+    else {
+        buffer->direct = (ring->inDirectFd != -1 && buffer->offset % URING_ALIGNMENT == 0);
+    }
+
+    if (buffer->direct && !write)
+    {
+        length = (length + URING_ALIGNMENT - 1) / URING_ALIGNMENT * URING_ALIGNMENT;
+    }
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+    if (ring->fixedBuffers)
+    {
+        sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->buf_index = (uint16_t) bufferIndex;
+    }
+    else {
+        sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+
+    if (ring->fixedFiles)
+    {
+        sqe->fd = (write ? 1 : 0) + (buffer->direct ? 2 : 0);
+        sqe->flags = IOSQE_FIXED_FILE;
+    }
+    else if (buffer->direct) {
+        sqe->fd = write ? ring->outDirectFd : ring->inDirectFd;
+    }
+    else {
+        sqe->fd = write ? ring->outFd : ring->inFd;
+    }
+
+    sqe->addr = (uint64_t) (uintptr_t) buffer->buffer.data;
+    sqe->len = (uint32_t) length;
+    sqe->off = buffer->offset;
+    sqe->user_data = (uint64_t) bufferIndex;
+
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    buffer->state = write ? RING_WRITING : RING_READING;
+    ring->toSubmit++;
+
+}
+
+/*
+ * Finish off a short read or write (the end of a file, a signal) with
+ * pread / pwrite.
+ *
+ * Returns the bytes done in all, or -errno on an error.
+ */
+static int ringComplete(io_ring_t* ring, ring_buffer_t* buffer, int write) {
+
+    size_t done = (size_t) buffer->result;
+
+    while (done < buffer->wanted)
+    {
+
+        ssize_t more = write ? pwrite(ring->outFd, buffer->buffer.data + done, buffer->wanted - done, buffer->offset + done)
+                             : pread(ring->inFd, buffer->buffer.data + done, buffer->wanted - done, buffer->offset + done);
+
+        if (more == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (more == 0 && !write)
+        {
+            return (int) done; // a read can end early, if the file shrank
+        }
+
+        if (more <= 0)
+        {
+            return (more == 0) ? -EIO : -errno;
+        }
+
+        done += (size_t) more;
+
+    }
+
+    return (int) done;
+
+}
+
+/*
+ * A read or write of the ring failed: print why, the first time, and
+ * have ringFinish report it.
+ */
+static void ringFailed(io_ring_t* ring, const char* what, int error) {
+
+    if (!ring->failed)
+    {
+        printf("Unable to %s: %s\n", what, strerror(error));
+        ring->failed = 1;
+    }
+
+}
+
+/*
+ * Take every completion there is.
+ */
+static void ringReap(io_ring_t* ring) {
+
+    unsigned head = *ring->cqHead;
+    unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+
+    while (head != tail)
+    {
+
+        struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cqMask];
+        ring_buffer_t* buffer = &ring->buffers[cqe->user_data];
+        int write = (buffer->state == RING_WRITING);
+
+        buffer->result = cqe->res;
+
+        if (buffer->result == -EINVAL && buffer->direct) // the device wants a larger alignment: no more O_DIRECT
+        {
+            close(write ? ring->outDirectFd : ring->inDirectFd);
+            *(write ? &ring->outDirectFd : &ring->inDirectFd) = -1;
+            buffer->result = 0;
+        }
+
+        if (buffer->result > 0 && (size_t) buffer->result > buffer->wanted)
+        {
+            buffer->result = (int) buffer->wanted; // a rounded up read
+        }
+
+        if (buffer->result >= 0 && (size_t) buffer->result < buffer->wanted)
+        {
+            buffer->result = ringComplete(ring, buffer, write);
+        }
+
+        if (buffer->result > 0 && ring->dropCache && !buffer->direct)
+        {
+
+            if (write) {
+                cacheWriteBehind(ring->outFd, buffer->offset, buffer->wanted);
+            }
+            else {
+                cacheDrop(ring->inFd, buffer->offset + (size_t) buffer->result);
+            }
+
+        }
+
+        if (buffer->result < 0)
+        {
+            ringFailed(ring, write ? "write the output file" : "read the input file", -buffer->result);
+        }
+
+        buffer->state = write ? RING_IDLE : RING_READ;
+        head++;
+
+    }
+
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+
+}
+
+/*
+ * Submit whatever is queued and wait until buffer is no longer in state.
+ */
+static void ringWait(io_ring_t* ring, ring_buffer_t* buffer, ring_state_t state) {
+
+    ringReap(ring);
+
+    while (buffer->state == state)
+    {
+
+        if (ringEnter(ring, 1) == -1)
+        {
+            buffer->result = -errno;
+            ringFailed(ring, "wait for io_uring", errno);
+            buffer->state = (state == RING_WRITING) ? RING_IDLE : RING_READ; // given up on
+            return;
+        }
+
+        ringReap(ring);
+
+    }
+
+}
+
+/*
+ * Queue reads for the chunks after the caller's, as far as there are
+ * idle buffers in order.
+ */
+static void ringReadAhead(io_ring_t* ring) {
+
+    while (ring->nextRead < ring->next + URING_BUFFERS && ring->readOffset < ring->inEnd)
+    {
+
+        ring_buffer_t* buffer = &ring->buffers[ring->nextRead % URING_BUFFERS];
+
+        if (buffer->state != RING_IDLE)
+        {
+            break; // still being written
+        }
+
+        buffer->offset = ring->readOffset;
+        buffer->wanted = (ring->inEnd - ring->readOffset < ring->chunkSize) ? ring->inEnd - ring->readOffset : ring->chunkSize;
+
+        ringQueue(ring, buffer, 0);
+
+        ring->readOffset += buffer->wanted;
+        ring->nextRead++;
+
+    }
+
+    if (ring->toSubmit > 0 && ringEnter(ring, 0) == -1)
+    {
+        ringFailed(ring, "submit to io_uring", errno);
+    }
+
+}
+
+static void ringUnmap(io_ring_t* ring) {
+
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqesSize);
+    }
+
+    if (ring->cqRing && ring->cqRing != ring->sqRing) {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+
+    if (ring->sqRing) {
+        munmap(ring->sqRing, ring->sqRingSize);
+    }
+
+    if (ring->fd != -1) {
+        close(ring->fd);
+    }
+
+    if (ring->inDirectFd != -1) {
+        close(ring->inDirectFd);
+    }
+
+    if (ring->outDirectFd != -1) {
+        close(ring->outDirectFd);
+    }
+
+    free(ring->memory);
+
+    memset(ring, 0, sizeof(io_ring_t));
+    ring->fd = -1;
+    ring->inDirectFd = -1;
+    ring->outDirectFd = -1;
+
+}
+
+/*
+ * ring         - the ring to set up
+ * inFd         - read from inOffset on, for inLength bytes
+ * outFd        - written from outOffset on
+ * chunkSize    - bytes per read; every buffer from ringNext() holds this
+ *                many, except the last
+ * bufferSize   - bytes per buffer, at least chunkSize
+ * direct       - 1 to keep the files out of the page cache: O_DIRECT
+ *                where the file system takes it, dropping pages behind
+ *                the reads and writes otherwise
+ *
+ * The files and buffers are registered with the kernel if it allows, so
+ * it does not have to look them up (and pin the pages) on every request.
+ *
+ * Returns 0 on success, -1 if io_uring is not available (nothing is left
+ * set up then).
+ */
+int ringStart(io_ring_t* ring, int inFd, unsigned long inOffset, unsigned long inLength, int outFd, unsigned long outOffset,
+              size_t chunkSize, size_t bufferSize, int direct) {
+
+    struct io_uring_params params;
+    struct iovec iovecs[URING_BUFFERS];
+
+    memset(ring, 0, sizeof(io_ring_t));
+    memset(&params, 0, sizeof(params));
+    ring->inDirectFd = -1;
+    ring->outDirectFd = -1;
+
+    bufferSize = (bufferSize + URING_ALIGNMENT - 1) / URING_ALIGNMENT * URING_ALIGNMENT;
+
+    if ((ring->fd = ringSetup(URING_BUFFERS, &params)) == -1)
+    {
+        return -1;
+    }
+
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->sqRingSize = (ring->cqRingSize > ring->sqRingSize) ? ring->cqRingSize : ring->sqRingSize;
+    }
+
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED)
+    {
+        ring->sqRing = NULL;
+        ringUnmap(ring);
+        return -1;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cqRing = ring->sqRing;
+    }
+    else
+    {
+
+        ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cqRing == MAP_FAILED)
+        {
+            ring->cqRing = NULL;
+            ringUnmap(ring);
+            return -1;
+        }
+
+    }
+
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = NULL;
+        ringUnmap(ring);
+        return -1;
+    }
+
+    ring->sqHead = (unsigned*) ((uint8_t*) ring->sqRing + params.sq_off.head);
+    ring->sqTail = (unsigned*) ((uint8_t*) ring->sqRing + params.sq_off.tail);
+    ring->sqMask = (unsigned*) ((uint8_t*) ring->sqRing + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned*) ((uint8_t*) ring->sqRing + params.sq_off.array);
+    ring->cqHead = (unsigned*) ((uint8_t*) ring->cqRing + params.cq_off.head);
+    ring->cqTail = (unsigned*) ((uint8_t*) ring->cqRing + params.cq_off.tail);
+    ring->cqMask = (unsigned*) ((uint8_t*) ring->cqRing + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*) ((uint8_t*) ring->cqRing + params.cq_off.cqes);
+
+    if (posix_memalign((void**) &ring->memory, URING_ALIGNMENT, bufferSize * URING_BUFFERS) != 0)
+    {
+        ring->memory = NULL;
+        ringUnmap(ring);
+        return -1;
+    }
+
+    for (int i = 0; i < URING_BUFFERS; i++)
+    {
+        ring->buffers[i].buffer.data = ring->memory + bufferSize * i;
+        iovecs[i].iov_base = ring->buffers[i].buffer.data;
+        iovecs[i].iov_len = bufferSize;
+    }
+
+    if (direct)
+    {
+        ring->inDirectFd = ringReopenDirect(inFd, O_RDONLY);
+        ring->outDirectFd = ringReopenDirect(outFd, O_WRONLY);
+        ring->dropCache = 1;
+    }
+
+    int fds[URING_FILES] = {inFd, outFd,
+                            (ring->inDirectFd != -1) ? ring->inDirectFd : inFd,
+                            (ring->outDirectFd != -1) ? ring->outDirectFd : outFd};
+
+    // either can fail (RLIMIT_MEMLOCK, an old kernel); the plain requests work regardless
+    ring->fixedBuffers = (ringRegister(ring, IORING_REGISTER_BUFFERS, iovecs, URING_BUFFERS) == 0);
+    ring->fixedFiles = (ringRegister(ring, IORING_REGISTER_FILES, fds, URING_FILES) == 0);
+
+    ring->inFd = inFd;
+    ring->outFd = outFd;
+    ring->readOffset = inOffset;
+    ring->inEnd = inOffset + inLength;
+    ring->writeOffset = outOffset;
+    ring->chunkSize = chunkSize;
+
+    ringReadAhead(ring);
+
+    return 0;
+
+}
+
+/*
+ * Returns the next chunk read, in file order. At the end of the input
+ * it is empty, and so it is after a failed read, which ringFinish then
+ * reports.
+ */
+io_buffer_t* ringNext(io_ring_t* ring) {
+
+    ring_buffer_t* buffer = &ring->buffers[ring->next % URING_BUFFERS];
+
+    ringReadAhead(ring);
+
+    if (ring->nextRead == ring->next && ring->readOffset < ring->inEnd) // the buffer is still being written
+    {
+        ringWait(ring, buffer, RING_WRITING);
+        ringReadAhead(ring);
+    }
+
+    if (ring->nextRead == ring->next) // nothing more to read
+    {
+        return ringTake(ring);
+    }
+
+    ringWait(ring, buffer, RING_READING);
+
+    buffer->buffer.length = (buffer->result > 0) ? (size_t) buffer->result : 0;
+    buffer->state = RING_HELD;
+    ring->next++;
+
+    if (buffer->result < 0)
+    {
+
+        // end the input here: drop the reads after this one
+        for (int i = 0; i < URING_BUFFERS; i++)
+        {
+
+            ringWait(ring, &ring->buffers[i], RING_READING);
+
+            if (ring->buffers[i].state == RING_READ) {
+                ring->buffers[i].state = RING_IDLE;
+            }
+
+        }
+
+        ring->readOffset = ring->inEnd;
+        ring->nextRead = ring->next;
+
+    }
+
+    return &buffer->buffer;
+
+}
+
+/*
+ * Returns an empty buffer, for output that does not follow a read (only
+ * once the input has all been handed over).
+ */
+io_buffer_t* ringTake(io_ring_t* ring) {
+
+    ring_buffer_t* buffer = &ring->buffers[ring->next % URING_BUFFERS];
+
+    ringWait(ring, buffer, RING_WRITING);
+
+    buffer->buffer.length = 0;
+    buffer->state = RING_HELD;
+    ring->next++;
+    ring->nextRead = ring->next; // keeps the read ahead from taking a buffer out from under a later ringTake
+
+    return &buffer->buffer;
+
+}
+
+/*
+ * Write buffer->length bytes of buffer at the output position, and give
+ * the buffer back.
+ */
+void ringWrite(io_ring_t* ring, io_buffer_t* buffer) {
+
+    ring_buffer_t* ringBuffer = (ring_buffer_t*) buffer; // the first member
+
+    ringBuffer->offset = ring->writeOffset;
+    ringBuffer->wanted = buffer->length;
+    ring->writeOffset += buffer->length;
+
+    if (buffer->length == 0) {
+        ringBuffer->state = RING_IDLE;
+    }
+    else {
+        ringQueue(ring, ringBuffer, 1);
+    }
+
+    ringReadAhead(ring); // also submits the write
+
+}
+
+/*
+ * Wait for every request still in flight, then tear the ring down.
+ *
+ * Returns 0, or -1 if a read or a write failed (printed when it did).
+ */
+int ringFinish(io_ring_t* ring) {
+
+    for (int i = 0; i < URING_BUFFERS; i++)
+    {
+        ringWait(ring, &ring->buffers[i], RING_READING);
+        ringWait(ring, &ring->buffers[i], RING_WRITING);
+    }
+
+    int failed = ring->failed;
+
+    ringUnmap(ring);
+
+    return failed ? -1 : 0;
+
+}
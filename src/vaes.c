@@ -0,0 +1,543 @@
+#include "../inc/aes.h"
+#include "../inc/aesni.h"
+#include "../inc/vaes.h"
+
+// VAES engines: the AES round instructions on YMM (2 blocks) and ZMM (4 blocks)
+// registers. Four registers are kept in flight per round so the AES units
+// always have independent work while an earlier round is still in the pipeline.
+//
+// Key expansion is left to the AES-NI engine; the round keys are broadcast
+// to every 128-bit lane once per key. Blocks left over after the last full
+// register use the low lane of the same keys with the 128-bit instructions.
+
+#ifdef ENGINE_X86
+
+#define VAES512_TARGET __attribute__((target("aes,vaes,avx512f,avx512bw")))
+#define VAES256_TARGET __attribute__((target("aes,vaes,avx2")))
+
+#define VAES_INTERLEAVE 4               // registers in flight per loop iteration
+
+// AES-NI round keys in every 128-bit lane, kept in the context's engineKeys
+typedef struct vaes512_keys {
+
+    __m512i enc[AES_256_NUM_ROUNDS + 1];
+    __m512i dec[AES_256_NUM_ROUNDS + 1];
+
+} vaes512_keys_t;
+
+typedef struct vaes256_keys {
+
+    __m256i enc[AES_256_NUM_ROUNDS + 1];
+    __m256i dec[AES_256_NUM_ROUNDS + 1];
+
+} vaes256_keys_t;
+
+CHECK_ENGINE_KEYS(vaes512_keys_t);
+CHECK_ENGINE_KEYS(vaes256_keys_t);
+
+
+
+static int vaes512Supported(void) {
+
+    __builtin_cpu_init();
+
+    return aesniSupported() && __builtin_cpu_supports("vaes") &&
+           __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+
+}
+
+static int vaes256Supported(void) {
+
+    __builtin_cpu_init();
+
+    return aesniSupported() && __builtin_cpu_supports("vaes") && __builtin_cpu_supports("avx2");
+
+}
+
+
+
+// ********************************************************************************
+// 512-bit (4 blocks per register)
+// ********************************************************************************
+
+VAES512_TARGET
+static void vaes512ExpandKey(aes_ctx_t* ctx) {
+
+    vaes512_keys_t* keys = ENGINE_KEYS(vaes512_keys_t, ctx);
+    aesni_keys_t roundKeys;
+
+    aesniExpandRoundKeys(ctx->keySchedule, ctx->keyLengthInWords, ctx->numRounds, &roundKeys);
+
+    for (int i = 0; i <= ctx->numRounds; i++)
+    {
+        keys->enc[i] = _mm512_broadcast_i32x4(roundKeys.enc[i]);
+        keys->dec[i] = _mm512_broadcast_i32x4(roundKeys.dec[i]);
+    }
+
+    aesWipe(&roundKeys, sizeof(roundKeys));
+
+}
+
+VAES512_TARGET
+static inline __m512i vaes512Load(const uint8_t* blocks) {
+
+    return _mm512_loadu_si512((const void*) blocks);
+
+}
+
+VAES512_TARGET
+static inline void vaes512Store(uint8_t* blocks, __m512i state) {
+
+    _mm512_storeu_si512((void*) blocks, state);
+
+}
+
+VAES512_TARGET
+static inline __m128i vaes512Load128(const uint8_t* block) {
+
+    return _mm_loadu_si128((const __m128i*) block);
+
+}
+
+VAES512_TARGET
+static inline void vaes512Store128(uint8_t* block, __m128i state) {
+
+    _mm_storeu_si128((__m128i*) block, state);
+
+}
+
+VAES512_TARGET
+KERNEL_INLINE void vaes512EncryptKernel(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks, int numRounds) {
+
+    const vaes512_keys_t* keys = ENGINE_KEYS(const vaes512_keys_t, ctx);
+
+    const int step = 4 * VAES_INTERLEAVE;
+    __m512i k[AES_256_NUM_ROUNDS + 1];
+    int n = 0;
+
+    #pragma GCC unroll 15
+    for (int i = 0; i <= numRounds; i++)
+    {
+        k[i] = keys->enc[i];
+    }
+
+    for (; n + step <= numBlocks; n += step)
+    {
+
+        const uint8_t* src = in + (BLOCK_SIZE_BYTES * n);
+        uint8_t* dst = out + (BLOCK_SIZE_BYTES * n);
+        __m512i s[VAES_INTERLEAVE];
+
+        #pragma GCC unroll 4
+        for (int j = 0; j < VAES_INTERLEAVE; j++)
+        {
+            s[j] = _mm512_xor_si512(vaes512Load(src + (64 * j)), k[0]);
+        }
+
+        #pragma GCC unroll 14
+        for (int i = 1; i < numRounds; i++)
+        {
+            #pragma GCC unroll 4
+            for (int j = 0; j < VAES_INTERLEAVE; j++)
+            {
+                s[j] = _mm512_aesenc_epi128(s[j], k[i]);
+            }
+        }
+
+        #pragma GCC unroll 4
+        for (int j = 0; j < VAES_INTERLEAVE; j++)
+        {
+            vaes512Store(dst + (64 * j), _mm512_aesenclast_epi128(s[j], k[numRounds]));
+        }
+
+    }
+
+    for (; n + 4 <= numBlocks; n += 4)
+    {
+
+        const uint8_t* src = in + (BLOCK_SIZE_BYTES * n);
+        uint8_t* dst = out + (BLOCK_SIZE_BYTES * n);
+        __m512i s = _mm512_xor_si512(vaes512Load(src), k[0]);
+
+        #pragma GCC unroll 14
+        for (int i = 1; i < numRounds; i++)
+        {
+            s = _mm512_aesenc_epi128(s, k[i]);
+        }
+
+        vaes512Store(dst, _mm512_aesenclast_epi128(s, k[numRounds]));
+
+    }
+
+    for (; n < numBlocks; n++)
+    {
+
+        const uint8_t* src = in + (BLOCK_SIZE_BYTES * n);
+        uint8_t* dst = out + (BLOCK_SIZE_BYTES * n);
+        __m128i s = _mm_xor_si128(vaes512Load128(src), _mm512_castsi512_si128(k[0]));
+
+        #pragma GCC unroll 14
+        for (int i = 1; i < numRounds; i++)
+        {
+            s = _mm_aesenc_si128(s, _mm512_castsi512_si128(k[i]));
+        }
+
+        vaes512Store128(dst, _mm_aesenclast_si128(s, _mm512_castsi512_si128(k[numRounds])));
+
+    }
+
+}
+
+VAES512_TARGET
+KERNEL_INLINE void vaes512DecryptKernel(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks, int numRounds) {
+
+    const vaes512_keys_t* keys = ENGINE_KEYS(const vaes512_keys_t, ctx);
+
+    const int step = 4 * VAES_INTERLEAVE;
+    __m512i k[AES_256_NUM_ROUNDS + 1];
+    int n = 0;
+
+    #pragma GCC unroll 15
+    for (int i = 0; i <= numRounds; i++)
+    {
+        k[i] = keys->dec[i];
+    }
+
+    for (; n + step <= numBlocks; n += step)
+    {
+
+        const uint8_t* src = in + (BLOCK_SIZE_BYTES * n);
+        uint8_t* dst = out + (BLOCK_SIZE_BYTES * n);
+        __m512i s[VAES_INTERLEAVE];
+
+        #pragma GCC unroll 4
+        for (int j = 0; j < VAES_INTERLEAVE; j++)
+        {
+            s[j] = _mm512_xor_si512(vaes512Load(src + (64 * j)), k[0]);
+        }
+
+        #pragma GCC unroll 14
+        for (int i = 1; i < numRounds; i++)
+        {
+            #pragma GCC unroll 4
+            for (int j = 0; j < VAES_INTERLEAVE; j++)
+            {
+                s[j] = _mm512_aesdec_epi128(s[j], k[i]);
+            }
+        }
+
+        #pragma GCC unroll 4
+        for (int j = 0; j < VAES_INTERLEAVE; j++)
+        {
+            vaes512Store(dst + (64 * j), _mm512_aesdeclast_epi128(s[j], k[numRounds]));
+        }
+
+    }
+
+    for (; n + 4 <= numBlocks; n += 4)
+    {
+
+        const uint8_t* src = in + (BLOCK_SIZE_BYTES * n);
+        uint8_t* dst = out + (BLOCK_SIZE_BYTES * n);
+        __m512i s = _mm512_xor_si512(vaes512Load(src), k[0]);
+
+        #pragma GCC unroll 14
+        for (int i = 1; i < numRounds; i++)
+        {
+            s = _mm512_aesdec_epi128(s, k[i]);
+        }
+
+        vaes512Store(dst, _mm512_aesdeclast_epi128(s, k[numRounds]));
+
+    }
+
+    for (; n < numBlocks; n++)
+    {
+
+        const uint8_t* src = in + (BLOCK_SIZE_BYTES * n);
+        uint8_t* dst = out + (BLOCK_SIZE_BYTES * n);
+        __m128i s = _mm_xor_si128(vaes512Load128(src), _mm512_castsi512_si128(k[0]));
+
+        #pragma GCC unroll 14
+        for (int i = 1; i < numRounds; i++)
+        {
+            s = _mm_aesdec_si128(s, _mm512_castsi512_si128(k[i]));
+        }
+
+        vaes512Store128(dst, _mm_aesdeclast_si128(s, _mm512_castsi512_si128(k[numRounds])));
+
+    }
+
+}
+
+VAES512_TARGET
+static void vaes512Encrypt(const aes_ctx_t* ctx, uint8_t* block) {
+
+    vaes512EncryptKernel(ctx, block, block, 1, ctx->numRounds);
+
+}
+
+VAES512_TARGET
+static void vaes512EncryptBlocks(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks) {
+
+    vaes512EncryptKernel(ctx, in, out, numBlocks, ctx->numRounds);
+
+}
+
+VAES512_TARGET
+static void vaes512Decrypt(const aes_ctx_t* ctx, uint8_t* block) {
+
+    vaes512DecryptKernel(ctx, block, block, 1, ctx->numRounds);
+
+}
+
+VAES512_TARGET
+static void vaes512DecryptBlocks(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks) {
+
+    vaes512DecryptKernel(ctx, in, out, numBlocks, ctx->numRounds);
+
+}
+
+DEFINE_KERNELS(vaes512, VAES512_TARGET)
+
+
+
+// ********************************************************************************
+// 256-bit (2 blocks per register)
+// ********************************************************************************
+
+VAES256_TARGET
+static void vaes256ExpandKey(aes_ctx_t* ctx) {
+
+    vaes256_keys_t* keys = ENGINE_KEYS(vaes256_keys_t, ctx);
+    aesni_keys_t roundKeys;
+
+    aesniExpandRoundKeys(ctx->keySchedule, ctx->keyLengthInWords, ctx->numRounds, &roundKeys);
+
+    for (int i = 0; i <= ctx->numRounds; i++)
+    {
+        keys->enc[i] = _mm256_broadcastsi128_si256(roundKeys.enc[i]);
+        keys->dec[i] = _mm256_broadcastsi128_si256(roundKeys.dec[i]);
+    }
+
+    aesWipe(&roundKeys, sizeof(roundKeys));
+
+}
+
+VAES256_TARGET
+static inline __m256i vaes256Load(const uint8_t* blocks) {
+
+    return _mm256_loadu_si256((const __m256i*) blocks);
+
+}
+
+VAES256_TARGET
+static inline void vaes256Store(uint8_t* blocks, __m256i state) {
+
+    _mm256_storeu_si256((__m256i*) blocks, state);
+
+}
+
+VAES256_TARGET
+static inline __m128i vaes256Load128(const uint8_t* block) {
+
+    return _mm_loadu_si128((const __m128i*) block);
+
+}
+
+VAES256_TARGET
+static inline void vaes256Store128(uint8_t* block, __m128i state) {
+
+    _mm_storeu_si128((__m128i*) block, state);
+
+}
+
+VAES256_TARGET
+KERNEL_INLINE void vaes256EncryptKernel(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks, int numRounds) {
+
+    const vaes256_keys_t* keys = ENGINE_KEYS(const vaes256_keys_t, ctx);
+
+    const int step = 2 * VAES_INTERLEAVE;
+    __m256i k[AES_256_NUM_ROUNDS + 1];
+    int n = 0;
+
+    #pragma GCC unroll 15
+    for (int i = 0; i <= numRounds; i++)
+    {
+        k[i] = keys->enc[i];
+    }
+
+    for (; n + step <= numBlocks; n += step)
+    {
+
+        const uint8_t* src = in + (BLOCK_SIZE_BYTES * n);
+        uint8_t* dst = out + (BLOCK_SIZE_BYTES * n);
+        __m256i s[VAES_INTERLEAVE];
+
+        #pragma GCC unroll 4
+        for (int j = 0; j < VAES_INTERLEAVE; j++)
+        {
+            s[j] = _mm256_xor_si256(vaes256Load(src + (32 * j)), k[0]);
+        }
+
+        #pragma GCC unroll 14
+        for (int i = 1; i < numRounds; i++)
+        {
+            #pragma GCC unroll 4
+            for (int j = 0; j < VAES_INTERLEAVE; j++)
+            {
+                s[j] = _mm256_aesenc_epi128(s[j], k[i]);
+            }
+        }
+
+        #pragma GCC unroll 4
+        for (int j = 0; j < VAES_INTERLEAVE; j++)
+        {
+            vaes256Store(dst + (32 * j), _mm256_aesenclast_epi128(s[j], k[numRounds]));
+        }
+
+    }
+
+    for (; n < numBlocks; n++)
+    {
+
+        const uint8_t* src = in + (BLOCK_SIZE_BYTES * n);
+        uint8_t* dst = out + (BLOCK_SIZE_BYTES * n);
+        __m128i s = _mm_xor_si128(vaes256Load128(src), _mm256_castsi256_si128(k[0]));
+
+        #pragma GCC unroll 14
+        for (int i = 1; i < numRounds; i++)
+        {
+            s = _mm_aesenc_si128(s, _mm256_castsi256_si128(k[i]));
+        }
+
+        vaes256Store128(dst, _mm_aesenclast_si128(s, _mm256_castsi256_si128(k[numRounds])));
+
+    }
+
+}
+
+VAES256_TARGET
+KERNEL_INLINE void vaes256DecryptKernel(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks, int numRounds) {
+
+    const vaes256_keys_t* keys = ENGINE_KEYS(const vaes256_keys_t, ctx);
+
+    const int step = 2 * VAES_INTERLEAVE;
+    __m256i k[AES_256_NUM_ROUNDS + 1];
+    int n = 0;
+
+    #pragma GCC unroll 15
+    for (int i = 0; i <= numRounds; i++)
+    {
+        k[i] = keys->dec[i];
+    }
+
+    for (; n + step <= numBlocks; n += step)
+    {
+
+        const uint8_t* src = in + (BLOCK_SIZE_BYTES * n);
+        uint8_t* dst = out + (BLOCK_SIZE_BYTES * n);
+        __m256i s[VAES_INTERLEAVE];
+
+        #pragma GCC unroll 4
+        for (int j = 0; j < VAES_INTERLEAVE; j++)
+        {
+            s[j] = _mm256_xor_si256(vaes256Load(src + (32 * j)), k[0]);
+        }
+
+        #pragma GCC unroll 14
+        for (int i = 1; i < numRounds; i++)
+        {
+            #pragma GCC unroll 4
+            for (int j = 0; j < VAES_INTERLEAVE; j++)
+            {
+                s[j] = _mm256_aesdec_epi128(s[j], k[i]);
+            }
+        }
+
+        #pragma GCC unroll 4
+        for (int j = 0; j < VAES_INTERLEAVE; j++)
+        {
+            vaes256Store(dst + (32 * j), _mm256_aesdeclast_epi128(s[j], k[numRounds]));
+        }
+
+    }
+
+    for (; n < numBlocks; n++)
+    {
+
+        const uint8_t* src = in + (BLOCK_SIZE_BYTES * n);
+        uint8_t* dst = out + (BLOCK_SIZE_BYTES * n);
+        __m128i s = _mm_xor_si128(vaes256Load128(src), _mm256_castsi256_si128(k[0]));
+
+        #pragma GCC unroll 14
+        for (int i = 1; i < numRounds; i++)
+        {
+            s = _mm_aesdec_si128(s, _mm256_castsi256_si128(k[i]));
+        }
+
+        vaes256Store128(dst, _mm_aesdeclast_si128(s, _mm256_castsi256_si128(k[numRounds])));
+
+    }
+
+}
+
+VAES256_TARGET
+static void vaes256Encrypt(const aes_ctx_t* ctx, uint8_t* block) {
+
+    vaes256EncryptKernel(ctx, block, block, 1, ctx->numRounds);
+
+}
+
+VAES256_TARGET
+static void vaes256EncryptBlocks(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks) {
+
+    vaes256EncryptKernel(ctx, in, out, numBlocks, ctx->numRounds);
+
+}
+
+VAES256_TARGET
+static void vaes256Decrypt(const aes_ctx_t* ctx, uint8_t* block) {
+
+    vaes256DecryptKernel(ctx, block, block, 1, ctx->numRounds);
+
+}
+
+VAES256_TARGET
+static void vaes256DecryptBlocks(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks) {
+
+    vaes256DecryptKernel(ctx, in, out, numBlocks, ctx->numRounds);
+
+}
+
+DEFINE_KERNELS(vaes256, VAES256_TARGET)
+
+
+
+const engine_t aesVaes512Engine = {
+
+    .name = "vaes512",
+    .isSupported = vaes512Supported,
+    .expandKey = vaes512ExpandKey,
+    .encrypt = vaes512Encrypt,
+    .decrypt = vaes512Decrypt,
+    .encryptBlocks = vaes512EncryptBlocks,
+    .decryptBlocks = vaes512DecryptBlocks,
+    .specialize = vaes512Specialize
+
+};
+
+const engine_t aesVaes256Engine = {
+
+    .name = "vaes256",
+    .isSupported = vaes256Supported,
+    .expandKey = vaes256ExpandKey,
+    .encrypt = vaes256Encrypt,
+    .decrypt = vaes256Decrypt,
+    .encryptBlocks = vaes256EncryptBlocks,
+    .decryptBlocks = vaes256DecryptBlocks,
+    .specialize = vaes256Specialize
+
+};
+
+#endif // ENGINE_X86
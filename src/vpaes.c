@@ -0,0 +1,554 @@
+#include "../inc/aes.h"
+#include "../inc/vpaes.h"
+
+// SSSE3 vector permute engine (after Hamburg's vpaes). The whole state sits in
+// one XMM register and every table is 16 bytes, indexed a nibble at a time
+// with PSHUFB, so there are no data dependent memory accesses.
+//
+// SubBytes maps each byte into the tower field GF((2^4)^2), where inversion
+// needs only five GF(2^4) inverse lookups, and maps the result back with two
+// more lookups. ShiftRows and MixColumns are byte shuffles and XORs.
+
+#ifdef ENGINE_X86
+
+#include <immintrin.h>
+
+#define VPAES_TARGET __attribute__((target("ssse3")))
+
+// round keys, kept in the context's engineKeys
+typedef struct vpaes_keys {
+
+    __m128i enc[AES_256_NUM_ROUNDS + 1];    // round keys, 0x63 folded into rounds 1..numRounds
+    __m128i dec[AES_256_NUM_ROUNDS + 1];    // equivalent inverse cipher round keys
+
+} vpaes_keys_t;
+
+CHECK_ENGINE_KEYS(vpaes_keys_t);
+
+
+
+// change of basis into the tower field GF((2^4)^2), low and high nibble halves
+static const uint8_t inputLo[16] __attribute__((aligned(16))) = {
+    0x00, 0x01, 0x1c, 0x1d, 0x2d, 0x2c, 0x31, 0x30, 0x27, 0x26, 0x3b, 0x3a, 0x0a, 0x0b, 0x16, 0x17
+};
+
+static const uint8_t inputHi[16] __attribute__((aligned(16))) = {
+    0x00, 0x86, 0xfd, 0x7b, 0x8e, 0x08, 0x73, 0xf5, 0x77, 0xf1, 0x8a, 0x0c, 0xf9, 0x7f, 0x04, 0x82
+};
+
+// inverse affine transformation followed by the change of basis, for InvSubBytes
+static const uint8_t invInputLo[16] __attribute__((aligned(16))) = {
+    0x2c, 0x99, 0xf0, 0x45, 0xf7, 0x42, 0x2b, 0x9e, 0x38, 0x8d, 0xe4, 0x51, 0xe3, 0x56, 0x3f, 0x8a
+};
+
+static const uint8_t invInputHi[16] __attribute__((aligned(16))) = {
+    0x00, 0xa7, 0xa8, 0x0f, 0xed, 0x4a, 0x45, 0xe2, 0xd1, 0x76, 0x79, 0xde, 0x3c, 0x9b, 0x94, 0x33
+};
+
+// 1/x in GF(2^4), with 1/0 mapped to 0x80 so a second lookup returns 0
+static const uint8_t gfInverse[16] __attribute__((aligned(16))) = {
+    0x80, 0x01, 0x09, 0x0e, 0x0d, 0x0b, 0x07, 0x06, 0x0f, 0x02, 0x0c, 0x05, 0x0a, 0x04, 0x03, 0x08
+};
+
+// p/x in GF(2^4), where t^2 + pt + p is the tower polynomial (p = 2)
+static const uint8_t gfInverseScaled[16] __attribute__((aligned(16))) = {
+    0x80, 0x02, 0x01, 0x0f, 0x09, 0x05, 0x0e, 0x0c, 0x0d, 0x04, 0x0b, 0x0a, 0x07, 0x08, 0x06, 0x03
+};
+
+// back to the AES basis and affine transformation (without the 0x63 constant), SubBytes
+static const uint8_t sboxOutU[16] __attribute__((aligned(16))) = {
+    0x00, 0xcb, 0xd7, 0xb0, 0x21, 0x8d, 0x67, 0xac, 0x7b, 0x5a, 0xea, 0x3d, 0x46, 0xf6, 0x91, 0x1c
+};
+
+static const uint8_t sboxOutT[16] __attribute__((aligned(16))) = {
+    0x00, 0x9f, 0x61, 0x16, 0xc2, 0x2a, 0x77, 0xe8, 0x89, 0x4b, 0x5d, 0x3c, 0xb5, 0xa3, 0xd4, 0xfe
+};
+
+// same, times {02}, used by MixColumns
+static const uint8_t sbox2OutU[16] __attribute__((aligned(16))) = {
+    0x00, 0x8d, 0xb5, 0x7b, 0x42, 0x01, 0xce, 0x43, 0xf6, 0xb4, 0xcf, 0x7a, 0x8c, 0xf7, 0x39, 0x38
+};
+
+static const uint8_t sbox2OutT[16] __attribute__((aligned(16))) = {
+    0x00, 0x25, 0xc2, 0x2c, 0x9f, 0x54, 0xee, 0xcb, 0x09, 0x96, 0xba, 0x78, 0x71, 0x5d, 0xb3, 0xe7
+};
+
+// back to the AES basis, InvSubBytes
+static const uint8_t invSboxOutU[16] __attribute__((aligned(16))) = {
+    0x00, 0x3b, 0xe4, 0xc8, 0x03, 0x14, 0x2c, 0x17, 0xf3, 0xf0, 0x38, 0xdc, 0x2f, 0xe7, 0xcb, 0xdf
+};
+
+static const uint8_t invSboxOutT[16] __attribute__((aligned(16))) = {
+    0x00, 0x24, 0x91, 0x19, 0x23, 0x8f, 0x88, 0xac, 0x3d, 0x1e, 0x07, 0x96, 0xab, 0xb2, 0x3a, 0xb5
+};
+
+// InvSubBytes times {09}, {0b}, {0d} and {0e}, used by InvMixColumns
+static const uint8_t invSbox9OutU[16] __attribute__((aligned(16))) = {
+    0x00, 0xf8, 0x85, 0xd2, 0x1b, 0xb4, 0x57, 0xaf, 0x2a, 0x31, 0xe3, 0x66, 0x4c, 0x9e, 0xc9, 0x7d
+};
+
+static const uint8_t invSbox9OutT[16] __attribute__((aligned(16))) = {
+    0x00, 0x1f, 0x75, 0xd1, 0x20, 0x9b, 0xa4, 0xbb, 0xce, 0xee, 0x3f, 0x4a, 0x84, 0x55, 0xf1, 0x6a
+};
+
+static const uint8_t invSbox11OutU[16] __attribute__((aligned(16))) = {
+    0x00, 0x8e, 0x56, 0x59, 0x1d, 0x9c, 0x0f, 0x81, 0xd7, 0xca, 0x93, 0xc5, 0x12, 0x4b, 0x44, 0xd8
+};
+
+static const uint8_t invSbox11OutT[16] __attribute__((aligned(16))) = {
+    0x00, 0x57, 0x4c, 0xe3, 0x66, 0x9e, 0xaf, 0xf8, 0xb4, 0xd2, 0x31, 0x7d, 0xc9, 0x2a, 0x85, 0x1b
+};
+
+static const uint8_t invSbox13OutU[16] __attribute__((aligned(16))) = {
+    0x00, 0x14, 0x38, 0xdf, 0x17, 0xe4, 0xe7, 0xf3, 0xcb, 0xdc, 0x03, 0x3b, 0xf0, 0x2f, 0xc8, 0x2c
+};
+
+static const uint8_t invSbox13OutT[16] __attribute__((aligned(16))) = {
+    0x00, 0x8f, 0x07, 0xb5, 0xac, 0x91, 0xb2, 0x3d, 0x3a, 0x96, 0x23, 0x24, 0x1e, 0xab, 0x19, 0x88
+};
+
+static const uint8_t invSbox14OutU[16] __attribute__((aligned(16))) = {
+    0x00, 0x59, 0x0f, 0x9c, 0x12, 0xd8, 0x93, 0xca, 0xc5, 0xd7, 0x4b, 0x44, 0x81, 0x1d, 0x8e, 0x56
+};
+
+static const uint8_t invSbox14OutT[16] __attribute__((aligned(16))) = {
+    0x00, 0xe3, 0xaf, 0x9e, 0xc9, 0x1b, 0x31, 0xd2, 0x7d, 0xb4, 0x2a, 0x85, 0xf8, 0x66, 0x57, 0x4c
+};
+
+
+
+/*
+ * Byte shuffles on the column-major state (byte 4 * column + row)
+ */
+
+// ShiftRows: row r moves left by r columns
+static const uint8_t shiftRowsMask[16] __attribute__((aligned(16))) = {
+    0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12, 1, 6, 11
+};
+
+// InvShiftRows: row r moves right by r columns
+static const uint8_t invShiftRowsMask[16] __attribute__((aligned(16))) = {
+    0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3
+};
+
+// every column rotated up by one row (row r takes row r + 1)
+static const uint8_t rotate1Mask[16] __attribute__((aligned(16))) = {
+    1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12
+};
+
+// every column rotated up by two rows
+static const uint8_t rotate2Mask[16] __attribute__((aligned(16))) = {
+    2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13
+};
+
+// every column rotated up by three rows
+static const uint8_t rotate3Mask[16] __attribute__((aligned(16))) = {
+    3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14
+};
+
+#define LOAD_TABLE(t) _mm_load_si128((const __m128i*) (t))
+
+
+
+static int vpaesSupported(void) {
+
+    __builtin_cpu_init();
+
+    return __builtin_cpu_supports("ssse3");
+
+}
+
+
+
+/**
+ * Inversion in the tower field. The input holds the high nibbles (i) and
+ * low nibbles (k) of the tower representation; io and jo come out so that
+ * the inverse is a linear function of 1/io and 1/jo, which the output
+ * tables apply (lanes with the top bit set stand for 1/0 and read as 0).
+ */
+VPAES_TARGET
+static inline void vpaesInvert(__m128i x, __m128i* io, __m128i* jo) {
+
+    const __m128i lowNibbles = _mm_set1_epi8(0x0F);
+    const __m128i inverse = LOAD_TABLE(gfInverse);
+
+    __m128i i = _mm_and_si128(_mm_srli_epi16(x, 4), lowNibbles);
+    __m128i k = _mm_and_si128(x, lowNibbles);
+    __m128i j = _mm_xor_si128(i, k);
+    __m128i ak = _mm_shuffle_epi8(LOAD_TABLE(gfInverseScaled), k);            // p/k
+    __m128i iak = _mm_xor_si128(_mm_shuffle_epi8(inverse, i), ak);            // 1/i + p/k
+    __m128i jak = _mm_xor_si128(_mm_shuffle_epi8(inverse, j), ak);            // 1/j + p/k
+
+    *io = _mm_xor_si128(_mm_shuffle_epi8(inverse, iak), j);
+    *jo = _mm_xor_si128(_mm_shuffle_epi8(inverse, jak), i);
+
+}
+
+/**
+ * Change of basis from AES bytes into the tower field, one lookup per nibble.
+ */
+VPAES_TARGET
+static inline __m128i vpaesInput(__m128i x, const uint8_t* lo, const uint8_t* hi) {
+
+    const __m128i lowNibbles = _mm_set1_epi8(0x0F);
+
+    __m128i xLo = _mm_and_si128(x, lowNibbles);
+    __m128i xHi = _mm_and_si128(_mm_srli_epi16(x, 4), lowNibbles);
+
+    return _mm_xor_si128(_mm_shuffle_epi8(LOAD_TABLE(lo), xLo), _mm_shuffle_epi8(LOAD_TABLE(hi), xHi));
+
+}
+
+VPAES_TARGET
+static inline __m128i vpaesOutput(__m128i io, __m128i jo, const uint8_t* u, const uint8_t* t) {
+
+    return _mm_xor_si128(_mm_shuffle_epi8(LOAD_TABLE(u), io), _mm_shuffle_epi8(LOAD_TABLE(t), jo));
+
+}
+
+/**
+ * SubBytes without the 0x63 constant (it is folded into the round keys).
+ */
+VPAES_TARGET
+static inline __m128i vpaesSubBytes(__m128i state) {
+
+    __m128i io, jo;
+
+    vpaesInvert(vpaesInput(state, inputLo, inputHi), &io, &jo);
+
+    return vpaesOutput(io, jo, sboxOutU, sboxOutT);
+
+}
+
+/**
+ * One full encryption round: ShiftRows, SubBytes, MixColumns, AddRoundKey.
+ * ShiftRows only moves bytes, so it is done first; SubBytes then gives both
+ * S(x) and 2 S(x), and MixColumns is 2 S ^ 3 S' ^ S'' ^ S''' over the rows.
+ */
+VPAES_TARGET
+static inline __m128i vpaesEncryptRound(__m128i state, __m128i roundKey) {
+
+    __m128i io, jo;
+
+    state = _mm_shuffle_epi8(state, LOAD_TABLE(shiftRowsMask));
+    vpaesInvert(vpaesInput(state, inputLo, inputHi), &io, &jo);
+
+    __m128i s1 = vpaesOutput(io, jo, sboxOutU, sboxOutT);
+    __m128i s2 = vpaesOutput(io, jo, sbox2OutU, sbox2OutT);
+
+    state = _mm_xor_si128(s2, _mm_shuffle_epi8(_mm_xor_si128(s1, s2), LOAD_TABLE(rotate1Mask)));
+    state = _mm_xor_si128(state, _mm_shuffle_epi8(s1, LOAD_TABLE(rotate2Mask)));
+    state = _mm_xor_si128(state, _mm_shuffle_epi8(s1, LOAD_TABLE(rotate3Mask)));
+
+    return _mm_xor_si128(state, roundKey);
+
+}
+
+VPAES_TARGET
+static inline __m128i vpaesEncryptLastRound(__m128i state, __m128i roundKey) {
+
+    state = _mm_shuffle_epi8(state, LOAD_TABLE(shiftRowsMask));
+
+    return _mm_xor_si128(vpaesSubBytes(state), roundKey);
+
+}
+
+/**
+ * One full round of the equivalent inverse cipher: InvShiftRows,
+ * InvSubBytes, InvMixColumns, AddRoundKey. InvSubBytes gives the
+ * {0e}, {0b}, {0d} and {09} multiples directly.
+ */
+VPAES_TARGET
+static inline __m128i vpaesDecryptRound(__m128i state, __m128i roundKey) {
+
+    __m128i io, jo;
+
+    state = _mm_shuffle_epi8(state, LOAD_TABLE(invShiftRowsMask));
+    vpaesInvert(vpaesInput(state, invInputLo, invInputHi), &io, &jo);
+
+    state = vpaesOutput(io, jo, invSbox14OutU, invSbox14OutT);
+    state = _mm_xor_si128(state, _mm_shuffle_epi8(vpaesOutput(io, jo, invSbox11OutU, invSbox11OutT), LOAD_TABLE(rotate1Mask)));
+    state = _mm_xor_si128(state, _mm_shuffle_epi8(vpaesOutput(io, jo, invSbox13OutU, invSbox13OutT), LOAD_TABLE(rotate2Mask)));
+    state = _mm_xor_si128(state, _mm_shuffle_epi8(vpaesOutput(io, jo, invSbox9OutU, invSbox9OutT), LOAD_TABLE(rotate3Mask)));
+
+    return _mm_xor_si128(state, roundKey);
+
+}
+
+VPAES_TARGET
+static inline __m128i vpaesDecryptLastRound(__m128i state, __m128i roundKey) {
+
+    __m128i io, jo;
+
+    state = _mm_shuffle_epi8(state, LOAD_TABLE(invShiftRowsMask));
+    vpaesInvert(vpaesInput(state, invInputLo, invInputHi), &io, &jo);
+
+    return _mm_xor_si128(vpaesOutput(io, jo, invSboxOutU, invSboxOutT), roundKey);
+
+}
+
+
+
+/**
+ * Multiply every byte by {02}, branch free.
+ */
+VPAES_TARGET
+static inline __m128i xtime(__m128i x) {
+
+    __m128i carry = _mm_cmpgt_epi8(_mm_setzero_si128(), x); // 0xFF where the top bit is set
+
+    return _mm_xor_si128(_mm_add_epi8(x, x), _mm_and_si128(carry, _mm_set1_epi8(0x1B)));
+
+}
+
+/**
+ * InvMixColumns on a round key, for the equivalent inverse cipher.
+ */
+VPAES_TARGET
+static __m128i vpaesInvMixColumns(__m128i x) {
+
+    __m128i x2 = xtime(x);
+    __m128i x4 = xtime(x2);
+    __m128i x8 = xtime(x4);
+
+    __m128i x9 = _mm_xor_si128(x8, x);
+    __m128i x11 = _mm_xor_si128(x9, x2);
+    __m128i x13 = _mm_xor_si128(x9, x4);
+    __m128i x14 = _mm_xor_si128(_mm_xor_si128(x8, x4), x2);
+
+    __m128i result = x14;
+    result = _mm_xor_si128(result, _mm_shuffle_epi8(x11, LOAD_TABLE(rotate1Mask)));
+    result = _mm_xor_si128(result, _mm_shuffle_epi8(x13, LOAD_TABLE(rotate2Mask)));
+    result = _mm_xor_si128(result, _mm_shuffle_epi8(x9, LOAD_TABLE(rotate3Mask)));
+
+    return result;
+
+}
+
+/**
+ * Constant-time SubWord for the key schedule.
+ */
+VPAES_TARGET
+static uint32_t vpaesSubWord(uint32_t word) {
+
+    return _mm_cvtsi128_si32(vpaesSubBytes(_mm_cvtsi32_si128(word))) ^ 0x63636363;
+
+}
+
+VPAES_TARGET
+static void vpaesExpandKey(aes_ctx_t* ctx) {
+
+    vpaes_keys_t* keys = ENGINE_KEYS(vpaes_keys_t, ctx);
+    const uint32_t* key = ctx->keySchedule;
+    int keyLengthInWords = ctx->keyLengthInWords;
+    int numRounds = ctx->numRounds;
+    uint32_t w[AES_BLOCK_SIZE_WORDS * (AES_256_NUM_ROUNDS + 1)];
+    uint32_t rcon = 1;
+    int scheduleLength = AES_BLOCK_SIZE_WORDS * (numRounds + 1);
+    __m128i roundKeys[AES_256_NUM_ROUNDS + 1];
+
+    // little endian words in memory byte order, RotWord is a right rotate
+    for (int i = 0; i < keyLengthInWords; i++)
+    {
+        w[i] = __builtin_bswap32(key[i]);
+    }
+
+    for (int i = keyLengthInWords; i < scheduleLength; i++)
+    {
+
+        uint32_t temp = w[i - 1];
+
+        if (i % keyLengthInWords == 0)
+        {
+            temp = vpaesSubWord((temp >> 8) | (temp << 24)) ^ rcon;
+            rcon = (rcon << 1) ^ ((rcon & 0x80) ? 0x11B : 0);
+        }
+        else if (keyLengthInWords == AES_256_KEY_LENGTH_WORDS && i % keyLengthInWords == 4)
+        {
+            temp = vpaesSubWord(temp);
+        }
+
+        w[i] = w[i - keyLengthInWords] ^ temp;
+
+    }
+
+    for (int i = 0; i <= numRounds; i++)
+    {
+        roundKeys[i] = _mm_loadu_si128((const __m128i*) &w[AES_BLOCK_SIZE_WORDS * i]);
+    }
+
+    // the s-box output tables leave out the 0x63 constant; MixColumns maps
+    // a column of 0x63 to itself, so it can be added with the round key instead
+    keys->enc[0] = roundKeys[0];
+
+    for (int i = 1; i <= numRounds; i++)
+    {
+        keys->enc[i] = _mm_xor_si128(roundKeys[i], _mm_set1_epi8(0x63));
+    }
+
+    keys->dec[0] = roundKeys[numRounds];
+
+    for (int i = 1; i < numRounds; i++)
+    {
+        keys->dec[i] = vpaesInvMixColumns(roundKeys[numRounds - i]);
+    }
+
+    keys->dec[numRounds] = roundKeys[0];
+
+    aesWipe(w, sizeof(w));
+    aesWipe(roundKeys, sizeof(roundKeys));
+
+}
+
+
+
+VPAES_TARGET
+static inline __m128i vpaesEncryptState(const vpaes_keys_t* keys, __m128i state, int numRounds) {
+
+    state = _mm_xor_si128(state, keys->enc[0]);
+
+    for (int i = 1; i < numRounds; i++)
+    {
+        state = vpaesEncryptRound(state, keys->enc[i]);
+    }
+
+    return vpaesEncryptLastRound(state, keys->enc[numRounds]);
+
+}
+
+VPAES_TARGET
+static inline __m128i vpaesDecryptState(const vpaes_keys_t* keys, __m128i state, int numRounds) {
+
+    state = _mm_xor_si128(state, keys->dec[0]);
+
+    for (int i = 1; i < numRounds; i++)
+    {
+        state = vpaesDecryptRound(state, keys->dec[i]);
+    }
+
+    return vpaesDecryptLastRound(state, keys->dec[numRounds]);
+
+}
+
+VPAES_TARGET
+static inline __m128i vpaesLoad(const uint8_t* block) {
+
+    return _mm_loadu_si128((const __m128i*) block);
+
+}
+
+VPAES_TARGET
+static inline void vpaesStore(uint8_t* block, __m128i state) {
+
+    _mm_storeu_si128((__m128i*) block, state);
+
+}
+
+VPAES_TARGET
+static void vpaesEncrypt(const aes_ctx_t* ctx, uint8_t* block) {
+
+    const vpaes_keys_t* keys = ENGINE_KEYS(const vpaes_keys_t, ctx);
+
+    vpaesStore(block, vpaesEncryptState(keys, vpaesLoad(block), ctx->numRounds));
+
+}
+
+VPAES_TARGET
+static void vpaesDecrypt(const aes_ctx_t* ctx, uint8_t* block) {
+
+    const vpaes_keys_t* keys = ENGINE_KEYS(const vpaes_keys_t, ctx);
+
+    vpaesStore(block, vpaesDecryptState(keys, vpaesLoad(block), ctx->numRounds));
+
+}
+
+/**
+ * Two blocks per round loop so the shuffles of one block fill the gaps
+ * left by the dependency chain of the other.
+ */
+VPAES_TARGET
+static void vpaesEncryptBlocks(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks) {
+
+    const vpaes_keys_t* keys = ENGINE_KEYS(const vpaes_keys_t, ctx);
+    int numRounds = ctx->numRounds;
+    int n = 0;
+
+    for (; n + 2 <= numBlocks; n += 2)
+    {
+
+        const uint8_t* src = in + (BLOCK_SIZE_BYTES * n);
+        uint8_t* dst = out + (BLOCK_SIZE_BYTES * n);
+        __m128i s0 = _mm_xor_si128(vpaesLoad(src), keys->enc[0]);
+        __m128i s1 = _mm_xor_si128(vpaesLoad(src + BLOCK_SIZE_BYTES), keys->enc[0]);
+
+        for (int i = 1; i < numRounds; i++)
+        {
+            s0 = vpaesEncryptRound(s0, keys->enc[i]);
+            s1 = vpaesEncryptRound(s1, keys->enc[i]);
+        }
+
+        vpaesStore(dst, vpaesEncryptLastRound(s0, keys->enc[numRounds]));
+        vpaesStore(dst + BLOCK_SIZE_BYTES, vpaesEncryptLastRound(s1, keys->enc[numRounds]));
+
+    }
+
+    if (n < numBlocks)
+    {
+        __m128i s = vpaesLoad(in + (BLOCK_SIZE_BYTES * n));
+
+        vpaesStore(out + (BLOCK_SIZE_BYTES * n), vpaesEncryptState(keys, s, numRounds));
+    }
+
+}
+
+VPAES_TARGET
+static void vpaesDecryptBlocks(const aes_ctx_t* ctx, const uint8_t* in, uint8_t* out, int numBlocks) {
+
+    const vpaes_keys_t* keys = ENGINE_KEYS(const vpaes_keys_t, ctx);
+    int numRounds = ctx->numRounds;
+    int n = 0;
+
+    for (; n + 2 <= numBlocks; n += 2)
+    {
+
+        const uint8_t* src = in + (BLOCK_SIZE_BYTES * n);
+        uint8_t* dst = out + (BLOCK_SIZE_BYTES * n);
+        __m128i s0 = _mm_xor_si128(vpaesLoad(src), keys->dec[0]);
+        __m128i s1 = _mm_xor_si128(vpaesLoad(src + BLOCK_SIZE_BYTES), keys->dec[0]);
+
+        for (int i = 1; i < numRounds; i++)
+        {
+            s0 = vpaesDecryptRound(s0, keys->dec[i]);
+            s1 = vpaesDecryptRound(s1, keys->dec[i]);
+        }
+
+        vpaesStore(dst, vpaesDecryptLastRound(s0, keys->dec[numRounds]));
+        vpaesStore(dst + BLOCK_SIZE_BYTES, vpaesDecryptLastRound(s1, keys->dec[numRounds]));
+
+    }
+
+    if (n < numBlocks)
+    {
+        __m128i s = vpaesLoad(in + (BLOCK_SIZE_BYTES * n));
+
+        vpaesStore(out + (BLOCK_SIZE_BYTES * n), vpaesDecryptState(keys, s, numRounds));
+    }
+
+}
+
+
+
+const engine_t aesVpaesEngine = {
+
+    .name = "vpaes",
+    .isSupported = vpaesSupported,
+    .expandKey = vpaesExpandKey,
+    .encrypt = vpaesEncrypt,
+    .decrypt = vpaesDecrypt,
+    .encryptBlocks = vpaesEncryptBlocks,
+    .decryptBlocks = vpaesDecryptBlocks,
+    .specialize = NULL      // rounds are too large to be worth unrolling
+
+};
+
+#endif // ENGINE_X86
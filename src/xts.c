@@ -0,0 +1,287 @@
+#include "../inc/aes.h"
+#include "../inc/cbc.h"
+#include "../inc/xts.h"
+#include <string.h>
+
+// implement XTS (IEEE 1619): every sector is en/de-crypted on its own,
+// tweaked by its number, so sectors can be read, written and worked on
+// in any order
+
+/*
+ * Arguments of a parallel run: the whole run, each part takes a slice
+ * of the sectors
+ */
+typedef struct xts_task {
+
+    const xts_ctx_t* xts;
+    uint64_t firstSector;
+    size_t sectorSize;
+    const uint8_t* in;
+    uint8_t* out;
+    size_t length;
+    int decrypt;
+
+} xts_task_t;
+
+
+
+// tweaks are little endian 128 bit numbers
+
+static void loadTweak(const uint8_t* p, uint64_t* low, uint64_t* high) {
+
+    memcpy(low, p, 8);
+    memcpy(high, p + 8, 8);
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    *low = __builtin_bswap64(*low);
+    *high = __builtin_bswap64(*high);
+#endif
+
+}
+
+static void storeTweak(uint8_t* p, uint64_t low, uint64_t high) {
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    low = __builtin_bswap64(low);
+    high = __builtin_bswap64(high);
+#endif
+
+    memcpy(p, &low, 8);
+    memcpy(p + 8, &high, 8);
+
+}
+
+/*
+ * The tweak of the next block: multiply by alpha (x) modulo
+ * x^128 + x^7 + x^2 + x + 1
+ */
+static void nextTweak(uint64_t* low, uint64_t* high) {
+
+    uint64_t carry = *high >> 63;
+
+    *high = (*high << 1) | (*low >> 63);
+    *low = (*low << 1) ^ (0x87 & (0 - carry));
+
+}
+
+/*
+ * One block on its own: out = E(in ^ tweak) ^ tweak (or D)
+ */
+static void xtsBlock(const xts_ctx_t* xts, const uint8_t* in, uint8_t* out, const uint8_t* tweak, int decrypt) {
+
+    uint8_t block[BLOCK_SIZE_BYTES];
+
+    for (int i = 0; i < BLOCK_SIZE_BYTES; i++)
+    {
+        block[i] = in[i] ^ tweak[i];
+    }
+
+    if (decrypt) {
+        aesDecrypt(&xts->data, block);
+    }
+    else {
+        aesEncrypt(&xts->data, block);
+    }
+
+    for (int i = 0; i < BLOCK_SIZE_BYTES; i++)
+    {
+        out[i] = block[i] ^ tweak[i];
+    }
+
+}
+
+/*
+ * En/de-crypt one data unit of length bytes (at least one block) whose
+ * encrypted tweak is tweak. The tweaks of a batch of blocks are made
+ * first, so the blocks go to the engine's widest kernel together. A
+ * partial last block takes the end of the block before it (ciphertext
+ * stealing), so the length is kept.
+ */
+static void xtsUnit(const xts_ctx_t* xts, const uint8_t* tweak, const uint8_t* in, uint8_t* out, size_t length, int decrypt) {
+
+    uint8_t tweaks[XTS_BATCH_BLOCKS * BLOCK_SIZE_BYTES];
+    uint8_t blocks[XTS_BATCH_BLOCKS * BLOCK_SIZE_BYTES];
+    size_t tail = length % BLOCK_SIZE_BYTES;
+    size_t numBlocks = length / BLOCK_SIZE_BYTES - (tail ? 1 : 0); // blocks done without stealing
+    uint64_t low;
+    uint64_t high;
+
+    loadTweak(tweak, &low, &high);
+
+    for (size_t n = 0; n < numBlocks; n += XTS_BATCH_BLOCKS)
+    {
+
+        int batch = (numBlocks - n < XTS_BATCH_BLOCKS) ? (int) (numBlocks - n) : XTS_BATCH_BLOCKS;
+
+        for (int i = 0; i < batch; i++)
+        {
+            storeTweak(tweaks + (BLOCK_SIZE_BYTES * i), low, high);
+            nextTweak(&low, &high);
+        }
+
+        aesXorBlocks(blocks, in + (BLOCK_SIZE_BYTES * n), tweaks, batch);
+
+        if (decrypt) {
+            aesDecryptBlocks(&xts->data, blocks, blocks, batch);
+        }
+        else {
+            aesEncryptBlocks(&xts->data, blocks, blocks, batch);
+        }
+
+        aesXorBlocks(out + (BLOCK_SIZE_BYTES * n), blocks, tweaks, batch);
+
+    }
+
+    if (tail > 0)
+    {
+
+        const uint8_t* lastIn = in + (BLOCK_SIZE_BYTES * numBlocks);
+        uint8_t* lastOut = out + (BLOCK_SIZE_BYTES * numBlocks);
+        uint8_t tweakLast[BLOCK_SIZE_BYTES];    // of the last whole block
+        uint8_t tweakPartial[BLOCK_SIZE_BYTES]; // of the partial block after it
+        uint8_t stolen[BLOCK_SIZE_BYTES];
+        uint8_t joined[BLOCK_SIZE_BYTES];
+
+        storeTweak(tweakLast, low, high);
+        nextTweak(&low, &high);
+        storeTweak(tweakPartial, low, high);
+
+        // decrypting undoes the last step of encrypting first, so the tweaks swap
+        xtsBlock(xts, lastIn, stolen, decrypt ? tweakPartial : tweakLast, decrypt);
+
+        memcpy(joined, lastIn + BLOCK_SIZE_BYTES, tail); // read before it is overwritten (in place)
+        memcpy(joined + tail, stolen + tail, BLOCK_SIZE_BYTES - tail);
+        memcpy(lastOut + BLOCK_SIZE_BYTES, stolen, tail);
+
+        xtsBlock(xts, joined, lastOut, decrypt ? tweakLast : tweakPartial, decrypt);
+
+        aesWipe(stolen, sizeof(stolen));
+        aesWipe(joined, sizeof(joined));
+
+    }
+
+    aesWipe(blocks, sizeof(blocks));
+
+}
+
+static void xtsTask(void* arg, int part, int numParts) {
+
+    xts_task_t* task = arg;
+    size_t numSectors = (task->length + task->sectorSize - 1) / task->sectorSize;
+    size_t first = poolSliceStart(numSectors, part, numParts);
+    size_t last = poolSliceStart(numSectors, part + 1, numParts);
+    uint8_t tweaks[XTS_BATCH_SECTORS * BLOCK_SIZE_BYTES];
+
+    for (size_t s = first; s < last; s += XTS_BATCH_SECTORS)
+    {
+
+        int batch = (last - s < XTS_BATCH_SECTORS) ? (int) (last - s) : XTS_BATCH_SECTORS;
+
+        for (int i = 0; i < batch; i++) // T = E(Key2, sector number)
+        {
+            storeTweak(tweaks + (BLOCK_SIZE_BYTES * i), task->firstSector + s + i, 0);
+        }
+
+        aesEncryptBlocks(&task->xts->tweak, tweaks, tweaks, batch);
+
+        for (int i = 0; i < batch; i++)
+        {
+
+            size_t offset = (s + i) * task->sectorSize;
+            size_t length = (task->length - offset < task->sectorSize) ? task->length - offset : task->sectorSize;
+
+            xtsUnit(task->xts, tweaks + (BLOCK_SIZE_BYTES * i), task->in + offset, task->out + offset, length, task->decrypt);
+
+        }
+
+    }
+
+}
+
+static int xtsRun(const xts_ctx_t* xts, uint64_t firstSector, size_t sectorSize, const uint8_t* in, uint8_t* out, size_t length, thread_pool_t* pool, int decrypt) {
+
+    xts_task_t task = {xts, firstSector, sectorSize, in, out, length, decrypt};
+
+    if (sectorSize < BLOCK_SIZE_BYTES || (length % sectorSize != 0 && length % sectorSize < BLOCK_SIZE_BYTES))
+    {
+        return -1;
+    }
+
+    if (pool && pool->numThreads > 1 && length / BLOCK_SIZE_BYTES >= (size_t) POOL_MIN_BLOCKS * pool->numThreads) {
+        poolRun(pool, xtsTask, &task);
+    }
+    else {
+        xtsTask(&task, 0, 1);
+    }
+
+    return 0;
+
+}
+
+
+
+/*
+ * xts              - the context to set up
+ * key              - Key1 followed by Key2, keyLengthBits / 8 bytes
+ * keyLengthBits    - 256 for XTS-AES-128, 512 for XTS-AES-256
+ * engineName       - the engine to use, or NULL to pick the fastest supported
+ *
+ * Both halves go through aesInit, so they get the same key schedule and
+ * engine format as any other key.
+ *
+ * Returns 0 on success, -1 if the key length is invalid, the halves are
+ * the same, or the engine is not available.
+ */
+int xtsInit(xts_ctx_t* xts, const uint8_t* key, int keyLengthBits, const char* engineName) {
+
+    int half = keyLengthBits / 2;
+
+    if (keyLengthBits != 2 * AES_128_KEY_LENGTH && keyLengthBits != 2 * AES_256_KEY_LENGTH)
+    {
+        return -1;
+    }
+
+    if (memcmp(key, key + (half / 8), half / 8) == 0)
+    {
+        return -1;
+    }
+
+    if (aesInit(&xts->data, key, half, engineName) == -1 || aesInit(&xts->tweak, key + (half / 8), half, engineName) == -1)
+    {
+        return -1;
+    }
+
+    return 0;
+
+}
+
+void xtsClear(xts_ctx_t* xts) {
+
+    aesClear(&xts->data);
+    aesClear(&xts->tweak);
+
+}
+
+/*
+ * xts          - the keys; only read
+ * firstSector  - the number of the sector in starts with, its tweak
+ * sectorSize   - bytes in a sector (data unit), at least 16
+ * in / out     - length bytes; out may be in, but must not otherwise overlap it
+ * length       - whole sectors, except that the last one may be shorter
+ *                (but not under 16 bytes)
+ * pool         - threads to split the sectors across, or NULL
+ *
+ * Returns 0 on success, -1 if the sizes are invalid (nothing is
+ * en/de-crypted then).
+ */
+int xtsEncrypt(const xts_ctx_t* xts, uint64_t firstSector, size_t sectorSize, const uint8_t* in, uint8_t* out, size_t length, thread_pool_t* pool) {
+
+    return xtsRun(xts, firstSector, sectorSize, in, out, length, pool, 0);
+
+}
+
+int xtsDecrypt(const xts_ctx_t* xts, uint64_t firstSector, size_t sectorSize, const uint8_t* in, uint8_t* out, size_t length, thread_pool_t* pool) {
+
+    return xtsRun(xts, firstSector, sectorSize, in, out, length, pool, 1);
+
+}